@@ -20,6 +20,7 @@
  * */
 
 #include "convenience.h"
+#include "kernels.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -27,6 +28,10 @@
 
 #ifndef _WIN32
 #include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #else
 #include <windows.h>
 #include <fcntl.h>
@@ -35,6 +40,7 @@
 #endif
 
 #include <math.h>
+#include <pthread.h>
 
 #include <SoapySDR/Device.h>
 #include <SoapySDR/Formats.h>
@@ -488,6 +494,254 @@ int verbose_device_search(char *s, SoapySDRDevice **devOut)
 	return 0;
 }
 
+static int query_value(const char *query, const char *key, char *out, size_t len)
+/* the value of key=value in a comma separated query, 1 if present */
+{
+	size_t n, klen = strlen(key);
+	const char *p = query;
+	while (p && *p) {
+		n = strcspn(p, ",");
+		if (n > klen && strncmp(p, key, klen) == 0 && p[klen] == '=') {
+			n -= klen + 1;
+			if (n >= len) {
+				n = len - 1;}
+			memcpy(out, p + klen + 1, n);
+			out[n] = '\0';
+			return 1;
+		}
+		p = p[n] ? p + n + 1 : NULL;
+	}
+	return 0;
+}
+
+static const char *input_format(const char *name)
+/* the SoapySDR constant, NULL if unknown */
+{
+	int i;
+	const char *formats[] = {SOAPY_SDR_CU8, SOAPY_SDR_CS8, SOAPY_SDR_CS12, SOAPY_SDR_CS16, SOAPY_SDR_CF32, NULL};
+	for (i=0; formats[i]; i++) {
+		if (strcasecmp(name, formats[i]) == 0) {
+			return formats[i];}
+	}
+	return NULL;
+}
+
+static double now_seconds(void)
+{
+#ifdef _WIN32
+	return (double)GetTickCount64() / 1000.0;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+static int open_shm(struct iq_input *in, const char *name)
+{
+	if (shm_ring_attach(&in->shm, name) != 0) {
+		return -1;}
+	in->format = input_format(shm_ring_format(&in->shm));
+	if (!in->format) {
+		fprintf(stderr, "IQ broadcast '%s' has unknown format %s.\n", name, shm_ring_format(&in->shm));
+		shm_ring_close(&in->shm);
+		return -1;
+	}
+	in->elem_size = shm_ring_elem_size(&in->shm);
+	in->rate = shm_ring_rate(&in->shm);
+	in->freq = shm_ring_freq(&in->shm);
+	fprintf(stderr, "Attached to IQ broadcast '%s': %s at %.0f Hz, %.0f S/s.\n",
+		name, in->format, in->freq, in->rate);
+	return 0;
+}
+
+static int open_file(struct iq_input *in, const char *s, const char *path)
+{
+	char value[64];
+	in->format = SOAPY_SDR_CU8;
+	if (query_value(s, "format", value, sizeof(value))) {
+		in->format = input_format(value);}
+	if (!in->format) {
+		fprintf(stderr, "Unknown input format %s.\n", value);
+		return -1;
+	}
+	if (!query_value(s, "rate", value, sizeof(value)) || (in->rate = atofs(value)) <= 0.0) {
+		fprintf(stderr, "The input needs its sample rate (rate=).\n");
+		return -1;
+	}
+	if (!query_value(s, "freq", value, sizeof(value))) {
+		fprintf(stderr, "The input needs its center frequency (freq=).\n");
+		return -1;
+	}
+	in->freq = atofs(value);
+	in->elem_size = SoapySDR_formatToSize(in->format);
+	in->offline = 1;
+	if (strcmp(path, "-") == 0) {
+		in->file = stdin;
+#ifdef _WIN32
+		_setmode(_fileno(stdin), _O_BINARY);
+#endif
+	} else {
+		in->file = fopen(path, "rb");}
+	if (!in->file) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return -1;
+	}
+	in->buf_elems = INPUT_BLOCK_ELEMS;
+	in->buf = malloc(in->buf_elems * in->elem_size);
+	if (!in->buf) {
+		return -1;}
+	fprintf(stderr, "Reading %s: %s at %.0f Hz, %.0f S/s.\n", path, in->format, in->freq, in->rate);
+	return 0;
+}
+
+#define SYNTH_DEFAULT	"fm:100.3M:-20:50k:1k;am:120.5M:-20:0.8:1k;noise:-50"
+
+static int synth_signal(struct synth *sy, char *item)
+/* kind:Hz:dB[:param:mod], 0 on success */
+{
+	char *f[5], *p = item;
+	int i, n = 0;
+	while (n < 5) {
+		f[n++] = p;
+		p = strchr(p, ':');
+		if (!p) {
+			break;}
+		*p++ = '\0';
+	}
+	for (i=0; i<n; i++) {
+		if (!f[i][0]) {
+			return -1;}
+	}
+	if (strcmp(f[0], "noise") == 0 && n == 2) {
+		return synth_add(sy, SYNTH_NOISE, 0.0, atof(f[1]), 0.0, 0.0);}
+	if (strcmp(f[0], "tone") == 0 && n == 3) {
+		return synth_add(sy, SYNTH_TONE, atofs(f[1]), atof(f[2]), 0.0, 0.0);}
+	if (n != 5) {
+		return -1;}
+	if (strcmp(f[0], "fm") == 0) {
+		return synth_add(sy, SYNTH_FM, atofs(f[1]), atof(f[2]), atofs(f[3]), atofs(f[4]));}
+	if (strcmp(f[0], "am") == 0) {
+		return synth_add(sy, SYNTH_AM, atofs(f[1]), atof(f[2]), atof(f[3]), atofs(f[4]));}
+	if (strcmp(f[0], "burst") == 0 && atof(f[4]) > 0.0) {
+		return synth_add(sy, SYNTH_BURST, atofs(f[1]), atof(f[2]), atof(f[3]), atof(f[4]));}
+	return -1;
+}
+
+static int open_synth(struct iq_input *in, const char *s, const char *spec)
+{
+	char value[64], list[1024], *item, *next;
+	int k;
+	in->format = SOAPY_SDR_CU8;
+	if (query_value(s, "format", value, sizeof(value))) {
+		in->format = input_format(value);}
+	if (!in->format) {
+		fprintf(stderr, "Unknown input format %s.\n", value);
+		return -1;
+	}
+	in->rate = 2400000.0;
+	if (query_value(s, "rate", value, sizeof(value)) && (in->rate = atofs(value)) <= 0.0) {
+		fprintf(stderr, "Invalid synth rate %s.\n", value);
+		return -1;
+	}
+	in->synth = malloc(sizeof(struct synth));
+	if (!in->synth) {
+		return -1;}
+	synth_init(in->synth, query_value(s, "seed", value, sizeof(value)) ? strtoull(value, NULL, 10) : 1);
+	snprintf(list, sizeof(list), "%s", spec[0] ? spec : SYNTH_DEFAULT);
+	for (item = list; item; item = next) {
+		next = strchr(item, ';');
+		if (next) {
+			*next++ = '\0';}
+		if (synth_signal(in->synth, item) != 0) {
+			fprintf(stderr, "Bad synth signal '%s'.\n", item);
+			return -1;
+		}
+	}
+	/* tuned to the first carrier until told otherwise */
+	in->freq = 100000000.0;
+	for (k=in->synth->count-1; k>=0; k--) {
+		if (in->synth->sig[k].kind != SYNTH_NOISE) {
+			in->freq = in->synth->sig[k].freq;}
+	}
+	if (query_value(s, "freq", value, sizeof(value))) {
+		in->freq = atofs(value);}
+	if (query_value(s, "samples", value, sizeof(value))) {
+		in->limit = (uint64_t)atofs(value);}
+	/* as fast as it is processed, unless it stands in for a live device */
+	in->offline = !(query_value(s, "realtime", value, sizeof(value)) && atoi(value));
+	in->tunable = 1;
+	in->elem_size = SoapySDR_formatToSize(in->format);
+	in->buf_elems = INPUT_BLOCK_ELEMS;
+	in->buf = malloc(in->buf_elems * in->elem_size);
+	in->synth_iq = malloc(in->buf_elems * 2 * sizeof(float));
+	in->synth_16 = malloc(in->buf_elems * 2 * sizeof(int16_t));
+	if (!in->buf || !in->synth_iq || !in->synth_16) {
+		return -1;}
+	fprintf(stderr, "Synthesizing %d signal%s: %s at %.0f Hz, %.0f S/s%s.\n", in->synth->count,
+		in->synth->count > 1 ? "s" : "", in->format, in->freq, in->rate, in->offline ? "" : ", in real time");
+	return 0;
+}
+
+int verbose_input_open(const char *s, struct iq_input *in)
+{
+	char value[1024];
+	memset(in, 0, sizeof(*in));
+	if (query_value(s, "shm", value, sizeof(value))) {
+		return open_shm(in, value) == 0 ? 1 : -1;}
+	if (query_value(s, "file", value, sizeof(value))) {
+		return open_file(in, s, value) == 0 ? 1 : -1;}
+	if (query_value(s, "synth", value, sizeof(value))) {
+		return open_synth(in, s, value) == 0 ? 1 : -1;}
+	return 0;
+}
+
+void input_close(struct iq_input *in)
+{
+	shm_ring_close(&in->shm);
+	if (in->file && in->file != stdin) {
+		fclose(in->file);}
+	in->file = NULL;
+	free(in->buf);
+	in->buf = NULL;
+	free(in->synth);
+	free(in->synth_iq);
+	free(in->synth_16);
+	in->synth = NULL;
+	in->synth_iq = NULL;
+	in->synth_16 = NULL;
+}
+
+int input_set_frequency(struct iq_input *in, double freq)
+{
+	if (!in->tunable) {
+		return -1;}
+	if (freq != in->freq) {
+		in->retunes++;}
+	in->freq = freq;
+	return 0;
+}
+
+int input_set_rate(struct iq_input *in, double rate)
+{
+	if (!in->tunable || rate <= 0.0) {
+		return -1;}
+	in->rate = rate;
+	return 0;
+}
+
+void input_report(struct iq_input *in)
+{
+	double elapsed = now_seconds() - in->started;
+	if (!in->samples || elapsed <= 0.0) {
+		return;}
+	fprintf(stderr, "Read %llu samples in %.3f s: %.2f MS/s, %.1fx real time.\n",
+		(unsigned long long)in->samples, elapsed, in->samples / elapsed / 1e6,
+		in->samples / elapsed / in->rate);
+	if (in->retunes) {
+		fprintf(stderr, "Retuned %llu times: %.1f hops/s.\n", (unsigned long long)in->retunes, in->retunes / elapsed);}
+}
+
 int verbose_setup_stream(SoapySDRDevice *dev, SoapySDRStream **streamOut, size_t channel, const char *format)
 {
 	SoapySDRKwargs stream_args = {0};
@@ -512,4 +766,443 @@ int verbose_setup_stream(SoapySDRDevice *dev, SoapySDRStream **streamOut, size_t
 	return 0;
 }
 
+const char *verbose_native_format(SoapySDRDevice *dev, size_t channel, const char * const *supported)
+{
+	int i;
+	double full_scale = 0.0;
+	const char *format = supported[0];
+	char *native = SoapySDRDevice_getNativeStreamFormat(dev, SOAPY_SDR_RX, channel, &full_scale);
+	if (!native) {
+		return format;}
+	for (i=0; supported[i]; i++) {
+		if (strcmp(native, supported[i]) == 0) {
+			format = supported[i];}
+	}
+	fprintf(stderr, "Native stream format %s (full scale %g), reading %s.\n", native, full_scale, format);
+	free(native);
+	return format;
+}
+
+int verbose_stream_reader(struct stream_reader *r, SoapySDRDevice *dev, SoapySDRStream *stream, int direct)
+{
+	memset(r, 0, sizeof(*r));
+	r->dev = dev;
+	r->stream = stream;
+	if (!direct) {
+		return 0;}
+	r->direct = (int)SoapySDRDevice_getNumDirectAccessBuffers(dev, stream);
+	if (r->direct > 0) {
+		fprintf(stderr, "Reading from %d driver buffers directly.\n", r->direct);
+	} else {
+		fprintf(stderr, "WARNING: no direct buffer access, using readStream.\n");}
+	return r->direct;
+}
+
+int verbose_input_reader(struct stream_reader *r, struct iq_input *in)
+{
+	memset(r, 0, sizeof(*r));
+	r->input = in;
+	r->direct = in->file || in->synth ? 1 : (int)shm_ring_slot_count(&in->shm);
+	return r->direct;
+}
+
+static int file_acquire(struct iq_input *in, const void **buf, size_t elems, int *flags, long long *timeNs)
+/* a whole number of elements, up to elems, stamped with the time into the recording */
+{
+	size_t n;
+	if (elems > in->buf_elems) {
+		elems = in->buf_elems;}
+	n = fread(in->buf, in->elem_size, elems, in->file);
+	if (n == 0) {
+		return STREAM_EOF;}
+	*buf = in->buf;
+	*flags = SOAPY_SDR_HAS_TIME;
+	*timeNs = (long long)((double)in->samples * 1e9 / in->rate);
+	return (int)n;
+}
+
+static int synth_acquire(struct iq_input *in, const void **buf, size_t elems, int *flags, long long *timeNs)
+/* render around the current tuning, paced to the rate in real time mode */
+{
+	size_t n = elems < in->buf_elems ? elems : in->buf_elems;
+	float *iq = strcmp(in->format, SOAPY_SDR_CF32) == 0 ? (float *)in->buf : in->synth_iq;
+	double freq = in->freq, rate = in->rate, ahead;
+	if (in->limit) {
+		if (in->samples >= in->limit) {
+			return STREAM_EOF;}
+		if (n > in->limit - in->samples) {
+			n = (size_t)(in->limit - in->samples);}
+	}
+	*flags = SOAPY_SDR_HAS_TIME;
+	*timeNs = (long long)(in->synth->time * 1e9);
+	synth_render(in->synth, iq, n, freq, rate);
+	if (strcmp(in->format, SOAPY_SDR_CS16) == 0) {
+		dsp.cf32_to_cs16(iq, (int16_t *)in->buf, 2 * n);}
+	else if (iq == in->synth_iq) {
+		dsp.cf32_to_cs16(iq, in->synth_16, 2 * n);
+		if (strcmp(in->format, SOAPY_SDR_CU8) == 0) {
+			dsp.cs16_to_cu8(in->synth_16, in->buf, 2 * n);}
+		else if (strcmp(in->format, SOAPY_SDR_CS8) == 0) {
+			dsp.cs16_to_cs8(in->synth_16, (int8_t *)in->buf, 2 * n);}
+		else {
+			dsp.cs16_to_cs12(in->synth_16, in->buf, 2 * n);}
+	}
+	*buf = in->buf;
+	if (!in->offline) {
+		in->paced += (double)n / rate;
+		ahead = in->started + in->paced - now_seconds();
+		if (ahead > 0.0) {
+#ifdef _WIN32
+			Sleep((DWORD)(ahead * 1000));
+#else
+			usleep((useconds_t)(ahead * 1e6));
+#endif
+		}
+	}
+	return (int)n;
+}
+
+static int input_acquire(struct stream_reader *r, const void **buf, size_t elems, int *flags, long long *timeNs, long timeoutUs)
+{
+	int n;
+	struct iq_input *in = r->input;
+	if (r->lapped) {
+		r->lapped = 0;
+		return SOAPY_SDR_OVERFLOW;
+	}
+	if (!in->samples) {
+		in->started = now_seconds();}
+	if (in->file || in->synth) {
+		n = in->file ? file_acquire(in, buf, elems, flags, timeNs) : synth_acquire(in, buf, elems, flags, timeNs);
+		if (n < 0) {
+			return n;}
+		in->samples += n;
+		return n;
+	}
+	n = shm_ring_acquire(&in->shm, buf, flags, timeNs, timeoutUs);
+	if (n == SHM_RING_TIMEOUT) {
+		return SOAPY_SDR_TIMEOUT;}
+	if (n == SHM_RING_CLOSED) {
+		return STREAM_EOF;}
+	if (n == SHM_RING_LAPPED) {
+		return SOAPY_SDR_OVERFLOW;}
+	r->held = 1;
+	in->samples += n;
+	return n;
+}
+
+/* the metrics every tool has, in front of the ones it registers */
+enum {METRIC_SAMPLES, METRIC_OVERFLOWS, METRIC_READ_ERRORS, METRIC_COMMON};
+
+static struct metric metrics[METRICS_MAX] = {
+	{"rx_samples_total", "Complex samples read from the device or input.", METRIC_COUNTER, 1.0, 0},
+	{"rx_overflows_total", "Reads that reported samples lost before they were read.", METRIC_COUNTER, 1.0, 0},
+	{"rx_read_errors_total", "Reads that failed for another reason than a timeout.", METRIC_COUNTER, 1.0, 0},
+};
+static int metric_count = METRIC_COMMON;
+
+#define METRICS_TEXT		(16 * 1024)
+#define METRICS_PERIOD_MS	1000
+#define METRICS_POLL_MS		100
+
+static struct
+{
+	const char *tool;
+	char path[256];
+	int unix_socket;
+	int fd;
+	volatile int stop;
+	int running;
+	pthread_t thread;
+} exporter;
+
+#ifdef _MSC_VER
+#define metric_load(p)		InterlockedCompareExchange64((volatile LONG64 *)(p), 0, 0)
+#else
+#define metric_load(p)		__atomic_load_n((p), __ATOMIC_RELAXED)
+#endif
+
+struct metric *metric_new(enum metric_kind kind, const char *name, const char *help, double scale)
+{
+	struct metric *m;
+	if (metric_count >= METRICS_MAX) {
+		fprintf(stderr, "Too many metrics, %s is not exported.\n", name);
+		return NULL;
+	}
+	m = &metrics[metric_count++];
+	m->name = name;
+	m->help = help;
+	m->kind = kind;
+	m->scale = scale;
+	m->value = 0;
+	return m;
+}
+
+void metric_add(struct metric *m, int64_t v)
+{
+	if (!m) {
+		return;}
+#ifdef _MSC_VER
+	InterlockedExchangeAdd64((volatile LONG64 *)&m->value, v);
+#else
+	__atomic_fetch_add(&m->value, v, __ATOMIC_RELAXED);
+#endif
+}
+
+void metric_set(struct metric *m, int64_t v)
+{
+	if (!m) {
+		return;}
+#ifdef _MSC_VER
+	InterlockedExchange64((volatile LONG64 *)&m->value, v);
+#else
+	__atomic_store_n(&m->value, v, __ATOMIC_RELAXED);
+#endif
+}
+
+int64_t metric_clock(void)
+{
+#ifdef _WIN32
+	return (int64_t)GetTickCount64() * 1000000;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+void metric_add_since(struct metric *m, int64_t start)
+{
+	metric_add(m, metric_clock() - start);
+}
+
+static size_t metrics_render(char *buf, size_t len)
+/* the Prometheus text exposition format, version 0.0.4 */
+{
+	int i, n;
+	size_t used = 0;
+	struct metric *m;
+	for (i=0; i<metric_count; i++) {
+		m = &metrics[i];
+		n = snprintf(buf + used, len - used, "# HELP %s %s\n# TYPE %s %s\n%s{tool=\"%s\"} %.15g\n",
+			m->name, m->help, m->name, m->kind == METRIC_COUNTER ? "counter" : "gauge",
+			m->name, exporter.tool, (double)metric_load(&m->value) * m->scale);
+		if (n < 0 || (size_t)n >= len - used) {
+			break;}
+		used += n;
+	}
+	return used;
+}
+
+static void metrics_pause(int ms)
+{
+#ifdef _WIN32
+	Sleep(ms);
+#else
+	usleep(ms * 1000);
+#endif
+}
+
+static int metrics_write_file(void)
+/* written aside and renamed, the collector never sees half a file */
+{
+	char text[METRICS_TEXT];
+	char tmp[sizeof(exporter.path) + 8];
+	size_t len = metrics_render(text, sizeof(text));
+	FILE *f;
+	snprintf(tmp, sizeof(tmp), "%s.tmp", exporter.path);
+	f = fopen(tmp, "w");
+	if (!f) {
+		return -1;}
+	if (fwrite(text, 1, len, f) != len) {
+		fclose(f);
+		remove(tmp);
+		return -1;
+	}
+	fclose(f);
+#ifdef _WIN32
+	remove(exporter.path);
+#endif
+	return rename(tmp, exporter.path);
+}
+
+#ifndef _WIN32
+
+static void metrics_serve(int fd)
+/* plain text for nc -U, an HTTP response when it asks like a scraper */
+{
+	char text[METRICS_TEXT];
+	char head[128], req[512];
+	struct pollfd p = {fd, POLLIN, 0};
+	size_t len;
+	ssize_t n = 0;
+	int flags = 0;
+#ifdef MSG_NOSIGNAL
+	flags = MSG_NOSIGNAL;
+#endif
+	if (poll(&p, 1, METRICS_POLL_MS) > 0) {
+		n = recv(fd, req, sizeof(req) - 1, 0);}
+	len = metrics_render(text, sizeof(text));
+	if (n >= 4 && memcmp(req, "GET ", 4) == 0) {
+		n = snprintf(head, sizeof(head), "HTTP/1.0 200 OK\r\n"
+			"Content-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n", len);
+		if (send(fd, head, n, flags) != n) {
+			return;}
+	}
+	send(fd, text, len, flags);
+}
+
+static int metrics_listen(void)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(exporter.path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Metrics socket path '%s' is too long.\n", exporter.path);
+		return -1;
+	}
+	strcpy(addr.sun_path, exporter.path);
+	exporter.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (exporter.fd < 0) {
+		perror("socket");
+		return -1;
+	}
+	/* a socket left behind by a crashed run is simply replaced */
+	unlink(exporter.path);
+	if (bind(exporter.fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(exporter.fd, 4) != 0) {
+		perror("metrics socket");
+		close(exporter.fd);
+		return -1;
+	}
+	return 0;
+}
+
+#else
+
+static void metrics_serve(int fd)
+{
+}
+
+static int metrics_listen(void)
+{
+	fprintf(stderr, "Metrics sockets are not supported on this platform, use a textfile.\n");
+	return -1;
+}
+
+#endif
+
+static void *metrics_thread_fn(void *arg)
+{
+	int waited;
+	while (!exporter.stop) {
+#ifndef _WIN32
+		if (exporter.unix_socket) {
+			struct pollfd p = {exporter.fd, POLLIN, 0};
+			int fd;
+			if (poll(&p, 1, METRICS_POLL_MS) <= 0) {
+				continue;}
+			fd = accept(exporter.fd, NULL, NULL);
+			if (fd < 0) {
+				continue;}
+			metrics_serve(fd);
+			close(fd);
+			continue;
+		}
+#endif
+		metrics_write_file();
+		for (waited=0; waited < METRICS_PERIOD_MS && !exporter.stop; waited += METRICS_POLL_MS) {
+			metrics_pause(METRICS_POLL_MS);}
+	}
+	return 0;
+}
+
+int verbose_metrics_start(const char *dest, const char *tool)
+{
+	exporter.tool = tool;
+	exporter.unix_socket = strncmp(dest, "unix:", 5) == 0;
+	if (exporter.unix_socket) {
+		dest += 5;}
+	if (!dest[0] || strlen(dest) >= sizeof(exporter.path)) {
+		fprintf(stderr, "Invalid metrics destination '%s'.\n", dest);
+		return -1;
+	}
+	snprintf(exporter.path, sizeof(exporter.path), "%s", dest);
+	if (exporter.unix_socket && metrics_listen() != 0) {
+		return -1;}
+	if (!exporter.unix_socket && metrics_write_file() != 0) {
+		fprintf(stderr, "Failed to write metrics to %s.\n", exporter.path);
+		return -1;
+	}
+	exporter.stop = 0;
+	if (pthread_create(&exporter.thread, NULL, metrics_thread_fn, NULL) != 0) {
+		return -1;}
+	exporter.running = 1;
+	fprintf(stderr, "Exporting metrics %s %s.\n", exporter.unix_socket ? "on socket" : "to", exporter.path);
+	return 0;
+}
+
+void metrics_stop(void)
+{
+	if (!exporter.running) {
+		return;}
+	exporter.stop = 1;
+	pthread_join(exporter.thread, NULL);
+	exporter.running = 0;
+	if (!exporter.unix_socket) {
+		metrics_write_file();
+		return;
+	}
+#ifndef _WIN32
+	close(exporter.fd);
+	unlink(exporter.path);
+#endif
+}
+
+static int acquire(struct stream_reader *r, const void **buf, void *fallback, size_t elems,
+	int *flags, long long *timeNs, long timeoutUs)
+{
+	int n;
+	void *buffs[] = {fallback};
+	const void *direct_buffs[] = {NULL};
+	if (r->input) {
+		return input_acquire(r, buf, elems, flags, timeNs, timeoutUs);}
+	if (!r->direct) {
+		*buf = fallback;
+		return SoapySDRDevice_readStream(r->dev, r->stream, buffs, elems, flags, timeNs, timeoutUs);
+	}
+	n = SoapySDRDevice_acquireReadBuffer(r->dev, r->stream, &r->handle, direct_buffs, flags, timeNs, timeoutUs);
+	if (n < 0) {
+		return n;}
+	r->held = 1;
+	*buf = direct_buffs[0];
+	return n;
+}
+
+int stream_acquire(struct stream_reader *r, const void **buf, void *fallback, size_t elems,
+	int *flags, long long *timeNs, long timeoutUs)
+{
+	int n = acquire(r, buf, fallback, elems, flags, timeNs, timeoutUs);
+	if (n > 0) {
+		metric_add(&metrics[METRIC_SAMPLES], n);
+	} else if (n == SOAPY_SDR_OVERFLOW) {
+		metric_add(&metrics[METRIC_OVERFLOWS], 1);
+	} else if (n < 0 && n != SOAPY_SDR_TIMEOUT && n != STREAM_EOF) {
+		metric_add(&metrics[METRIC_READ_ERRORS], 1);}
+	return n;
+}
+
+void stream_release(struct stream_reader *r)
+{
+	if (!r->held) {
+		return;}
+	r->held = 0;
+	if (r->input) {
+		/* the samples were overwritten while in use, report it next time */
+		if (!r->input->file && shm_ring_release(&r->input->shm) != 0) {
+			r->lapped = 1;}
+		return;
+	}
+	SoapySDRDevice_releaseReadBuffer(r->dev, r->stream, r->handle);
+}
+
 // vim: tabstop=8:softtabstop=8:shiftwidth=8:noexpandtab
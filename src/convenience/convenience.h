@@ -30,7 +30,10 @@ struct tm *localtime_r (const time_t *timer, struct tm *result);
 #endif
 
 #include <stdint.h>
+#include <stdio.h>
 #include <SoapySDR/Device.h>
+#include "shm_ring.h"
+#include "synth.h"
 
 
 /* a collection of user friendly tools */
@@ -185,6 +188,222 @@ int verbose_device_search(char *s, SoapySDRDevice **devOut);
  */
 int verbose_setup_stream(SoapySDRDevice *dev, SoapySDRStream **streamOut, size_t channel, const char *format);
 
+/*!
+ * Pick the stream format, the device's native one when the caller
+ * has a processing path for it, so SoapySDR does not convert
+ *
+ * \param dev the device handle
+ * \param channel channel to listen
+ * \param supported NULL terminated formats the caller handles, the first is the fallback
+ * \return one of supported
+ */
+const char *verbose_native_format(SoapySDRDevice *dev, size_t channel, const char * const *supported);
+
+/*
+ * Samples from somewhere else than a device, named by the device query:
+ *   shm=name attaches to the broadcast of an rx_sdr -P name, the
+ *     frequency and rate are whatever the producer was tuned to
+ *   file=path,rate=Hz,freq=Hz[,format=CU8] reads a recording ('-' for
+ *     stdin) as fast as it can be processed, format is CU8, CS8, CS12,
+ *     CS16 or CF32
+ *   synth=signal[;signal...][,rate=Hz][,freq=Hz][,format=CU8]
+ *     [,samples=N][,seed=N][,realtime=1] generates deterministic samples
+ *     and can be tuned like a device, see input_set_frequency(), a
+ *     signal is one of
+ *       tone:Hz:dB  fm:Hz:dB:deviation:tone  am:Hz:dB:depth:tone
+ *       burst:Hz:dB:seconds_on:period  noise:dB
+ *     with levels in dB full scale, an empty list is a broadcast FM
+ *     station at 100.3M, an AM voice channel at 120.5M and noise
+ */
+#define INPUT_BLOCK_ELEMS	(256 * 1024)
+
+struct iq_input
+{
+	const char *format;
+	size_t elem_size;
+	double rate;
+	double freq;
+	int offline;       /* a recording, wait for the processing instead of dropping */
+	uint64_t samples;  /* elements read */
+	double started;    /* seconds, when the first block was read */
+	struct shm_ring shm;
+	FILE *file;
+	uint8_t *buf;      /* file, synth: the block being read */
+	size_t buf_elems;
+	int tunable;       /* follows input_set_frequency() and input_set_rate() */
+	struct synth *synth;
+	float *synth_iq;   /* rendered before the conversion to format */
+	int16_t *synth_16;
+	uint64_t limit;    /* synth: elements until the end, 0 for none */
+	double paced;      /* synth in real time: seconds handed out */
+	uint64_t retunes;  /* input_set_frequency() changes */
+};
+
+/* stream_acquire() result once an input has ended */
+#define STREAM_EOF	-100
+
+/*!
+ * Attach to the input named by a device query instead of opening a device
+ *
+ * \param s device query
+ * \param in input to set up
+ * \return 1 for an input, 0 when the query is for a device, -1 on failure
+ */
+int verbose_input_open(const char *s, struct iq_input *in);
+
+void input_close(struct iq_input *in);
+
+/*!
+ * Tune a synthetic input like setFrequency, the next block is at freq
+ *
+ * \param in the input
+ * \param freq center frequency in Hz
+ * \return 0 on success, -1 when the input can not be tuned
+ */
+int input_set_frequency(struct iq_input *in, double freq);
+
+/*!
+ * Change the rate of a synthetic input like setSampleRate
+ *
+ * \param in the input
+ * \param rate sample rate in Hz
+ * \return 0 on success, -1 when the input can not be tuned
+ */
+int input_set_rate(struct iq_input *in, double rate);
+
+/*!
+ * Report on stderr how fast the input was read, the throughput of an
+ * offline run
+ *
+ * \param in the input
+ */
+void input_report(struct iq_input *in);
+
+/*
+ * Reading a stream from the driver's own buffers when it offers direct
+ * access, so the samples can be processed without a copy, otherwise
+ * with readStream into a buffer supplied by the caller.  Inputs are
+ * always read in place, like driver buffers.
+ */
+struct stream_reader
+{
+	SoapySDRDevice *dev;
+	SoapySDRStream *stream;
+	struct iq_input *input;  /* instead of the device */
+	int direct;     /* driver buffers, 0 when reading with readStream */
+	int held;       /* handle is acquired and not yet released */
+	int lapped;     /* an input block was overwritten while held */
+	size_t handle;
+};
+
+/*!
+ * Prepare reading from an open stream
+ *
+ * \param r reader to set up
+ * \param dev the device handle
+ * \param stream stream to read
+ * \param direct try direct buffer access
+ * \return number of driver buffers, 0 if reading with readStream
+ */
+int verbose_stream_reader(struct stream_reader *r, SoapySDRDevice *dev, SoapySDRStream *stream, int direct);
+
+/*!
+ * Prepare reading from an input
+ *
+ * \param r reader to set up
+ * \param in input opened by verbose_input_open()
+ * \return number of input blocks held in memory
+ */
+int verbose_input_reader(struct stream_reader *r, struct iq_input *in);
+
+/*!
+ * Get the next block of samples, pair every success with stream_release()
+ *
+ * \param r the reader
+ * \param buf set to the samples, a driver buffer or fallback
+ * \param fallback readStream target, not used with direct access
+ * \param elems readStream size, driver buffers may hold more
+ * \param flags as for readStream
+ * \param timeNs as for readStream
+ * \param timeoutUs as for readStream
+ * \return number of elements, a SoapySDR error code or STREAM_EOF
+ */
+int stream_acquire(struct stream_reader *r, const void **buf, void *fallback, size_t elems,
+	int *flags, long long *timeNs, long timeoutUs);
+
+/*!
+ * Hand a driver buffer back, nothing to do after readStream
+ *
+ * \param r the reader
+ */
+void stream_release(struct stream_reader *r);
+
+/*
+ * Metrics for fleet monitoring in the Prometheus text format.  A metric
+ * is one 64 bit integer updated with relaxed atomics, the sample path
+ * never takes a lock.  Register everything before verbose_metrics_start(),
+ * a background thread then serves the current values on a unix socket
+ * (plain text for nc -U, an HTTP response to a GET) or rewrites a
+ * textfile for node_exporter's textfile collector every second.
+ *
+ * Every tool has rx_samples_total, rx_overflows_total and
+ * rx_read_errors_total, counted by stream_acquire().
+ */
+#define METRICS_MAX	32
+
+enum metric_kind {METRIC_COUNTER, METRIC_GAUGE};
+
+struct metric
+{
+	const char *name;
+	const char *help;
+	enum metric_kind kind;
+	double scale;      /* from the stored integer to the exported unit */
+	int64_t value;
+};
+
+/*!
+ * Register a metric, not thread safe
+ *
+ * \param kind counter or gauge
+ * \param name full Prometheus name, counters end in _total
+ * \param help one line description
+ * \param scale exported value per stored unit, 1e-9 for nanoseconds as seconds
+ * \return the metric, NULL when the table is full
+ */
+struct metric *metric_new(enum metric_kind kind, const char *name, const char *help, double scale);
+
+/*!
+ * Update a metric from any thread, a NULL metric is ignored
+ *
+ * \param m the metric
+ * \param v amount to add, or the new value
+ */
+void metric_add(struct metric *m, int64_t v);
+void metric_set(struct metric *m, int64_t v);
+
+/*!
+ * Time a section into a metric of nanoseconds
+ *
+ * \return start time for metric_add_since()
+ */
+int64_t metric_clock(void);
+void metric_add_since(struct metric *m, int64_t start);
+
+/*!
+ * Start exporting the metrics
+ *
+ * \param dest unix:path for a socket, otherwise the path of a textfile
+ * \param tool value of the tool label on every metric
+ * \return 0 on success
+ */
+int verbose_metrics_start(const char *dest, const char *tool);
+
+/*!
+ * Stop exporting, a textfile gets the final values
+ */
+void metrics_stop(void);
+
 /*!
  * Apply settings to device
  *
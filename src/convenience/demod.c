@@ -0,0 +1,387 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* demodulators and audio filters of rx_fm */
+
+#ifdef _WIN32
+#define _USE_MATH_DEFINES
+#endif
+
+#include "demod.h"
+#include "kernels.h"
+#include <stdlib.h>
+#include <math.h>
+
+/*
+ * -A lut, 3 KB of tables instead of a 512 KB one.  The angle within
+ * the first octant follows from the ratio of the smaller leg to the
+ * larger, taken as a difference of logs so no sample needs a division
+ * or a reciprocal: log2 of each leg is its top bit plus log2 of the
+ * mantissa from atan_log, and atan_lut has the angle at every
+ * 1/ATAN_STEPS of an octave of the ratio down to 2^-ATAN_OCTAVES.
+ * Both hold value and slope side by side, so each interpolates from
+ * one lookup, and nothing branches on the sample.
+ */
+#define ATAN_LOG_BITS	8
+#define ATAN_LOG	(1 << ATAN_LOG_BITS)
+#define ATAN_STEP_BITS	5
+#define ATAN_STEPS	(1 << ATAN_STEP_BITS)
+#define ATAN_OCTAVES	16
+#define ATAN_LAST	(ATAN_STEPS * ATAN_OCTAVES)
+#define ATAN_FRAC	3     /* bits below the output's lsb in atan_lut */
+
+static uint16_t atan_log[2 * ATAN_LOG];  /* log2(1 + i/ATAN_LOG) in 16.16 and its step */
+static uint16_t atan_lut[2 * (ATAN_LAST + 1)];  /* angle and its int16 step to the next, the last is flat */
+
+int low_pass_simple(int16_t *signal2, int len, int step)
+// no wrap around, length must be multiple of step
+{
+	int i, i2, sum;
+	for(i=0; i < len; i+=step) {
+		sum = 0;
+		for(i2=0; i2<step; i2++) {
+			sum += (int)signal2[i + i2];
+		}
+		//signal2[i/step] = (int16_t)(sum / step);
+		signal2[i/step] = (int16_t)(sum);
+	}
+	signal2[i/step + 1] = signal2[i/step];
+	return len / step;
+}
+
+static int16_t clip16(int64_t x)
+{
+	if (x > 32767) {
+		return 32767;}
+	if (x < -32768) {
+		return -32768;}
+	return (int16_t)x;
+}
+
+/* define our own complex math ops
+   because ARMv5 has no hardware float */
+
+static void multiply(int ar, int aj, int br, int bj, int64_t *cr, int64_t *cj)
+/* full scale 16 bit products need 32 bits plus sign */
+{
+	*cr = (int64_t)ar*br - (int64_t)aj*bj;
+	*cj = (int64_t)aj*br + (int64_t)ar*bj;
+}
+
+static int fast_atan2(int64_t y, int64_t x)
+/* pre scaled for int16 */
+{
+	int64_t yabs, angle;
+	int pi4=(1<<12), pi34=3*(1<<12);  // note pi = 1<<14
+	if (x==0 && y==0) {
+		return 0;
+	}
+	yabs = y;
+	if (yabs < 0) {
+		yabs = -yabs;
+	}
+	if (x >= 0) {
+		angle = pi4  - pi4 * (x-yabs) / (x+yabs);
+	} else {
+		angle = pi34 - pi4 * (x+yabs) / (yabs-x);
+	}
+	if (y < 0) {
+		return (int)-angle;
+	}
+	return (int)angle;
+}
+
+static int polar_disc_fast(int ar, int aj, int br, int bj)
+{
+	int64_t cr, cj;
+	multiply(ar, aj, br, -bj, &cr, &cj);
+	return fast_atan2(cj, cr);
+}
+
+int atan_lut_init(void)
+{
+	int i;
+	long v, next;
+	for (i=0; i<ATAN_LOG; i++) {
+		v = lround(log2(1.0 + (double)i / ATAN_LOG) * 65536.0);
+		next = lround(log2(1.0 + (double)(i + 1) / ATAN_LOG) * 65536.0);
+		atan_log[2*i] = (uint16_t)v;
+		atan_log[2*i+1] = (uint16_t)(next - v);
+	}
+	for (i=0; i<=ATAN_LAST; i++) {
+		v = lround(atan(pow(2.0, -(double)i / ATAN_STEPS)) / M_PI * (1 << (14 + ATAN_FRAC)));
+		next = lround(atan(pow(2.0, -(double)(i + 1) / ATAN_STEPS)) / M_PI * (1 << (14 + ATAN_FRAC)));
+		/* with half an output lsb added, so the shift rounds */
+		atan_lut[2*i] = (uint16_t)(v + (1 << (ATAN_FRAC - 1)));
+		atan_lut[2*i+1] = (uint16_t)(i < ATAN_LAST ? next - v : 0);
+	}
+	return 0;
+}
+
+static int msb32(uint32_t v)
+/* v > 0 */
+{
+#ifdef __GNUC__
+	return 31 - __builtin_clz(v);
+#else
+	int n = 0;
+	if (v >> 16) {
+		v >>= 16;
+		n += 16;
+	}
+	if (v >> 8) {
+		v >>= 8;
+		n += 8;
+	}
+	if (v >> 4) {
+		v >>= 4;
+		n += 4;
+	}
+	if (v >> 2) {
+		v >>= 2;
+		n += 2;
+	}
+	return n + (int)(v >> 1);
+#endif
+}
+
+static int polar_disc_lut(int ar, int aj, int br, int bj)
+{
+	int64_t cr, cj;
+	uint32_t ax, ay, mx, mn, fx, fn, k;
+	int sx, sn, d, swap, flat, angle;
+	const uint16_t *lx, *ln, *t;
+
+	multiply(ar, aj, br, -bj, &cr, &cj);
+	/* at most 2^31 */
+	ax = (uint32_t)(cr < 0 ? -cr : cr);
+	ay = (uint32_t)(cj < 0 ? -cj : cj);
+	swap = ay > ax;
+	mx = swap ? ay : ax;
+	mn = swap ? ax : ay;
+	flat = mn == 0;
+
+	/* log2 of each leg is its top bit and the interpolated log of the
+	   mantissa, only the difference is needed so the top bits subtract */
+	sx = 31 - msb32(mx | 1);
+	sn = 31 - msb32(mn | 1);
+	mx = (mx | 1) << sx;
+	mn = (mn | 1) << sn;
+	lx = atan_log + 2 * ((mx >> (31 - ATAN_LOG_BITS)) & (ATAN_LOG - 1));
+	ln = atan_log + 2 * ((mn >> (31 - ATAN_LOG_BITS)) & (ATAN_LOG - 1));
+	fx = (mx >> (15 - ATAN_LOG_BITS)) & 0xffff;
+	fn = (mn >> (15 - ATAN_LOG_BITS)) & 0xffff;
+	d = ((sn - sx) << 16) + lx[0] - ln[0] + (((int)(lx[1] * fx) - (int)(ln[1] * fn)) >> 16);
+
+	/* the first octant, past 2^-ATAN_OCTAVES and at a 0 leg the flat last entry */
+	k = (uint32_t)d >> (16 - ATAN_STEP_BITS) | -(uint32_t)flat;
+	k = k < ATAN_LAST ? k : ATAN_LAST;
+	t = atan_lut + 2 * k;
+	d &= (1 << (16 - ATAN_STEP_BITS)) - 1;
+	angle = (t[0] + (((int16_t)t[1] * d) >> (16 - ATAN_STEP_BITS))) >> ATAN_FRAC;
+
+	/* and unfolded to the others */
+	if (swap) {
+		angle = (1 << 13) - angle;}
+	if (cr < 0) {
+		angle = (1 << 14) - angle;}
+	return cj < 0 ? -angle : angle;
+}
+
+static int esbensen(int ar, int aj, int br, int bj)
+/*
+  input signal: s(t) = a*exp(-i*w*t+p)
+  a = amplitude, w = angular freq, p = phase difference
+  solve w
+  s' = -i(w)*a*exp(-i*w*t+p)
+  s'*conj(s) = -i*w*a*a
+  s'*conj(s) / |s|^2 = -i*w
+*/
+{
+	int64_t cj, dr, dj;
+	int64_t scaled_pi = 2608; /* 1<<14 / (2*pi) */
+	dr = (br - ar) * 2;
+	dj = (bj - aj) * 2;
+	cj = bj*dr - br*dj; /* imag(ds*conj(s)) */
+	return (int)(scaled_pi * cj / ((int64_t)ar*ar + (int64_t)aj*aj + 1));
+}
+
+/* block discriminators, out may alias lp, each sample is read before its slot is written */
+typedef void (*fm_disc_fn)(const int16_t *lp, int16_t *out, int n, int pr, int pj);
+
+static void disc_std(const int16_t *lp, int16_t *out, int n, int pr, int pj)
+{
+	dsp.fm_disc(lp, out, n, pr, pj);
+}
+
+static void disc_fast(const int16_t *lp, int16_t *out, int n, int pr, int pj)
+{
+	int k, r, j;
+	for (k=0; k<n; k++) {
+		r = lp[2*k];
+		j = lp[2*k+1];
+		out[k] = (int16_t)polar_disc_fast(r, j, pr, pj);
+		pr = r;
+		pj = j;
+	}
+}
+
+static void disc_lut(const int16_t *lp, int16_t *out, int n, int pr, int pj)
+{
+	int k, r, j;
+	for (k=0; k<n; k++) {
+		r = lp[2*k];
+		j = lp[2*k+1];
+		out[k] = (int16_t)polar_disc_lut(r, j, pr, pj);
+		pr = r;
+		pj = j;
+	}
+}
+
+static void disc_esbensen(const int16_t *lp, int16_t *out, int n, int pr, int pj)
+{
+	int k, r, j;
+	for (k=0; k<n; k++) {
+		r = lp[2*k];
+		j = lp[2*k+1];
+		out[k] = (int16_t)esbensen(r, j, pr, pj);
+		pr = r;
+		pj = j;
+	}
+}
+
+/* by custom_atan */
+static const fm_disc_fn fm_discs[] = {disc_std, disc_fast, disc_lut, disc_esbensen};
+
+void fm_demod(struct demod_state *fm)
+/* result may alias lowpassed, so the last sample is kept before it can be overwritten */
+{
+	int n = fm->lp_len / 2;
+	int16_t *lp = fm->lowpassed;
+	int pr, pj;
+	fm->result_len = n;
+	if (n < 1) {
+		return;}
+	pr = lp[2*n-2];
+	pj = lp[2*n-1];
+	fm_discs[fm->custom_atan](lp, fm->result, n, fm->pre_r, fm->pre_j);
+	fm->pre_r = pr;
+	fm->pre_j = pj;
+}
+
+void am_demod(struct demod_state *fm)
+// todo, fix this extreme laziness
+{
+	int i;
+	int64_t pcm;
+	int16_t *lp = fm->lowpassed;
+	int16_t *r  = fm->result;
+	for (i = 0; i < fm->lp_len; i += 2) {
+		// hypot uses floats but won't overflow
+		//r[i/2] = (int16_t)hypot(lp[i], lp[i+1]);
+		pcm = (int64_t)lp[i] * lp[i];
+		pcm += (int64_t)lp[i+1] * lp[i+1];
+		r[i/2] = clip16((int64_t)sqrt((double)pcm));
+	}
+	fm->result_len = fm->lp_len/2;
+	// lowpass? (3khz)  highpass?  (dc)
+}
+
+void usb_demod(struct demod_state *fm)
+{
+	int i, pcm;
+	int16_t *lp = fm->lowpassed;
+	int16_t *r  = fm->result;
+	for (i = 0; i < fm->lp_len; i += 2) {
+		pcm = lp[i] + lp[i+1];
+		r[i/2] = clip16(pcm);
+	}
+	fm->result_len = fm->lp_len/2;
+}
+
+void lsb_demod(struct demod_state *fm)
+{
+	int i, pcm;
+	int16_t *lp = fm->lowpassed;
+	int16_t *r  = fm->result;
+	for (i = 0; i < fm->lp_len; i += 2) {
+		pcm = lp[i] - lp[i+1];
+		r[i/2] = clip16(pcm);
+	}
+	fm->result_len = fm->lp_len/2;
+}
+
+void raw_demod(struct demod_state *fm)
+/* result aliases lowpassed, nothing to move */
+{
+	fm->result_len = fm->lp_len;
+}
+
+void deemph_filter(struct demod_state *fm)
+{
+	static int avg;  // cheating...
+	int i, d;
+	// de-emph IIR
+	// avg = avg * (1 - alpha) + sample * alpha;
+	for (i = 0; i < fm->result_len; i++) {
+		d = fm->result[i] - avg;
+		if (d > 0) {
+			avg += (d + fm->deemph_a/2) / fm->deemph_a;
+		} else {
+			avg += (d - fm->deemph_a/2) / fm->deemph_a;
+		}
+		fm->result[i] = (int16_t)avg;
+	}
+}
+
+void dc_block_audio_filter(struct demod_state *fm)
+{
+	int i, avg;
+	int64_t sum = 0;
+	for (i=0; i < fm->result_len; i++) {
+		sum += fm->result[i];
+	}
+	avg = sum / fm->result_len;
+	avg = (avg + fm->dc_avg * fm->adc_block_const) / ( fm->adc_block_const + 1 );
+	for (i=0; i < fm->result_len; i++) {
+		fm->result[i] -= avg;
+	}
+	fm->dc_avg = avg;
+}
+
+void dc_block_raw_filter(struct demod_state *fm, int16_t *buf, int len)
+{
+	/* derived from dc_block_audio_filter,
+		running over the raw I/Q components
+	*/
+	int i, avgI, avgQ;
+	int64_t sumI = 0;
+	int64_t sumQ = 0;
+	for (i = 0; i < len; i += 2) {
+		sumI += buf[i];
+		sumQ += buf[i+1];
+	}
+	avgI = sumI / ( len / 2 );
+	avgQ = sumQ / ( len / 2 );
+	avgI = (avgI + fm->dc_avgI * fm->rdc_block_const) / ( fm->rdc_block_const + 1 );
+	avgQ = (avgQ + fm->dc_avgQ * fm->rdc_block_const) / ( fm->rdc_block_const + 1 );
+	for (i = 0; i < len; i += 2) {
+		buf[i] -= avgI;
+		buf[i+1] -= avgQ;
+	}
+	fm->dc_avgI = avgI;
+	fm->dc_avgQ = avgQ;
+}
+
+// vim: tabstop=8:softtabstop=8:shiftwidth=8:noexpandtab
@@ -0,0 +1,110 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __DEMOD_H
+#define __DEMOD_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "ring.h"
+#include "kernels.h"
+#include "fir.h"
+
+/*
+ * rx_fm's demodulators and the filters around them, they work
+ * in place on full scale 16 bit samples
+ */
+
+struct output_state;
+
+struct demod_state
+{
+	int	  exit_flag;
+	pthread_t thread;
+	int16_t  *lowpassed;  /* both point into the block being demodulated */
+	int	  lp_len;
+	struct cic_state cic;  /* the fifth_order passes with -F, or ahead of channel */
+	struct fir_filter droop;  /* after them, with -F 9 */
+	struct fir_filter channel;  /* decimation by downsample without -F */
+	int	  channel_passes;  /* halvings by cic before it */
+	struct fir_resampler resample;  /* rate_out to rate_out2 with -r */
+	int16_t  *result;
+	int	  result_len;
+	int	  rate_in;
+	int	  rate_out;
+	int	  rate_out2;
+	int	  pre_r, pre_j;
+	int	  downsample;	/* min 1, max 256 */
+	int	  post_downsample;
+	int	  squelch_level, conseq_squelch, squelch_hits, terminate_on_squelch, squelch_zero;
+	int	  downsample_passes;
+	int	  comp_fir_size;
+	int	  custom_atan;
+	int	  deemph, deemph_a;
+	int	  dc_block_audio, dc_avg, adc_block_const;
+	int	  dc_block_raw, dc_avgI, dc_avgQ, rdc_block_const;
+	void	 (*mode_demod)(struct demod_state*);
+	int	  ring_depth;
+	struct ring_buffer ring;  /* blocks from the dongle thread */
+	struct output_state *output_target;
+};
+
+/*!
+ * Sum every step real samples, no state kept between calls
+ *
+ * \param signal2 samples, decimated in place
+ * \param len number of samples, a multiple of step
+ * \param step decimation factor
+ * \return number of samples left
+ */
+int low_pass_simple(int16_t *signal2, int len, int step);
+
+/*!
+ * Build the tables for custom_atan 2, once before fm_demod() uses them
+ *
+ * \return 0 on success
+ */
+int atan_lut_init(void);
+
+/*!
+ * Phase differences of lowpassed into result, with the discriminator
+ * picked by custom_atan once per block: 0 std (dsp.fm_disc), 1 fast,
+ * 2 lut, 3 esbensen
+ */
+void fm_demod(struct demod_state *fm);
+void am_demod(struct demod_state *fm);
+void usb_demod(struct demod_state *fm);
+void lsb_demod(struct demod_state *fm);
+void raw_demod(struct demod_state *fm);
+
+/*!
+ * Single pole de-emphasis of result, time constant deemph_a samples
+ */
+void deemph_filter(struct demod_state *fm);
+
+/*!
+ * Remove the running average from result
+ */
+void dc_block_audio_filter(struct demod_state *fm);
+
+/*!
+ * Remove the running average from interleaved I/Q
+ *
+ * \param fm demodulator holding the averages
+ * \param buf samples, changed in place
+ * \param len number of int16 values
+ */
+void dc_block_raw_filter(struct demod_state *fm, int16_t *buf, int len);
+
+#endif /*__DEMOD_H*/
@@ -0,0 +1,214 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* float FFT, builtin radix-4 or FFTW */
+
+#include "fft.h"
+#include "kernels.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#define _USE_MATH_DEFINES
+#endif
+
+#include <math.h>
+
+#ifdef HAVE_FFTW3F
+#include <fftw3.h>
+#endif
+
+static int plan_builtin(struct fft_plan *p)
+{
+	int i, j, k, b, s, count = 0;
+	double theta;
+	float *t;
+	/* bit reversal, only the pairs that actually move */
+	p->swaps = malloc(sizeof(uint32_t) * (p->n > 1 ? p->n : 2));
+	if (!p->swaps) {
+		return -1;}
+	for (i=0; i<p->n; i++) {
+		j = 0;
+		for (b=0; b<p->log2n; b++) {
+			j |= ((i >> b) & 1) << (p->log2n - 1 - b);}
+		if (i < j) {
+			p->swaps[count++] = (uint32_t)i;
+			p->swaps[count++] = (uint32_t)j;
+		}
+	}
+	p->swap_count = count / 2;
+	/* for each pass, (wr, wr) and (-wi, wi) for w^2, w and w^3 */
+	p->twiddles = malloc(sizeof(float) * 4 * (p->n + 1));
+	if (!p->twiddles) {
+		return -1;}
+	t = p->twiddles;
+	for (s=(p->log2n & 1) ? 2 : 1; s<p->n; s*=4) {
+		for (k=0; k<3; k++) {
+			for (j=0; j<s; j++) {
+				theta = -2.0 * M_PI * (double)j / (double)(4*s);
+				theta *= (k == 0) ? 2.0 : (k == 1) ? 1.0 : 3.0;
+				t[k*4*s + 2*j]         = (float)cos(theta);
+				t[k*4*s + 2*j + 1]     = (float)cos(theta);
+				t[k*4*s + 2*s + 2*j]   = (float)-sin(theta);
+				t[k*4*s + 2*s + 2*j+1] = (float)sin(theta);
+			}
+		}
+		t += 12*s;
+	}
+	return 0;
+}
+
+static void forward_builtin(struct fft_plan *p, float *iq)
+{
+	int i, s;
+	uint32_t a, b;
+	float tmp, x0, x1;
+	const float *t = p->twiddles;
+	for (i=0; i<p->swap_count; i++) {
+		a = 2 * p->swaps[2*i];
+		b = 2 * p->swaps[2*i+1];
+		tmp = iq[a];   iq[a]   = iq[b];   iq[b]   = tmp;
+		tmp = iq[a+1]; iq[a+1] = iq[b+1]; iq[b+1] = tmp;
+	}
+	s = 1;
+	if (p->log2n & 1) {
+		for (i=0; i<2*p->n; i+=4) {
+			x0 = iq[i];
+			x1 = iq[i+1];
+			iq[i]   = x0 + iq[i+2];
+			iq[i+1] = x1 + iq[i+3];
+			iq[i+2] = x0 - iq[i+2];
+			iq[i+3] = x1 - iq[i+3];
+		}
+		s = 2;
+	}
+	for (; s<p->n; s*=4) {
+		dsp.fft_radix4(iq, t, p->n, s);
+		t += 12*s;
+	}
+}
+
+struct fft_plan *fft_plan_new(int log2n, enum fft_backend backend)
+{
+	struct fft_plan *p = calloc(1, sizeof(struct fft_plan));
+	if (!p) {
+		return NULL;}
+	p->log2n = log2n;
+	p->n = 1 << log2n;
+#ifdef HAVE_FFTW3F
+	if (backend == FFT_BACKEND_AUTO) {
+		backend = FFT_BACKEND_FFTW;}
+	if (backend == FFT_BACKEND_FFTW) {
+		fftwf_complex *tmp = fftwf_malloc(sizeof(fftwf_complex) * p->n);
+		if (tmp) {
+			p->fftw = fftwf_plan_dft_1d(p->n, tmp, tmp, FFTW_FORWARD, FFTW_MEASURE);
+			fftwf_free(tmp);
+		}
+		if (!p->fftw) {
+			free(p);
+			return NULL;
+		}
+		p->backend = backend;
+		return p;
+	}
+#else
+	if (backend == FFT_BACKEND_FFTW) {
+		free(p);
+		return NULL;
+	}
+#endif
+	p->backend = FFT_BACKEND_BUILTIN;
+	if (plan_builtin(p) != 0) {
+		fft_plan_free(p);
+		return NULL;
+	}
+	return p;
+}
+
+void fft_forward(struct fft_plan *plan, float *iq)
+{
+#ifdef HAVE_FFTW3F
+	if (plan->backend == FFT_BACKEND_FFTW) {
+		fftwf_execute_dft((fftwf_plan)plan->fftw, (fftwf_complex *)iq, (fftwf_complex *)iq);
+		return;
+	}
+#endif
+	forward_builtin(plan, iq);
+}
+
+void fft_plan_free(struct fft_plan *plan)
+{
+	if (!plan) {
+		return;}
+#ifdef HAVE_FFTW3F
+	if (plan->fftw) {
+		fftwf_destroy_plan((fftwf_plan)plan->fftw);}
+#endif
+	free(plan->swaps);
+	free(plan->twiddles);
+	free(plan);
+}
+
+float *fft_malloc(int n)
+{
+	size_t size = sizeof(float) * 2 * (size_t)n;
+#ifdef HAVE_FFTW3F
+	return fftwf_malloc(size);
+#elif defined(_WIN32)
+	return _aligned_malloc(size, 64);
+#else
+	void *p = NULL;
+	if (posix_memalign(&p, 64, size) != 0) {
+		return NULL;}
+	return p;
+#endif
+}
+
+void fft_free(float *p)
+{
+#ifdef HAVE_FFTW3F
+	fftwf_free(p);
+#elif defined(_WIN32)
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+int fft_backend_parse(const char *name)
+{
+	if (strcmp(name, "auto") == 0) {
+		return FFT_BACKEND_AUTO;}
+	if (strcmp(name, "builtin") == 0) {
+		return FFT_BACKEND_BUILTIN;}
+	if (strcmp(name, "fftw") == 0) {
+		return FFT_BACKEND_FFTW;}
+	return -1;
+}
+
+const char *fft_backend_name(enum fft_backend backend)
+{
+	switch (backend) {
+	case FFT_BACKEND_BUILTIN:
+		return "builtin";
+	case FFT_BACKEND_FFTW:
+		return "fftw";
+	default:
+		return "auto";
+	}
+}
+
+// vim: tabstop=8:softtabstop=8:shiftwidth=8:noexpandtab
@@ -0,0 +1,86 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __FFT_H
+#define __FFT_H
+
+#include <stdint.h>
+
+/*
+ * Single precision complex FFT with a pluggable backend.
+ *
+ * The builtin backend is an in place radix-4 decimation in time FFT
+ * (with one radix-2 pass for odd powers of two) running its passes
+ * through the SIMD kernels.  FFTW is used instead when it was found
+ * at build time.  A plan is read only once created, so several threads
+ * may run transforms with the same plan on their own buffers.
+ */
+
+enum fft_backend
+{
+	FFT_BACKEND_AUTO,
+	FFT_BACKEND_BUILTIN,
+	FFT_BACKEND_FFTW
+};
+
+struct fft_plan
+{
+	int log2n;
+	int n;
+	enum fft_backend backend;
+	uint32_t *swaps;      /* bit reversal as pairs of complex indices */
+	int swap_count;
+	float *twiddles;      /* 12*s floats for each radix-4 pass of span s */
+	void *fftw;
+};
+
+/*!
+ * Prepare a forward transform of 2^log2n points
+ *
+ * \param log2n size of the transform
+ * \param backend FFT_BACKEND_AUTO picks FFTW when available
+ * \return plan, or NULL on failure (or when FFTW was asked for but is missing)
+ */
+struct fft_plan *fft_plan_new(int log2n, enum fft_backend backend);
+
+/*!
+ * Unnormalized forward transform, in place
+ *
+ * \param plan the plan
+ * \param iq interleaved complex floats from fft_malloc()
+ */
+void fft_forward(struct fft_plan *plan, float *iq);
+
+void fft_plan_free(struct fft_plan *plan);
+
+/*!
+ * Allocate a buffer suitably aligned for every backend
+ *
+ * \param n number of complex floats
+ * \return buffer, release with fft_free()
+ */
+float *fft_malloc(int n);
+void fft_free(float *p);
+
+/*!
+ * Parse a backend name (auto, builtin, fftw)
+ *
+ * \param name name to parse
+ * \return backend, or -1 when unknown
+ */
+int fft_backend_parse(const char *name);
+
+const char *fft_backend_name(enum fft_backend backend);
+
+#endif /*__FFT_H*/
@@ -0,0 +1,363 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* FIR design, the decimating filter around dsp.fir_iq() and the
+   resampler around dsp.dot16() */
+
+#ifdef _WIN32
+#define _USE_MATH_DEFINES
+#endif
+
+#include "fir.h"
+#include "kernels.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define RESAMPLE_ATTEN	60.0
+
+static double bessel_i0(double x)
+{
+	double sum = 1.0, term = 1.0;
+	int k;
+	for (k=1; k<100; k++) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+		if (term < sum * 1e-12) {
+			break;}
+	}
+	return sum;
+}
+
+int fir_kaiser_taps(double width, double atten)
+/* Kaiser's estimate */
+{
+	double n = (atten - 7.95) / (14.36 * width) + 1.0;
+	if (n > FIR_MAX_TAPS) {
+		return FIR_MAX_TAPS;}
+	if (n < 3) {
+		return 3;}
+	return (int)ceil(n) | 1;
+}
+
+static double kaiser_beta(double atten)
+{
+	if (atten > 50) {
+		return 0.1102 * (atten - 8.7);}
+	if (atten > 21) {
+		return 0.5842 * pow(atten - 21, 0.4) + 0.07886 * (atten - 21);}
+	return 0.0;
+}
+
+static double kaiser_sinc(double t, double half, double cutoff, double beta)
+/* the windowed sinc at t samples from its center, zero past half */
+{
+	double r = half > 0 ? t / half : 0.0, h;
+	if (r < -1.0 || r > 1.0) {
+		return 0.0;}
+	h = t == 0.0 ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * t) / (M_PI * t);
+	return h * bessel_i0(beta * sqrt(1.0 - r * r)) / bessel_i0(beta);
+}
+
+void fir_kaiser_lowpass(double *h, int n, double cutoff, double atten)
+{
+	int k;
+	double beta = kaiser_beta(atten), sum = 0.0;
+	for (k=0; k<n; k++) {
+		h[k] = kaiser_sinc(k - (n - 1) / 2.0, (n - 1) / 2.0, cutoff, beta);
+		sum += h[k];
+	}
+	for (k=0; k<n; k++) {
+		h[k] /= sum;}
+}
+
+static int quantize(const double *h, int n, int shift, int16_t *coef, int len)
+/* 0 when the taps do not fit int16 or a full scale sum would overflow 32 bits */
+{
+	int k;
+	long q, peak = 0, total = 0;
+	for (k=0; k<n; k++) {
+		q = lround(ldexp(h[k], shift));
+		if (labs(q) > peak) {
+			peak = labs(q);}
+		total += labs(q);
+		/* the newest sample is last in the window */
+		coef[len - 1 - k] = (int16_t)q;
+	}
+	return peak <= 32767 && total <= 65535;
+}
+
+struct fir_taps *fir_taps_new(const double *h, int n, int step)
+{
+	struct fir_taps *t;
+	if (n < 1 || n > FIR_MAX_TAPS || step < 1) {
+		return NULL;}
+	t = calloc(1, sizeof(struct fir_taps));
+	if (!t) {
+		return NULL;}
+	t->taps = n;
+	t->len = (n + FIR_ALIGN - 1) / FIR_ALIGN * FIR_ALIGN;
+	t->step = step;
+	t->coef = calloc(t->len, sizeof(int16_t));
+	if (!t->coef) {
+		free(t);
+		return NULL;
+	}
+	/* as much precision as the kernels' 32 bit sums allow */
+	for (t->shift=15; t->shift>1; t->shift--) {
+		if (quantize(h, n, t->shift, t->coef, t->len)) {
+			return t;}
+	}
+	fir_taps_free(t);
+	return NULL;
+}
+
+void fir_taps_free(struct fir_taps *t)
+{
+	if (!t) {
+		return;}
+	free(t->coef);
+	free(t);
+}
+
+int fir_init(struct fir_filter *f, struct fir_taps *t)
+{
+	memset(f, 0, sizeof(*f));
+	f->taps = t;
+	f->size = t->len + FIR_CHUNK;
+	f->hist_i = calloc(f->size, sizeof(int16_t));
+	f->hist_q = calloc(f->size, sizeof(int16_t));
+	if (!f->hist_i || !f->hist_q) {
+		fir_free(f);
+		return -1;
+	}
+	f->fill = t->len - 1;
+	return 0;
+}
+
+void fir_prime(struct fir_filter *f, int16_t i, int16_t q)
+{
+	int k;
+	f->fill = f->taps->len - 1;
+	f->pos = 0;
+	for (k=0; k<f->fill; k++) {
+		f->hist_i[k] = i;
+		f->hist_q[k] = q;
+	}
+}
+
+int fir_decimate(struct fir_filter *f, int16_t *data, int length)
+{
+	struct fir_taps *t = f->taps;
+	int skip, take, count, zeros, n = length / 2, done = 0, out = 0;
+	while (done < n) {
+		/* drop what no window needs any more, a step longer than
+		   the filter also skips some of the input */
+		if (f->pos >= f->fill) {
+			skip = f->pos - f->fill;
+			if (skip > n - done) {
+				skip = n - done;}
+			done += skip;
+			f->pos -= f->fill + skip;
+			f->fill = 0;
+			if (f->pos) {
+				break;}
+		} else if (f->pos) {
+			memmove(f->hist_i, f->hist_i + f->pos, (f->fill - f->pos) * sizeof(int16_t));
+			memmove(f->hist_q, f->hist_q + f->pos, (f->fill - f->pos) * sizeof(int16_t));
+			f->fill -= f->pos;
+			f->pos = 0;
+		}
+		take = n - done;
+		if (take > f->size - f->fill) {
+			take = f->size - f->fill;}
+		dsp.split_iq(data + 2 * done, f->hist_i + f->fill, f->hist_q + f->fill, take);
+		f->fill += take;
+		done += take;
+		if (f->fill - f->pos < t->len) {
+			continue;}
+		/* never more outputs than inputs read, so in place is safe */
+		count = (f->fill - f->pos - t->len) / t->step + 1;
+		if (t->step == 1 && t->taps <= FIR_SHORT) {
+			/* only the even tail of the padded taps is worth a multiply */
+			zeros = (t->len - t->taps) & ~1;
+			dsp.fir_short(f->hist_i + f->pos + zeros, f->hist_q + f->pos + zeros, data + 2 * out,
+				count, t->coef + zeros, t->len - zeros, t->shift);
+		} else {
+			dsp.fir_iq(f->hist_i + f->pos, f->hist_q + f->pos, data + 2 * out, count,
+				t->step, t->coef, t->len, t->shift);}
+		out += count;
+		f->pos += count * t->step;
+	}
+	return 2 * out;
+}
+
+void fir_free(struct fir_filter *f)
+{
+	free(f->hist_i);
+	free(f->hist_q);
+	f->hist_i = NULL;
+	f->hist_q = NULL;
+}
+
+static int gcd(int a, int b)
+{
+	int t;
+	while (b) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+static int resampler_bank(struct fir_resampler *r, const double *h, int n)
+/* one shift for every row, each rounded on its own */
+{
+	int row, ok;
+	for (r->shift=15; r->shift>1; r->shift--) {
+		ok = 1;
+		for (row=0; row<r->rows && ok; row++) {
+			ok = quantize(h + row * n, n, r->shift, r->bank + row * r->len, r->len);}
+		if (ok) {
+			return 0;}
+	}
+	return -1;
+}
+
+int fir_resampler_init(struct fir_resampler *r, int rate_in, int rate_out)
+{
+	double *h, lower, mu, sum, beta = kaiser_beta(RESAMPLE_ATTEN);
+	int k, row, n, g, err;
+	memset(r, 0, sizeof(*r));
+	if (rate_in < 1 || rate_out < 1) {
+		return -1;}
+	g = gcd(rate_in, rate_out);
+	if (rate_out / g <= FIR_PHASES) {
+		r->one = (uint64_t)(rate_out / g);
+		r->step = (uint64_t)(rate_in / g);
+		r->rows = rate_out / g;
+	} else {
+		r->one = (uint64_t)1 << 32;
+		r->step = (uint64_t)llround(ldexp((double)rate_in / rate_out, 32));
+		r->rows = FIR_PHASES + 1;
+	}
+	r->advance = (int)(r->step / r->one);
+	r->step %= r->one;
+	/* a 0.4 passband and a 0.6 stopband of the lower rate, in cycles
+	   per input sample, half the taps a stopband from 0.5 would take */
+	lower = (rate_in < rate_out ? rate_in : rate_out) / (double)rate_in;
+	n = fir_kaiser_taps(0.2 * lower, RESAMPLE_ATTEN);
+	r->len = (n + FIR_ALIGN - 1) / FIR_ALIGN * FIR_ALIGN;
+	r->size = r->len + FIR_CHUNK;
+	r->fill = r->len - 1;
+	h = malloc((size_t)r->rows * n * sizeof(double));
+	r->bank = calloc((size_t)r->rows * r->len, sizeof(int16_t));
+	r->hist = calloc(r->size, sizeof(int16_t));
+	if (!h || !r->bank || !r->hist) {
+		free(h);
+		fir_resampler_free(r);
+		return -1;
+	}
+	/* row for a position mu past the window's n/2 th newest sample,
+	   h[0] is the newest, every row on its own has unity gain at DC */
+	for (row=0; row<r->rows; row++) {
+		mu = r->one <= FIR_PHASES ? (double)row / r->rows : (double)row / FIR_PHASES;
+		sum = 0.0;
+		for (k=0; k<n; k++) {
+			h[row * n + k] = kaiser_sinc(k + mu - n / 2.0, n / 2.0, 0.5 * lower, beta);
+			sum += h[row * n + k];
+		}
+		for (k=0; k<n; k++) {
+			h[row * n + k] /= sum;}
+	}
+	err = resampler_bank(r, h, n);
+	free(h);
+	if (err) {
+		fir_resampler_free(r);}
+	return err;
+}
+
+static int16_t resample_one(struct fir_resampler *r)
+{
+	const int16_t *x = r->hist + r->pos;
+	int64_t sum;
+	int row = (int)r->frac;
+	if (r->one > FIR_PHASES) {
+		/* the nearest row, the last one is a whole input further */
+		row = (int)((r->frac + ((uint64_t)1 << (31 - FIR_PHASE_BITS))) >> (32 - FIR_PHASE_BITS));}
+	sum = dsp.dot16(x, r->bank + row * r->len, r->len);
+	sum = (sum + (1 << (r->shift - 1))) >> r->shift;
+	if (sum > 32767) {
+		return 32767;}
+	if (sum < -32768) {
+		return -32768;}
+	return (int16_t)sum;
+}
+
+int fir_resample(struct fir_resampler *r, int16_t *data, int length, int capacity)
+{
+	int16_t *in = data;
+	int skip, take, done = 0, out = 0;
+	if (!r->advance && length < capacity) {
+		/* more out than in, move the input ahead of the output */
+		in = data + capacity - length;
+		memmove(in, data, length * sizeof(int16_t));
+	}
+	while (done < length) {
+		if (r->pos >= r->fill) {
+			skip = r->pos - r->fill;
+			if (skip > length - done) {
+				skip = length - done;}
+			done += skip;
+			r->pos -= r->fill + skip;
+			r->fill = 0;
+			if (r->pos) {
+				break;}
+		} else if (r->pos) {
+			memmove(r->hist, r->hist + r->pos, (r->fill - r->pos) * sizeof(int16_t));
+			r->fill -= r->pos;
+			r->pos = 0;
+		}
+		take = length - done;
+		if (take > r->size - r->fill) {
+			take = r->size - r->fill;}
+		memcpy(r->hist + r->fill, in + done, take * sizeof(int16_t));
+		r->fill += take;
+		done += take;
+		while (r->fill - r->pos >= r->len) {
+			/* never onto input not yet read */
+			if (data + out < in + done) {
+				data[out++] = resample_one(r);}
+			r->pos += r->advance;
+			r->frac += r->step;
+			if (r->frac >= r->one) {
+				r->frac -= r->one;
+				r->pos++;
+			}
+		}
+	}
+	return out;
+}
+
+void fir_resampler_free(struct fir_resampler *r)
+{
+	free(r->bank);
+	free(r->hist);
+	r->bank = NULL;
+	r->hist = NULL;
+}
+
+// vim: tabstop=8:softtabstop=8:shiftwidth=8:noexpandtab
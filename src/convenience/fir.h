@@ -0,0 +1,162 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __FIR_H
+#define __FIR_H
+
+#include <stdint.h>
+
+/*
+ * FIR filters for interleaved 16 bit I/Q, decimating by an integer step.
+ *
+ * Only the outputs that are kept get computed, each from the window of
+ * inputs ending at its sample, so a decimation by step costs what the
+ * polyphase split of the filter would: taps multiplies per output.
+ * I and Q are copied apart into two linear history buffers with the
+ * taps - 1 previous samples in front of the new ones, which makes every
+ * output one contiguous dot product for dsp.fir_iq().  Taps are read
+ * only once made, several filters (and threads) may share them.
+ */
+
+#define FIR_MAX_TAPS	4095
+#define FIR_CHUNK	4096  /* complex samples copied apart at a time */
+#define FIR_PHASE_BITS	10
+#define FIR_PHASES	(1 << FIR_PHASE_BITS)  /* most rows in a resampler's filter bank */
+
+struct fir_taps
+{
+	int16_t *coef;  /* reversed and zero padded in front to len */
+	int taps;       /* as designed */
+	int len;        /* a multiple of FIR_ALIGN */
+	int step;       /* decimation */
+	int shift;      /* coef are scaled by 2^shift */
+};
+
+struct fir_filter
+{
+	struct fir_taps *taps;  /* not owned */
+	int16_t *hist_i;
+	int16_t *hist_q;
+	int size;   /* of each history buffer */
+	int fill;   /* samples in the buffers */
+	int pos;    /* first sample of the next output's window */
+};
+
+/*
+ * Real samples from one rate to another.  Each output is a dot product
+ * of the latest inputs with the row of a bank of lowpass filters whose
+ * delay puts it at the output's fractional position between inputs.
+ * When out/in reduces to up/down with up <= FIR_PHASES that position
+ * only ever takes up values and there is one exact row per value.
+ * Otherwise the bank has FIR_PHASES + 1 rows and an output takes the
+ * row nearest its 32.32 fixed point position, off by at most half of
+ * 1/FIR_PHASES of an input sample.
+ */
+
+struct fir_resampler
+{
+	int16_t *bank;  /* rows of len coef, ordered like fir_taps */
+	int rows;
+	int len;        /* a multiple of FIR_ALIGN */
+	int shift;
+	uint64_t one;   /* up, or 2^32 */
+	int advance;    /* whole inputs from one output to the next */
+	uint64_t step;  /* and the rest of down, or of 2^32 * in / out */
+	uint64_t frac;  /* position of the next output past pos, in 1/one */
+	int16_t *hist;
+	int size, fill, pos;
+};
+
+/*!
+ * Number of taps for a Kaiser window lowpass
+ *
+ * \param width transition band as a fraction of the sample rate
+ * \param atten stopband attenuation in dB
+ * \return an odd tap count, at most FIR_MAX_TAPS
+ */
+int fir_kaiser_taps(double width, double atten);
+
+/*!
+ * Design a Kaiser windowed sinc lowpass with unity gain at DC
+ *
+ * \param h n taps are written here
+ * \param n tap count, see fir_kaiser_taps()
+ * \param cutoff -6 dB point as a fraction of the sample rate
+ * \param atten stopband attenuation in dB, sets the window shape
+ */
+void fir_kaiser_lowpass(double *h, int n, double cutoff, double atten);
+
+/*!
+ * Quantize taps for the kernels
+ *
+ * \param h taps, h[0] applies to the newest sample
+ * \param n tap count, at most FIR_MAX_TAPS
+ * \param step decimation, 1 for none
+ * \return taps, or NULL on failure
+ */
+struct fir_taps *fir_taps_new(const double *h, int n, int step);
+void fir_taps_free(struct fir_taps *t);
+
+/*!
+ * Set up a filter with zero history
+ *
+ * \param f filter to set up
+ * \param t its taps, kept until fir_free()
+ * \return 0 on success
+ */
+int fir_init(struct fir_filter *f, struct fir_taps *t);
+
+/*!
+ * Start over as if the input had been i + jq forever
+ */
+void fir_prime(struct fir_filter *f, int16_t i, int16_t q);
+
+/*!
+ * Filter and decimate I/Q in place, the history carries over between calls
+ *
+ * \param f the filter
+ * \param data interleaved I/Q
+ * \param length number of int16 values
+ * \return number of int16 values left
+ */
+int fir_decimate(struct fir_filter *f, int16_t *data, int length);
+
+void fir_free(struct fir_filter *f);
+
+/*!
+ * Design a resampler that passes 0.4 of the lower rate and stops
+ * everything from 0.6 of it, what folds over from between 0.5 and 0.6
+ * lands above the passband
+ *
+ * \param r resampler to set up
+ * \param rate_in input sample rate
+ * \param rate_out output sample rate
+ * \return 0 on success
+ */
+int fir_resampler_init(struct fir_resampler *r, int rate_in, int rate_out);
+
+/*!
+ * Resample in place, the history carries over between calls
+ *
+ * \param r the resampler
+ * \param data real samples
+ * \param length number of samples in
+ * \param capacity of data, outputs beyond are dropped
+ * \return number of samples out
+ */
+int fir_resample(struct fir_resampler *r, int16_t *data, int length, int capacity);
+
+void fir_resampler_free(struct fir_resampler *r);
+
+#endif /*__FIR_H*/
@@ -0,0 +1,660 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* scalar reference kernels and runtime selection */
+
+#include "kernels.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef HAVE_X86_KERNELS
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+static int16_t clip16(int64_t x)
+{
+	if (x > 32767) {
+		return 32767;}
+	if (x < -32768) {
+		return -32768;}
+	return (int16_t)x;
+}
+
+static void rotate16_90_scalar(const int16_t *in, int16_t *out, uint32_t len)
+/* 90 rotation is 1+0j, 0+1j, -1+0j, 0-1j
+   or [0, 1, -3, 2, -4, -5, 7, -6] */
+{
+	uint32_t i;
+	int16_t tmp;
+	for (i=0; i<len; i+=8) {
+		out[i]   = in[i];
+		out[i+1] = in[i+1];
+
+		tmp = - in[i+3];
+		out[i+3] = in[i+2];
+		out[i+2] = tmp;
+
+		out[i+4] = - in[i+4];
+		out[i+5] = - in[i+5];
+
+		tmp = - in[i+6];
+		out[i+6] = in[i+7];
+		out[i+7] = tmp;
+	}
+}
+
+static void fifth_order_half(int16_t *data, int length, int16_t *hist)
+/* for half of interleaved data */
+{
+	int i;
+	int16_t a, b, c, d, e, f;
+	a = hist[1];
+	b = hist[2];
+	c = hist[3];
+	d = hist[4];
+	e = hist[5];
+	f = data[0];
+	/* input is already full scale 16 bit, so fully shift (unity gain) */
+	data[0] = (a + (b+e)*5 + (c+d)*10 + f) >> 5;
+	for (i=4; i<length; i+=4) {
+		a = c;
+		b = d;
+		c = e;
+		d = f;
+		e = data[i-2];
+		f = data[i];
+		data[i/2] = (a + (b+e)*5 + (c+d)*10 + f) >> 5;
+	}
+	/* archive */
+	hist[0] = a;
+	hist[1] = b;
+	hist[2] = c;
+	hist[3] = d;
+	hist[4] = e;
+	hist[5] = f;
+}
+
+static void fifth_order_scalar(int16_t *data, int length, int16_t *hist_i, int16_t *hist_q)
+{
+	fifth_order_half(data, length, hist_i);
+	fifth_order_half(data+1, length-1, hist_q);
+}
+
+static void fifth_decimate_scalar(const int16_t *in, int16_t *out, int n)
+{
+	int m, c;
+	const int16_t *x;
+	for (m=0; m<n; m++) {
+		for (c=0; c<2; c++) {
+			x = in + 4*m + c;
+			out[2*m+c] = (int16_t)((x[-10] + (x[-8]+x[-2])*5 + (x[-6]+x[-4])*10 + x[0]) >> 5);
+		}
+	}
+}
+
+static void split_iq_scalar(const int16_t *in, int16_t *out_i, int16_t *out_q, int n)
+{
+	int k;
+	for (k=0; k<n; k++) {
+		out_i[k] = in[2*k];
+		out_q[k] = in[2*k+1];
+	}
+}
+
+static void fir_iq_scalar(const int16_t *x_i, const int16_t *x_q, int16_t *out, int n, int step,
+	const int16_t *coef, int len, int shift)
+{
+	int m, j;
+	int32_t sum_i, sum_q;
+	for (m=0; m<n; m++) {
+		sum_i = 1 << (shift - 1);
+		sum_q = 1 << (shift - 1);
+		for (j=0; j<len; j++) {
+			sum_i += coef[j] * x_i[j];
+			sum_q += coef[j] * x_q[j];
+		}
+		out[2*m]   = clip16(sum_i >> shift);
+		out[2*m+1] = clip16(sum_q >> shift);
+		x_i += step;
+		x_q += step;
+	}
+}
+
+static void fir_short_scalar(const int16_t *x_i, const int16_t *x_q, int16_t *out, int n,
+	const int16_t *coef, int len, int shift)
+{
+	fir_iq_scalar(x_i, x_q, out, n, 1, coef, len, shift);
+}
+
+void fir_short_run(const int16_t *x_i, const int16_t *x_q, int16_t *out, int n,
+	const int16_t *coef, int len, int shift, fir_short_body_fn body, int width)
+{
+	int count = n / width * width;
+	if (count) {
+		body(x_i, x_q, out, count, coef, len, shift);}
+	fir_iq_scalar(x_i + count, x_q + count, out + 2 * count, n - count, 1, coef, len, shift);
+}
+
+static int32_t dot16_scalar(const int16_t *x, const int16_t *coef, int len)
+{
+	int j;
+	int32_t sum = 0;
+	for (j=0; j<len; j++) {
+		sum += coef[j] * x[j];}
+	return sum;
+}
+
+static int16_t fm_disc_one(int ar, int aj, int br, int bj)
+{
+	float cr = (float)ar * (float)br + (float)aj * (float)bj;
+	float cj = (float)aj * (float)br - (float)ar * (float)bj;
+	float ax = fabsf(cr), ay = fabsf(cj);
+	float mx = ax > ay ? ax : ay;
+	float mn = ax > ay ? ay : ax;
+	float a, s, r;
+	/* both are whole numbers, mx < 1 only for 0/0 */
+	a = mn / (mx > 1.0f ? mx : 1.0f);
+	s = a * a;
+	r = a * ((((ATAN_P9 * s + ATAN_P7) * s + ATAN_P5) * s + ATAN_P3) * s + ATAN_P1);
+	if (ay > ax) {
+		r = ATAN_PI_2 - r;}
+	if (cr < 0.0f) {
+		r = ATAN_PI - r;}
+	if (cj < 0.0f) {
+		r = -r;}
+	return (int16_t)(int)(r * ATAN_SCALE);
+}
+
+static void fm_disc_scalar(const int16_t *iq, int16_t *out, int n, int pre_r, int pre_j)
+{
+	int k, r, j;
+	for (k=0; k<n; k++) {
+		r = iq[2*k];
+		j = iq[2*k+1];
+		out[k] = fm_disc_one(r, j, pre_r, pre_j);
+		pre_r = r;
+		pre_j = j;
+	}
+}
+
+void fm_disc_run(const int16_t *iq, int16_t *out, int n, int pre_r, int pre_j,
+	fm_disc_body_fn body, int width)
+/* out[0] is where the body's first previous sample is, it goes in last */
+{
+	int16_t first;
+	int k, count;
+	if (n < 1) {
+		return;}
+	first = fm_disc_one(iq[0], iq[1], pre_r, pre_j);
+	count = (n - 1) / width * width;
+	if (count) {
+		body(iq, out, 1, count);}
+	for (k=1+count; k<n; k++) {
+		out[k] = fm_disc_one(iq[2*k], iq[2*k+1], iq[2*k-2], iq[2*k-1]);}
+	out[0] = first;
+}
+
+static void remove_dc_scalar(int16_t *data, int length)
+/* works on interleaved data, the Q average is over length-1 like it always was */
+{
+	int i;
+	int16_t ave_i, ave_q;
+	int64_t sum_i = 0L, sum_q = 0L;
+	for (i=0; i+1 < length; i+=2) {
+		sum_i += data[i];
+		sum_q += data[i+1];
+	}
+	ave_i = (int16_t)(sum_i / (int64_t)(length));
+	ave_q = (int16_t)(sum_q / (int64_t)(length - 1));
+	for (i=0; i+1 < length; i+=2) {
+		data[i]   -= ave_i;
+		data[i+1] -= ave_q;
+	}
+}
+
+static void cs16_to_cs8_scalar(const int16_t *in, int8_t *out, size_t n)
+/* round to nearest, +32767 would round up to 128 */
+{
+	size_t i;
+	int v;
+	for (i=0; i<n; i++) {
+		v = (in[i] + 128) >> 8;
+		out[i] = (int8_t)(v > 127 ? 127 : v);
+	}
+}
+
+static void cs16_to_cu8_scalar(const int16_t *in, uint8_t *out, size_t n)
+{
+	size_t i;
+	int v;
+	for (i=0; i<n; i++) {
+		v = (in[i] + 128) >> 8;
+		out[i] = (uint8_t)((v > 127 ? 127 : v) + 128);
+	}
+}
+
+static void cs16_to_cf32_scalar(const int16_t *in, float *out, size_t n)
+/* full scale is 32768, so the conversion is exact */
+{
+	size_t i;
+	for (i=0; i<n; i++) {
+		out[i] = (float)in[i] * (1.0f / 32768.0f);
+	}
+}
+
+static void cs16_to_cs12_scalar(const int16_t *in, uint8_t *out, size_t n)
+/* keep the top 12 bits, rounded like cs16_to_cs8 */
+{
+	size_t i;
+	int a, b;
+	for (i=0; i+1<n; i+=2) {
+		a = (in[i] + 8) >> 4;
+		b = (in[i+1] + 8) >> 4;
+		a = a > 2047 ? 2047 : a;
+		b = b > 2047 ? 2047 : b;
+		*out++ = (uint8_t)a;
+		*out++ = (uint8_t)(((a >> 8) & 0x0f) | ((b & 0x0f) << 4));
+		*out++ = (uint8_t)(b >> 4);
+	}
+}
+
+static void cs8_to_cs16_scalar(const int8_t *in, int16_t *out, size_t n)
+{
+	size_t i;
+	for (i=0; i<n; i++) {
+		out[i] = (int16_t)(in[i] * 256);}
+}
+
+static void cu8_to_cs16_scalar(const uint8_t *in, int16_t *out, size_t n)
+{
+	size_t i;
+	for (i=0; i<n; i++) {
+		out[i] = (int16_t)((in[i] - 128) * 256);}
+}
+
+static void cs12_to_cs16_scalar(const uint8_t *in, int16_t *out, size_t n)
+{
+	size_t i;
+	uint8_t b0, b1, b2;
+	for (i=0; i+1<n; i+=2) {
+		b0 = *in++;
+		b1 = *in++;
+		b2 = *in++;
+		out[i]   = (int16_t)((b1 << 12) | (b0 << 4));
+		out[i+1] = (int16_t)((b2 << 8) | (b1 & 0xf0));
+	}
+}
+
+static void cf32_to_cs16_scalar(const float *in, int16_t *out, size_t n)
+/* clamp before converting, NaN becomes -32768 like the SIMD max */
+{
+	size_t i;
+	float v;
+	for (i=0; i<n; i++) {
+		v = in[i] * 32768.0f;
+		if (!(v >= -32768.0f)) {
+			v = -32768.0f;}
+		if (v > 32767.0f) {
+			v = 32767.0f;}
+		out[i] = (int16_t)lrintf(v);
+	}
+}
+
+static void flip8_scalar(const uint8_t *in, uint8_t *out, size_t n)
+{
+	size_t i;
+	for (i=0; i<n; i++) {
+		out[i] = in[i] ^ 0x80;}
+}
+
+static void window_cs16_scalar(const int16_t *iq, const float *win, float *out, int len)
+{
+	int j;
+	for (j=0; j<len; j++) {
+		out[2*j]   = (float)iq[2*j]   * win[j];
+		out[2*j+1] = (float)iq[2*j+1] * win[j];
+	}
+}
+
+void fft_radix4_scalar(float *data, const float *tw, int n, int s)
+/* tw holds (wr, wr) and (-wi, wi) per twiddle, for each of w^2, w, w^3,
+   the products are written out so the SIMD versions match exactly */
+{
+	int g, j, k;
+	float *a[4], p[4][2], A0[2], A1[2], S[2], D[2];
+	const float *t;
+	for (g=0; g<n; g+=4*s) {
+		for (j=0; j<s; j++) {
+			for (k=0; k<4; k++) {
+				a[k] = data + 2*(g + j + k*s);}
+			p[0][0] = a[0][0];
+			p[0][1] = a[0][1];
+			for (k=1; k<4; k++) {
+				t = tw + (k-1)*4*s + 2*j;
+				/* the first pass has no twiddles */
+				if (s == 1) {
+					p[k][0] = a[k][0];
+					p[k][1] = a[k][1];
+					continue;
+				}
+				p[k][0] = a[k][0] * t[0] + a[k][1] * t[2*s];
+				p[k][1] = a[k][1] * t[1] + a[k][0] * t[2*s+1];
+			}
+			A0[0] = p[0][0] + p[1][0];
+			A0[1] = p[0][1] + p[1][1];
+			A1[0] = p[0][0] - p[1][0];
+			A1[1] = p[0][1] - p[1][1];
+			S[0]  = p[2][0] + p[3][0];
+			S[1]  = p[2][1] + p[3][1];
+			/* times -j */
+			D[0]  =   p[2][1] - p[3][1];
+			D[1]  = -(p[2][0] - p[3][0]);
+			a[0][0] = A0[0] + S[0];
+			a[0][1] = A0[1] + S[1];
+			a[1][0] = A1[0] + D[0];
+			a[1][1] = A1[1] + D[1];
+			a[2][0] = A0[0] - S[0];
+			a[2][1] = A0[1] - S[1];
+			a[3][0] = A1[0] - D[0];
+			a[3][1] = A1[1] - D[1];
+		}
+	}
+}
+
+static void power_sum_scalar(const float *iq, double *avg, int len)
+{
+	int j;
+	for (j=0; j<len; j++) {
+		avg[j] += (double)(iq[2*j] * iq[2*j] + iq[2*j+1] * iq[2*j+1]);
+	}
+}
+
+static void power_max_scalar(const float *iq, double *avg, int len)
+{
+	int j;
+	double p;
+	for (j=0; j<len; j++) {
+		p = (double)(iq[2*j] * iq[2*j] + iq[2*j+1] * iq[2*j+1]);
+		if (p > avg[j]) {
+			avg[j] = p;}
+	}
+}
+
+struct dsp_kernels dsp = {
+	"scalar",
+	rotate16_90_scalar,
+	fifth_order_scalar,
+	fifth_decimate_scalar,
+	split_iq_scalar,
+	fir_iq_scalar,
+	fir_short_scalar,
+	dot16_scalar,
+	fm_disc_scalar,
+	remove_dc_scalar,
+	cs16_to_cs8_scalar,
+	cs16_to_cu8_scalar,
+	cs16_to_cf32_scalar,
+	cs16_to_cs12_scalar,
+	cs8_to_cs16_scalar,
+	cu8_to_cs16_scalar,
+	cs12_to_cs16_scalar,
+	cf32_to_cs16_scalar,
+	flip8_scalar,
+	window_cs16_scalar,
+	fft_radix4_scalar,
+	power_sum_scalar,
+	power_max_scalar,
+};
+
+void dsp_init_scalar(struct dsp_kernels *k)
+{
+	k->name         = "scalar";
+	k->rotate16_90  = rotate16_90_scalar;
+	k->fifth_order  = fifth_order_scalar;
+	k->fifth_decimate = fifth_decimate_scalar;
+	k->split_iq     = split_iq_scalar;
+	k->fir_iq       = fir_iq_scalar;
+	k->fir_short    = fir_short_scalar;
+	k->dot16        = dot16_scalar;
+	k->fm_disc      = fm_disc_scalar;
+	k->remove_dc    = remove_dc_scalar;
+	k->cs16_to_cs8  = cs16_to_cs8_scalar;
+	k->cs16_to_cu8  = cs16_to_cu8_scalar;
+	k->cs16_to_cf32 = cs16_to_cf32_scalar;
+	k->cs16_to_cs12 = cs16_to_cs12_scalar;
+	k->cs8_to_cs16  = cs8_to_cs16_scalar;
+	k->cu8_to_cs16  = cu8_to_cs16_scalar;
+	k->cs12_to_cs16 = cs12_to_cs16_scalar;
+	k->cf32_to_cs16 = cf32_to_cs16_scalar;
+	k->flip8        = flip8_scalar;
+	k->window_cs16  = window_cs16_scalar;
+	k->fft_radix4   = fft_radix4_scalar;
+	k->power_sum    = power_sum_scalar;
+	k->power_max    = power_max_scalar;
+}
+
+static int16_t fifth_point(const int16_t *x, int m, const int16_t *hist)
+/* output m of one channel, x[k] for k < 0 comes from hist[1..5] */
+{
+	int k, t[6];
+	for (k=0; k<6; k++) {
+		int n = 2*m - 5 + k;
+		t[k] = n < 0 ? hist[6 + n] : x[2*n];
+	}
+	return (int16_t)((t[0] + (t[1]+t[4])*5 + (t[2]+t[3])*10 + t[5]) >> 5);
+}
+
+void fifth_order_run(int16_t *data, int length, int16_t *hist_i, int16_t *hist_q,
+	fifth_body_fn body, int width)
+{
+	int k, m, n, head, bound, count = 0;
+	/* as fifth_order_scalar, Q is the half from data+1 with length-1 */
+	int last = (length + 3) / 4 - 1;
+	int last_q = (length - 2) / 4;
+	int16_t new_i[6], new_q[6], first[12];
+	if (length <= 0) {
+		return;}
+	/* the history is the input around the last output, grab it before it is overwritten */
+	for (k=0; k<6; k++) {
+		n = 2*last - 5 + k;
+		new_i[k] = n < 0 ? hist_i[6 + n] : data[2*n];
+		n = 2*last_q - 5 + k;
+		new_q[k] = n < 0 ? hist_q[6 + n] : data[2*n + 1];
+	}
+	/* the first outputs land on input the next ones still need */
+	head = last < 5 ? last + 1 : 6;
+	for (m=0; m<head; m++) {
+		first[2*m] = fifth_point(data, m, hist_i);
+		if (m <= last_q) {
+			first[2*m+1] = fifth_point(data+1, m, hist_q);}
+	}
+	for (m=0; m<head; m++) {
+		data[2*m] = first[2*m];
+		if (m <= last_q) {
+			data[2*m+1] = first[2*m+1];}
+	}
+	/* the body reads up to input 2*m+1 of its last output m */
+	bound = (length / 2 - 2) / 2;
+	if (bound > last_q) {
+		bound = last_q;}
+	if (body && bound >= 6) {
+		count = (bound - 5) / width * width;
+		if (count) {
+			body(data, data, 6, count);}
+	}
+	for (m=6+count; m<=last; m++) {
+		data[2*m] = fifth_point(data, m, hist_i);
+		if (m <= last_q) {
+			data[2*m+1] = fifth_point(data+1, m, hist_q);}
+	}
+	memcpy(hist_i, new_i, sizeof(new_i));
+	memcpy(hist_q, new_q, sizeof(new_q));
+}
+
+void fifth_decimate_run(const int16_t *in, int16_t *out, int n, fifth_body_fn body, int width)
+{
+	int m, c, count = n / width * width;
+	const int16_t *x;
+	if (count) {
+		body(in, out, 0, count);}
+	for (m=count; m<n; m++) {
+		for (c=0; c<2; c++) {
+			x = in + 4*m + c;
+			out[2*m+c] = (int16_t)((x[-10] + (x[-8]+x[-2])*5 + (x[-6]+x[-4])*10 + x[0]) >> 5);
+		}
+	}
+}
+
+/* int16 values of the first pass per piece, 16 KB */
+#define CIC_PIECE	8192
+#define CIC_LEAD	12
+
+static void cic_load(const int16_t *hist, int16_t *lead)
+/* the pass history in front of its line */
+{
+	int k;
+	for (k=0; k<6; k++) {
+		lead[2*k]   = hist[k];
+		lead[2*k+1] = hist[6+k];
+	}
+}
+
+static void cic_save(int16_t *hist, const int16_t *in)
+{
+	int k;
+	for (k=0; k<6; k++) {
+		hist[k]   = in[2*k];
+		hist[6+k] = in[2*k+1];
+	}
+}
+
+int cic_decimate(struct cic_state *s, int16_t *data, int length, int passes, int prime)
+{
+	int16_t line[2][CIC_LEAD + CIC_PIECE];
+	int16_t *in, *out;
+	int p, k, off, n, len, last;
+	if (passes > CIC_MAX_PASSES) {
+		passes = CIC_MAX_PASSES;}
+	/* uneven blocks keep the edge handling of whole passes */
+	if (length % (4 << passes)) {
+		for (p=0; p<passes; p++) {
+			if (prime) {
+				for (k=0; k<6; k++) {
+					s->hist[p][k] = data[0];
+					s->hist[p][6+k] = data[1];
+				}
+			}
+			dsp.fifth_order(data, length >> p, s->hist[p], s->hist[p] + 6);
+		}
+		return length >> passes;
+	}
+	for (off=0; off<length; off+=n) {
+		n = length - off < CIC_PIECE ? length - off : CIC_PIECE;
+		last = off + n == length;
+		/* later pieces find their history right in front of them */
+		in = data + off;
+		if (off == 0) {
+			in = line[0] + CIC_LEAD;
+			memcpy(in, data, n * sizeof(int16_t));
+		}
+		for (p=0; p<passes; p++) {
+			len = n >> p;
+			if (prime && off == 0) {
+				for (k=0; k<6; k++) {
+					s->hist[p][k] = in[0];
+					s->hist[p][6+k] = in[1];
+				}
+			}
+			if (p > 0 || off == 0) {
+				cic_load(s->hist[p], in - CIC_LEAD);}
+			out = p == passes - 1 ? data + (off >> passes) : line[~p & 1] + CIC_LEAD;
+			dsp.fifth_decimate(in, out, len / 4);
+			/* fifth_order skips the odd last sample of a block, not of a piece */
+			cic_save(s->hist[p], in + len - (last ? 14 : 12));
+			in = out;
+		}
+	}
+	return length >> passes;
+}
+
+#ifdef HAVE_X86_KERNELS
+#ifdef _MSC_VER
+static int cpu_has(int avx512)
+{
+	int info[4];
+	unsigned long long xcr0;
+	__cpuid(info, 1);
+	if (!(info[2] & (1 << 27))) {
+		return 0;}
+	xcr0 = _xgetbv(0);
+	__cpuidex(info, 7, 0);
+	if (avx512) {
+		return (xcr0 & 0xe6) == 0xe6 && (info[1] & (1 << 16)) && (info[1] & (1 << 30));}
+	return (xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5));
+}
+#define HAS_SSE2()	1
+#define HAS_AVX2()	cpu_has(0)
+#define HAS_AVX512()	cpu_has(1)
+#else
+#define HAS_SSE2()	__builtin_cpu_supports("sse2")
+#define HAS_AVX2()	__builtin_cpu_supports("avx2")
+#define HAS_AVX512()	(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+#endif
+#endif
+
+int dsp_init_level(struct dsp_kernels *k, int level)
+{
+	int reached = 0;
+	dsp_init_scalar(k);
+#ifdef HAVE_X86_KERNELS
+#ifndef _MSC_VER
+	__builtin_cpu_init();
+#endif
+	if (level >= 1 && HAS_SSE2()) {
+		dsp_init_sse2(k);
+		reached = 1;
+	}
+	if (level >= 2 && HAS_AVX2()) {
+		dsp_init_avx2(k);
+		reached = 2;
+	}
+	if (level >= 3 && HAS_AVX512()) {
+		dsp_init_avx512(k);
+		reached = 3;
+	}
+#endif
+	return reached;
+}
+
+const char *dsp_init(void)
+{
+	int level = 3;
+	char *cap = getenv("RX_TOOLS_SIMD");
+	if (cap) {
+		if (strcmp(cap, "scalar") == 0) {
+			level = 0;}
+		else if (strcmp(cap, "sse2") == 0) {
+			level = 1;}
+		else if (strcmp(cap, "avx2") == 0) {
+			level = 2;}
+	}
+	dsp_init_level(&dsp, level);
+	return dsp.name;
+}
+
+// vim: tabstop=8:softtabstop=8:shiftwidth=8:noexpandtab
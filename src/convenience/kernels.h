@@ -0,0 +1,208 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __KERNELS_H
+#define __KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Hot loops shared by rx_fm, rx_power and rx_sdr.
+ *
+ * Every kernel has a scalar reference in kernels.c; the SSE2, AVX2 and
+ * AVX-512 versions produce bit identical results and are picked once
+ * at startup by dsp_init().  Interleaved I/Q buffers are int16_t arrays
+ * of length 2 * number of complex samples.
+ */
+
+struct dsp_kernels
+{
+	const char *name;
+
+	/* multiply by 1, j, -1, -j, len is a multiple of 8, in may be out */
+	void (*rotate16_90)(const int16_t *in, int16_t *out, uint32_t len);
+
+	/* decimate I/Q by 2 in place with [1 5 10 10 5 1]/32,
+	   hist_i and hist_q hold 6 samples of state each */
+	void (*fifth_order)(int16_t *data, int length, int16_t *hist_i, int16_t *hist_q);
+
+	/* the same filter out of place, n complex outputs from 2n inputs,
+	   in[-12..-1] hold the 6 samples before in[0] */
+	void (*fifth_decimate)(const int16_t *in, int16_t *out, int n);
+
+	/* copy n complex samples apart into I and Q */
+	void (*split_iq)(const int16_t *in, int16_t *out_i, int16_t *out_q, int n);
+
+	/* n outputs of a decimating FIR over separate I and Q, see fir.h.
+	   Output m is the dot product of coef with x_i + m*step (and x_q),
+	   len is a multiple of FIR_ALIGN, the sum is rounded, shifted down
+	   by shift and saturated into out as I/Q.  coef must keep the sum
+	   within 32 bits for any input */
+	void (*fir_iq)(const int16_t *x_i, const int16_t *x_q, int16_t *out, int n, int step,
+		const int16_t *coef, int len, int shift);
+
+	/* fir_iq with step 1 for short filters, the taps run across
+	   outputs instead of along each one.  len is even and at most
+	   FIR_SHORT, otherwise as fir_iq */
+	void (*fir_short)(const int16_t *x_i, const int16_t *x_q, int16_t *out, int n,
+		const int16_t *coef, int len, int shift);
+
+	/* sum of x[j] * coef[j] for j < len, a multiple of FIR_ALIGN,
+	   with the same 32 bit limit on coef as fir_iq, see fir_resample() */
+	int32_t (*dot16)(const int16_t *x, const int16_t *coef, int len);
+
+	/* FM discriminator, out[k] is the angle of iq[k] * conj(iq[k-1])
+	   with pi = 1<<14, pre_r + j pre_j is the sample before iq[0].
+	   A float polynomial atan2, out may alias iq */
+	void (*fm_disc)(const int16_t *iq, int16_t *out, int n, int pre_r, int pre_j);
+
+	/* subtract the average of each of I and Q, see rtl_power */
+	void (*remove_dc)(int16_t *data, int length);
+
+	/* sample format conversion, n counts int16 values (2 per complex).
+	   Narrowing rounds to nearest and saturates, widening is exact, so
+	   any pair of formats converts through CS16 and CU8 is centered on 128.
+	   CS12 is the packed SoapySDR layout, 3 bytes per complex, n is even */
+	void (*cs16_to_cs8)(const int16_t *in, int8_t *out, size_t n);
+	void (*cs16_to_cu8)(const int16_t *in, uint8_t *out, size_t n);
+	void (*cs16_to_cf32)(const int16_t *in, float *out, size_t n);
+	void (*cs16_to_cs12)(const int16_t *in, uint8_t *out, size_t n);
+	void (*cs8_to_cs16)(const int8_t *in, int16_t *out, size_t n);
+	void (*cu8_to_cs16)(const uint8_t *in, int16_t *out, size_t n);
+	void (*cs12_to_cs16)(const uint8_t *in, int16_t *out, size_t n);
+	void (*cf32_to_cs16)(const float *in, int16_t *out, size_t n);
+
+	/* CS8 <-> CU8 directly, both directions flip the top bit */
+	void (*flip8)(const uint8_t *in, uint8_t *out, size_t n);
+
+	/* out[j] = iq[j] * win[j] as complex float, len counts complex samples */
+	void (*window_cs16)(const int16_t *iq, const float *win, float *out, int len);
+
+	/* one radix-4 decimation in time pass over n complex floats,
+	   combining transforms of size s into size 4s, see fft.c */
+	void (*fft_radix4)(float *data, const float *tw, int n, int s);
+
+	/* avg[j] += |iq[j]|^2, or avg[j] = max(avg[j], |iq[j]|^2) for peak hold */
+	void (*power_sum)(const float *iq, double *avg, int len);
+	void (*power_max)(const float *iq, double *avg, int len);
+};
+
+extern struct dsp_kernels dsp;
+
+/* fir_iq tap counts are padded to this, one AVX-512 vector of int16 */
+#define FIR_ALIGN	32
+
+/* the longest filter for fir_short, the CIC droop compensation is 9 */
+#define FIR_SHORT	16
+
+/*
+ * A cascade of fifth_order passes, each decimating by 2.  Instead of
+ * sweeping the whole block once per pass, the block is cut into pieces
+ * small enough for L1 and all passes run over a piece, between two
+ * small line buffers, before the next piece is read.  The results are
+ * those of whole block fifth_order passes.
+ */
+#define CIC_MAX_PASSES	10
+
+struct cic_state
+{
+	int16_t hist[CIC_MAX_PASSES][12];  /* per pass 6 I, then 6 Q */
+};
+
+/*!
+ * Decimate I/Q by 2^passes in place
+ *
+ * \param s history of every pass, zeroed for a fresh start
+ * \param data interleaved I/Q
+ * \param length number of int16 values in data
+ * \param passes number of halvings, at most CIC_MAX_PASSES
+ * \param prime start each pass from its first input instead of the history
+ * \return number of int16 values left
+ */
+int cic_decimate(struct cic_state *s, int16_t *data, int length, int passes, int prime);
+
+/*!
+ * Select the fastest kernels the CPU supports.  The RX_TOOLS_SIMD
+ * environment variable (scalar, sse2, avx2, avx512) caps the choice.
+ *
+ * \return name of the selected implementation
+ */
+const char *dsp_init(void);
+
+/*!
+ * Fill a table with the kernels up to a level (0 scalar, 1 sse2,
+ * 2 avx2, 3 avx512), skipping what the CPU lacks
+ *
+ * \param k table to fill
+ * \param level highest level to use
+ * \return highest level actually used
+ */
+int dsp_init_level(struct dsp_kernels *k, int level);
+
+/* implementations, only for dsp_init() and benchmarks */
+void dsp_init_scalar(struct dsp_kernels *k);
+void dsp_init_sse2(struct dsp_kernels *k);
+void dsp_init_avx2(struct dsp_kernels *k);
+void dsp_init_avx512(struct dsp_kernels *k);
+
+/* the wider FFT passes hand the short spans down to the narrower ones */
+void fft_radix4_scalar(float *data, const float *tw, int n, int s);
+void fft_radix4_sse2(float *data, const float *tw, int n, int s);
+void fft_radix4_avx2(float *data, const float *tw, int n, int s);
+
+/*
+ * The stateful filters work in place, so the SIMD versions only supply
+ * the bulk of a block and these drivers handle the history and edges.
+ * fifth_body computes outputs m..m+count-1 going forward (in may be
+ * out), count is a multiple of width.
+ */
+typedef void (*fifth_body_fn)(const int16_t *in, int16_t *out, int m, int count);
+
+void fifth_order_run(int16_t *data, int length, int16_t *hist_i, int16_t *hist_q,
+	fifth_body_fn body, int width);
+void fifth_decimate_run(const int16_t *in, int16_t *out, int n, fifth_body_fn body, int width);
+
+/*
+ * fir_short_body computes outputs 0..count-1, count is a multiple of
+ * width, and the driver finishes the rest.
+ */
+typedef void (*fir_short_body_fn)(const int16_t *x_i, const int16_t *x_q, int16_t *out, int count,
+	const int16_t *coef, int len, int shift);
+
+void fir_short_run(const int16_t *x_i, const int16_t *x_q, int16_t *out, int n,
+	const int16_t *coef, int len, int shift, fir_short_body_fn body, int width);
+
+/*
+ * fm_disc_body computes outputs m..m+count-1 from iq[2m-2] on, m >= 1.
+ * The float math is spelled out the same everywhere so all versions
+ * round alike: atan(a) on [0, 1] is a * poly(a^2), Hastings' fit,
+ * 1.2e-5 rad at worst, and the angle keeps rx_fm's old scale of
+ * 3.14159 to 1<<14.
+ */
+typedef void (*fm_disc_body_fn)(const int16_t *iq, int16_t *out, int m, int count);
+
+#define ATAN_P1		0.9998660f
+#define ATAN_P3		-0.3302995f
+#define ATAN_P5		0.1801410f
+#define ATAN_P7		-0.0851330f
+#define ATAN_P9		0.0208351f
+#define ATAN_PI		3.14159265f
+#define ATAN_PI_2	1.57079633f
+#define ATAN_SCALE	(16384.0f / 3.14159f)
+
+void fm_disc_run(const int16_t *iq, int16_t *out, int n, int pre_r, int pre_j,
+	fm_disc_body_fn body, int width);
+
+#endif /*__KERNELS_H*/
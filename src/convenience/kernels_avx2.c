@@ -0,0 +1,590 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* AVX2 kernels, 8 complex samples per vector, see kernels.c for the reference */
+
+#include "kernels.h"
+#include <string.h>
+#include <immintrin.h>
+
+/* unpack and pack work within 128 bit lanes, they undo each other */
+static __m256i madd_pair(__m256i a, __m256i b, __m256i c, int hi)
+{
+	if (hi) {
+		return _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), c);}
+	return _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), c);
+}
+
+static __m256i even32(__m256i a, __m256i b)
+{
+	__m256 s = _mm256_shuffle_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b), _MM_SHUFFLE(2,0,2,0));
+	return _mm256_permute4x64_epi64(_mm256_castps_si256(s), _MM_SHUFFLE(3,1,2,0));
+}
+
+static __m256i odd32(__m256i a, __m256i b)
+{
+	__m256 s = _mm256_shuffle_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b), _MM_SHUFFLE(3,1,3,1));
+	return _mm256_permute4x64_epi64(_mm256_castps_si256(s), _MM_SHUFFLE(3,1,2,0));
+}
+
+static __m256i load(const void *p)
+{
+	return _mm256_loadu_si256((const __m256i *)p);
+}
+
+static void store(void *p, __m256i v)
+{
+	_mm256_storeu_si256((__m256i *)p, v);
+}
+
+static void rotate16_90_avx2(const int16_t *in, int16_t *out, uint32_t len)
+{
+	uint32_t i;
+	const __m256i neg = _mm256_setr_epi16(0, 0, -1, 0, -1, -1, 0, -1, 0, 0, -1, 0, -1, -1, 0, -1);
+	__m256i v;
+	for (i=0; i+16<=len; i+=16) {
+		v = load(in + i);
+		v = _mm256_shufflelo_epi16(v, _MM_SHUFFLE(2,3,1,0));
+		v = _mm256_shufflehi_epi16(v, _MM_SHUFFLE(2,3,1,0));
+		store(out + i, _mm256_sub_epi16(_mm256_xor_si256(v, neg), neg));
+	}
+	if (i < len) {
+		v = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(in + i)));
+		v = _mm256_shufflelo_epi16(v, _MM_SHUFFLE(2,3,1,0));
+		v = _mm256_shufflehi_epi16(v, _MM_SHUFFLE(2,3,1,0));
+		v = _mm256_sub_epi16(_mm256_xor_si256(v, neg), neg);
+		_mm_storeu_si128((__m128i *)(out + i), _mm256_castsi256_si128(v));
+	}
+}
+
+static void fifth_body_avx2(const int16_t *in, int16_t *out, int m, int count)
+{
+	const __m256i c15 = _mm256_set1_epi32(1 | (5 << 16));
+	const __m256i c1010 = _mm256_set1_epi16(10);
+	const __m256i c51 = _mm256_set1_epi32(5 | (1 << 16));
+	__m256i a, b, t0, t1, t2, t3, t4, t5, lo, hi;
+	const int16_t *p;
+	int end = m + count;
+	for (; m<end; m+=8) {
+		p = in + 4*m;
+		a = load(p - 12);
+		b = load(p + 4);
+		t0 = odd32(a, b);
+		a = load(p - 8);
+		b = load(p + 8);
+		t1 = even32(a, b);
+		t2 = odd32(a, b);
+		a = load(p - 4);
+		b = load(p + 12);
+		t3 = even32(a, b);
+		t4 = odd32(a, b);
+		a = load(p);
+		b = load(p + 16);
+		t5 = even32(a, b);
+		lo = _mm256_add_epi32(madd_pair(t0, t1, c15, 0), madd_pair(t2, t3, c1010, 0));
+		lo = _mm256_srai_epi32(_mm256_add_epi32(lo, madd_pair(t4, t5, c51, 0)), 5);
+		hi = _mm256_add_epi32(madd_pair(t0, t1, c15, 1), madd_pair(t2, t3, c1010, 1));
+		hi = _mm256_srai_epi32(_mm256_add_epi32(hi, madd_pair(t4, t5, c51, 1)), 5);
+		store(out + 2*m, _mm256_packs_epi32(lo, hi));
+	}
+}
+
+static void fifth_order_avx2(int16_t *data, int length, int16_t *hist_i, int16_t *hist_q)
+{
+	fifth_order_run(data, length, hist_i, hist_q, fifth_body_avx2, 8);
+}
+
+static void fifth_decimate_avx2(const int16_t *in, int16_t *out, int n)
+{
+	fifth_decimate_run(in, out, n, fifth_body_avx2, 8);
+}
+
+static void split_iq_avx2(const int16_t *in, int16_t *out_i, int16_t *out_q, int n)
+/* I sign extended from the low half of each 32 bit pair, Q from the high half */
+{
+	__m256i a, b;
+	int k;
+	for (k=0; k+16<=n; k+=16) {
+		a = load(in + 2*k);
+		b = load(in + 2*k + 16);
+		store(out_i + k, _mm256_permute4x64_epi64(_mm256_packs_epi32(
+			_mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16), _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16)),
+			_MM_SHUFFLE(3,1,2,0)));
+		store(out_q + k, _mm256_permute4x64_epi64(_mm256_packs_epi32(
+			_mm256_srai_epi32(a, 16), _mm256_srai_epi32(b, 16)), _MM_SHUFFLE(3,1,2,0)));
+	}
+	for (; k<n; k++) {
+		out_i[k] = in[2*k];
+		out_q[k] = in[2*k+1];
+	}
+}
+
+static void fir_iq_avx2(const int16_t *x_i, const int16_t *x_q, int16_t *out, int n, int step,
+	const int16_t *coef, int len, int shift)
+{
+	const __m128i round = _mm_set1_epi32(1 << (shift - 1));
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	__m256i c, acc_i, acc_q;
+	__m128i s_i, s_q, t;
+	int32_t iq;
+	int m, j;
+	for (m=0; m<n; m++) {
+		acc_i = _mm256_setzero_si256();
+		acc_q = _mm256_setzero_si256();
+		for (j=0; j<len; j+=16) {
+			c = load(coef + j);
+			acc_i = _mm256_add_epi32(acc_i, _mm256_madd_epi16(load(x_i + j), c));
+			acc_q = _mm256_add_epi32(acc_q, _mm256_madd_epi16(load(x_q + j), c));
+		}
+		/* the lanes of each added up, I in lane 0 and Q in lane 1 */
+		s_i = _mm_add_epi32(_mm256_castsi256_si128(acc_i), _mm256_extracti128_si256(acc_i, 1));
+		s_q = _mm_add_epi32(_mm256_castsi256_si128(acc_q), _mm256_extracti128_si256(acc_q, 1));
+		t = _mm_add_epi32(_mm_unpacklo_epi32(s_i, s_q), _mm_unpackhi_epi32(s_i, s_q));
+		t = _mm_add_epi32(t, _mm_srli_si128(t, 8));
+		t = _mm_sra_epi32(_mm_add_epi32(t, round), count);
+		iq = _mm_cvtsi128_si32(_mm_packs_epi32(t, t));
+		memcpy(out + 2*m, &iq, sizeof(iq));
+		x_i += step;
+		x_q += step;
+	}
+}
+
+static int32_t coef_pair(const int16_t *c)
+/* c[0] in the low half, to pair with the older of two samples */
+{
+	return (int32_t)((uint16_t)c[0] | ((uint32_t)(uint16_t)c[1] << 16));
+}
+
+static __m256i fir_short16(const int16_t *x, const __m256i *c, int len, __m256i round, __m128i count)
+/* outputs 0..15 of one channel, saturated to int16, the unpacks and
+   the pack both stay within 128 bit lanes so the order comes out right */
+{
+	__m256i a, b, lo = round, hi = round;
+	int j;
+	for (j=0; j<len; j+=2) {
+		a = load(x + j);
+		b = load(x + j + 1);
+		lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), c[j/2]));
+		hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), c[j/2]));
+	}
+	return _mm256_packs_epi32(_mm256_sra_epi32(lo, count), _mm256_sra_epi32(hi, count));
+}
+
+static void fir_short_body_avx2(const int16_t *x_i, const int16_t *x_q, int16_t *out, int n,
+	const int16_t *coef, int len, int shift)
+{
+	const __m256i round = _mm256_set1_epi32(1 << (shift - 1));
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	__m256i c[FIR_SHORT/2], i, q, lo, hi;
+	int m, j;
+	for (j=0; j<len; j+=2) {
+		c[j/2] = _mm256_set1_epi32(coef_pair(coef + j));}
+	for (m=0; m<n; m+=16) {
+		i = fir_short16(x_i + m, c, len, round, count);
+		q = fir_short16(x_q + m, c, len, round, count);
+		lo = _mm256_unpacklo_epi16(i, q);
+		hi = _mm256_unpackhi_epi16(i, q);
+		store(out + 2*m, _mm256_permute2x128_si256(lo, hi, 0x20));
+		store(out + 2*m + 16, _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+}
+
+static void fir_short_avx2(const int16_t *x_i, const int16_t *x_q, int16_t *out, int n,
+	const int16_t *coef, int len, int shift)
+{
+	fir_short_run(x_i, x_q, out, n, coef, len, shift, fir_short_body_avx2, 16);
+}
+
+static int32_t dot16_avx2(const int16_t *x, const int16_t *coef, int len)
+{
+	__m256i acc = _mm256_setzero_si256();
+	__m128i s;
+	int j;
+	for (j=0; j<len; j+=16) {
+		acc = _mm256_add_epi32(acc, _mm256_madd_epi16(load(x + j), load(coef + j)));}
+	s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+	s = _mm_add_epi32(s, _mm_srli_si128(s, 8));
+	s = _mm_add_epi32(s, _mm_srli_si128(s, 4));
+	return _mm_cvtsi128_si32(s);
+}
+
+static void fm_disc_body_avx2(const int16_t *iq, int16_t *out, int m, int count)
+/* the same steps as fm_disc_one() in kernels.c, 8 samples at a time */
+{
+	const __m256 sign = _mm256_set1_ps(-0.0f), one = _mm256_set1_ps(1.0f), zero = _mm256_setzero_ps();
+	__m256i a, b, v;
+	__m256 ar, aj, br, bj, cr, cj, ax, ay, x, s, r;
+	int k;
+	for (k=m; k<m+count; k+=8) {
+		a = load(iq + 2*k);
+		b = load(iq + 2*k - 2);
+		ar = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16));
+		aj = _mm256_cvtepi32_ps(_mm256_srai_epi32(a, 16));
+		br = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16));
+		bj = _mm256_cvtepi32_ps(_mm256_srai_epi32(b, 16));
+		cr = _mm256_add_ps(_mm256_mul_ps(ar, br), _mm256_mul_ps(aj, bj));
+		cj = _mm256_sub_ps(_mm256_mul_ps(aj, br), _mm256_mul_ps(ar, bj));
+		ax = _mm256_andnot_ps(sign, cr);
+		ay = _mm256_andnot_ps(sign, cj);
+		x = _mm256_div_ps(_mm256_min_ps(ax, ay), _mm256_max_ps(_mm256_max_ps(ax, ay), one));
+		s = _mm256_mul_ps(x, x);
+		r = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(ATAN_P9), s), _mm256_set1_ps(ATAN_P7));
+		r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(ATAN_P5));
+		r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(ATAN_P3));
+		r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(ATAN_P1));
+		r = _mm256_mul_ps(x, r);
+		r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(ATAN_PI_2), r), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+		r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(ATAN_PI), r), _mm256_cmp_ps(cr, zero, _CMP_LT_OQ));
+		r = _mm256_xor_ps(r, _mm256_and_ps(_mm256_cmp_ps(cj, zero, _CMP_LT_OQ), sign));
+		v = _mm256_cvttps_epi32(_mm256_mul_ps(r, _mm256_set1_ps(ATAN_SCALE)));
+		_mm_storeu_si128((__m128i *)(out + k), _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+	}
+}
+
+static void fm_disc_avx2(const int16_t *iq, int16_t *out, int n, int pre_r, int pre_j)
+{
+	fm_disc_run(iq, out, n, pre_r, pre_j, fm_disc_body_avx2, 8);
+}
+
+static void remove_dc_avx2(int16_t *data, int length)
+{
+	int i, j, k, n = length / 2;
+	int32_t lanes[8];
+	int64_t sum_i = 0, sum_q = 0;
+	int16_t ave_i, ave_q;
+	__m256i v, acc_i, acc_q, ave;
+	/* flush the 32 bit lanes before they could overflow */
+	for (i=0; i+8<=n; ) {
+		acc_i = _mm256_setzero_si256();
+		acc_q = _mm256_setzero_si256();
+		for (j=0; j<32768 && i+8<=n; j++, i+=8) {
+			v = load(data + 2*i);
+			acc_i = _mm256_add_epi32(acc_i, _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16));
+			acc_q = _mm256_add_epi32(acc_q, _mm256_srai_epi32(v, 16));
+		}
+		store(lanes, acc_i);
+		for (k=0; k<8; k++) {
+			sum_i += lanes[k];}
+		store(lanes, acc_q);
+		for (k=0; k<8; k++) {
+			sum_q += lanes[k];}
+	}
+	for (; i<n; i++) {
+		sum_i += data[2*i];
+		sum_q += data[2*i+1];
+	}
+	ave_i = (int16_t)(sum_i / (int64_t)(length));
+	ave_q = (int16_t)(sum_q / (int64_t)(length - 1));
+	ave = _mm256_set1_epi32((int32_t)((uint16_t)ave_i | ((uint32_t)(uint16_t)ave_q << 16)));
+	for (i=0; i+8<=n; i+=8) {
+		store(data + 2*i, _mm256_sub_epi16(load(data + 2*i), ave));}
+	for (; i<n; i++) {
+		data[2*i]   -= ave_i;
+		data[2*i+1] -= ave_q;
+	}
+}
+
+static __m256i round8(__m256i v)
+{
+	return _mm256_srai_epi16(_mm256_adds_epi16(v, _mm256_set1_epi16(128)), 8);
+}
+
+static __m256i pack8(const int16_t *in)
+/* packs works per 128 bit lane, put the quadwords back in order */
+{
+	__m256i v = _mm256_packs_epi16(round8(load(in)), round8(load(in + 16)));
+	return _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3,1,2,0));
+}
+
+static void cs16_to_cs8_avx2(const int16_t *in, int8_t *out, size_t n)
+{
+	size_t i;
+	for (i=0; i+32<=n; i+=32) {
+		store(out + i, pack8(in + i));}
+	for (; i<n; i++) {
+		int v = (in[i] + 128) >> 8;
+		out[i] = (int8_t)(v > 127 ? 127 : v);
+	}
+}
+
+static void cs16_to_cu8_avx2(const int16_t *in, uint8_t *out, size_t n)
+{
+	size_t i;
+	const __m256i flip = _mm256_set1_epi8((char)0x80);
+	for (i=0; i+32<=n; i+=32) {
+		store(out + i, _mm256_xor_si256(pack8(in + i), flip));}
+	for (; i<n; i++) {
+		int v = (in[i] + 128) >> 8;
+		out[i] = (uint8_t)((v > 127 ? 127 : v) + 128);
+	}
+}
+
+static void cs16_to_cf32_avx2(const int16_t *in, float *out, size_t n)
+{
+	size_t i;
+	const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+	__m256i v;
+	for (i=0; i+8<=n; i+=8) {
+		v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in + i)));
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+	}
+	for (; i<n; i++) {
+		out[i] = (float)in[i] * (1.0f / 32768.0f);}
+}
+
+static void cs16_to_cs12_avx2(const int16_t *in, uint8_t *out, size_t n)
+/* round to 12 bits, join each I/Q pair into the low 24 bits of a dword,
+   then squeeze out the top bytes, 16 values make 24 bytes */
+{
+	size_t i;
+	int a, b;
+	const __m256i idx = _mm256_setr_epi8(0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1,
+		0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1);
+	const __m256i lo12 = _mm256_set1_epi32(0x000fff);
+	const __m256i hi12 = _mm256_set1_epi32(0xfff000);
+	__m256i v;
+	for (i=0; i+16<=n; i+=16) {
+		v = _mm256_srai_epi16(_mm256_adds_epi16(load(in + i), _mm256_set1_epi16(8)), 4);
+		v = _mm256_or_si256(_mm256_and_si256(v, lo12), _mm256_and_si256(_mm256_srli_epi32(v, 4), hi12));
+		v = _mm256_shuffle_epi8(v, idx);
+		v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0,1,2,4,5,6,3,7));
+		_mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(v));
+		_mm_storel_epi64((__m128i *)(out + 16), _mm256_extracti128_si256(v, 1));
+		out += 24;
+	}
+	for (; i+1<n; i+=2) {
+		a = (in[i] + 8) >> 4;
+		b = (in[i+1] + 8) >> 4;
+		a = a > 2047 ? 2047 : a;
+		b = b > 2047 ? 2047 : b;
+		*out++ = (uint8_t)a;
+		*out++ = (uint8_t)(((a >> 8) & 0x0f) | ((b & 0x0f) << 4));
+		*out++ = (uint8_t)(b >> 4);
+	}
+}
+
+static void widen8_avx2(const uint8_t *in, int16_t *out, size_t n, uint8_t flip)
+{
+	size_t i;
+	const __m128i f = _mm_set1_epi8((char)flip);
+	__m128i v;
+	for (i=0; i+16<=n; i+=16) {
+		v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + i)), f);
+		store(out + i, _mm256_slli_epi16(_mm256_cvtepi8_epi16(v), 8));
+	}
+	for (; i<n; i++) {
+		out[i] = (int16_t)((int8_t)(in[i] ^ flip) * 256);}
+}
+
+static void cs8_to_cs16_avx2(const int8_t *in, int16_t *out, size_t n)
+{
+	widen8_avx2((const uint8_t *)in, out, n, 0);
+}
+
+static void cu8_to_cs16_avx2(const uint8_t *in, int16_t *out, size_t n)
+{
+	widen8_avx2(in, out, n, 0x80);
+}
+
+static void cs12_to_cs16_avx2(const uint8_t *in, int16_t *out, size_t n)
+/* words (b0,b1) and (b1,b2) of each triple, the first moves up a nibble
+   and the second loses its low nibble, each lane reads 16 of 12 bytes */
+{
+	size_t i;
+	uint8_t b0, b1, b2;
+	const __m256i idx = _mm256_setr_epi8(0,1,1,2,3,4,4,5,6,7,7,8,9,10,10,11,
+		0,1,1,2,3,4,4,5,6,7,7,8,9,10,10,11);
+	const __m256i mask = _mm256_set1_epi16((short)0xfff0);
+	__m256i v;
+	for (i=0; i+24<=n; i+=16) {
+		v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)in)),
+			_mm_loadu_si128((const __m128i *)(in + 12)), 1);
+		v = _mm256_shuffle_epi8(v, idx);
+		store(out + i, _mm256_blend_epi16(_mm256_and_si256(v, mask), _mm256_slli_epi16(v, 4), 0x55));
+		in += 24;
+	}
+	for (; i+1<n; i+=2) {
+		b0 = *in++;
+		b1 = *in++;
+		b2 = *in++;
+		out[i]   = (int16_t)((b1 << 12) | (b0 << 4));
+		out[i+1] = (int16_t)((b2 << 8) | (b1 & 0xf0));
+	}
+}
+
+static __m256i round16(const float *in)
+{
+	__m256 v = _mm256_mul_ps(_mm256_loadu_ps(in), _mm256_set1_ps(32768.0f));
+	v = _mm256_min_ps(_mm256_max_ps(v, _mm256_set1_ps(-32768.0f)), _mm256_set1_ps(32767.0f));
+	return _mm256_cvtps_epi32(v);
+}
+
+static void cf32_to_cs16_avx2(const float *in, int16_t *out, size_t n)
+{
+	size_t i;
+	float v;
+	__m256i p;
+	for (i=0; i+16<=n; i+=16) {
+		p = _mm256_packs_epi32(round16(in + i), round16(in + i + 8));
+		store(out + i, _mm256_permute4x64_epi64(p, _MM_SHUFFLE(3,1,2,0)));
+	}
+	for (; i<n; i++) {
+		v = in[i] * 32768.0f;
+		if (!(v >= -32768.0f)) {
+			v = -32768.0f;}
+		if (v > 32767.0f) {
+			v = 32767.0f;}
+		out[i] = (int16_t)_mm_cvtss_si32(_mm_set_ss(v));
+	}
+}
+
+static void flip8_avx2(const uint8_t *in, uint8_t *out, size_t n)
+{
+	size_t i;
+	const __m256i f = _mm256_set1_epi8((char)0x80);
+	for (i=0; i+32<=n; i+=32) {
+		store(out + i, _mm256_xor_si256(load(in + i), f));}
+	for (; i<n; i++) {
+		out[i] = in[i] ^ 0x80;}
+}
+
+static void window_cs16_avx2(const int16_t *iq, const float *win, float *out, int len)
+{
+	int j;
+	__m256i v;
+	__m256 w;
+	const __m256i lo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+	const __m256i hi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+	for (j=0; j+8<=len; j+=8) {
+		v = load(iq + 2*j);
+		w = _mm256_loadu_ps(win + j);
+		_mm256_storeu_ps(out + 2*j, _mm256_mul_ps(_mm256_cvtepi32_ps(
+			_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v))), _mm256_permutevar8x32_ps(w, lo)));
+		_mm256_storeu_ps(out + 2*j + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(
+			_mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1))), _mm256_permutevar8x32_ps(w, hi)));
+	}
+	for (; j<len; j++) {
+		out[2*j]   = (float)iq[2*j]   * win[j];
+		out[2*j+1] = (float)iq[2*j+1] * win[j];
+	}
+}
+
+static __m256 cmul(__m256 a, const float *t, int s)
+/* see fft_radix4_scalar() for the twiddle layout */
+{
+	return _mm256_add_ps(_mm256_mul_ps(a, _mm256_loadu_ps(t)),
+		_mm256_mul_ps(_mm256_permute_ps(a, 0xb1), _mm256_loadu_ps(t + 2*s)));
+}
+
+void fft_radix4_avx2(float *data, const float *tw, int n, int s)
+{
+	int g, j;
+	float *p;
+	const __m256 neg_im = _mm256_setr_ps(0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f);
+	__m256 a0, a1, a2, a3, A0, A1, S, D;
+	if (s < 4) {
+		fft_radix4_sse2(data, tw, n, s);
+		return;
+	}
+	for (g=0; g<n; g+=4*s) {
+		for (j=0; j<s; j+=4) {
+			p = data + 2*(g + j);
+			a0 = _mm256_loadu_ps(p);
+			a1 = cmul(_mm256_loadu_ps(p + 2*s), tw + 2*j, s);
+			a2 = cmul(_mm256_loadu_ps(p + 4*s), tw + 4*s + 2*j, s);
+			a3 = cmul(_mm256_loadu_ps(p + 6*s), tw + 8*s + 2*j, s);
+			A0 = _mm256_add_ps(a0, a1);
+			A1 = _mm256_sub_ps(a0, a1);
+			S  = _mm256_add_ps(a2, a3);
+			D  = _mm256_xor_ps(_mm256_permute_ps(_mm256_sub_ps(a2, a3), 0xb1), neg_im);
+			_mm256_storeu_ps(p,       _mm256_add_ps(A0, S));
+			_mm256_storeu_ps(p + 2*s, _mm256_add_ps(A1, D));
+			_mm256_storeu_ps(p + 4*s, _mm256_sub_ps(A0, S));
+			_mm256_storeu_ps(p + 6*s, _mm256_sub_ps(A1, D));
+		}
+	}
+}
+
+static __m256 power8(const float *iq)
+/* |x|^2 of 8 complex samples */
+{
+	__m256 a = _mm256_loadu_ps(iq);
+	__m256 b = _mm256_loadu_ps(iq + 8);
+	a = _mm256_hadd_ps(_mm256_mul_ps(a, a), _mm256_mul_ps(b, b));
+	return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(a), _MM_SHUFFLE(3,1,2,0)));
+}
+
+static void power_sum_avx2(const float *iq, double *avg, int len)
+{
+	int j;
+	__m256 p;
+	for (j=0; j+8<=len; j+=8) {
+		p = power8(iq + 2*j);
+		_mm256_storeu_pd(avg + j,     _mm256_add_pd(_mm256_loadu_pd(avg + j),
+			_mm256_cvtps_pd(_mm256_castps256_ps128(p))));
+		_mm256_storeu_pd(avg + j + 4, _mm256_add_pd(_mm256_loadu_pd(avg + j + 4),
+			_mm256_cvtps_pd(_mm256_extractf128_ps(p, 1))));
+	}
+	for (; j<len; j++) {
+		avg[j] += (double)(iq[2*j] * iq[2*j] + iq[2*j+1] * iq[2*j+1]);}
+}
+
+static void power_max_avx2(const float *iq, double *avg, int len)
+{
+	int j;
+	double p;
+	__m256 v;
+	for (j=0; j+8<=len; j+=8) {
+		v = power8(iq + 2*j);
+		_mm256_storeu_pd(avg + j,     _mm256_max_pd(_mm256_loadu_pd(avg + j),
+			_mm256_cvtps_pd(_mm256_castps256_ps128(v))));
+		_mm256_storeu_pd(avg + j + 4, _mm256_max_pd(_mm256_loadu_pd(avg + j + 4),
+			_mm256_cvtps_pd(_mm256_extractf128_ps(v, 1))));
+	}
+	for (; j<len; j++) {
+		p = (double)(iq[2*j] * iq[2*j] + iq[2*j+1] * iq[2*j+1]);
+		if (p > avg[j]) {
+			avg[j] = p;}
+	}
+}
+
+void dsp_init_avx2(struct dsp_kernels *k)
+{
+	k->name         = "avx2";
+	k->rotate16_90  = rotate16_90_avx2;
+	k->fifth_order  = fifth_order_avx2;
+	k->fifth_decimate = fifth_decimate_avx2;
+	k->split_iq     = split_iq_avx2;
+	k->fir_iq       = fir_iq_avx2;
+	k->fir_short    = fir_short_avx2;
+	k->dot16        = dot16_avx2;
+	k->fm_disc      = fm_disc_avx2;
+	k->remove_dc    = remove_dc_avx2;
+	k->cs16_to_cs8  = cs16_to_cs8_avx2;
+	k->cs16_to_cu8  = cs16_to_cu8_avx2;
+	k->cs16_to_cf32 = cs16_to_cf32_avx2;
+	k->cs16_to_cs12 = cs16_to_cs12_avx2;
+	k->cs8_to_cs16  = cs8_to_cs16_avx2;
+	k->cu8_to_cs16  = cu8_to_cs16_avx2;
+	k->cs12_to_cs16 = cs12_to_cs16_avx2;
+	k->cf32_to_cs16 = cf32_to_cs16_avx2;
+	k->flip8        = flip8_avx2;
+	k->window_cs16  = window_cs16_avx2;
+	k->fft_radix4   = fft_radix4_avx2;
+	k->power_sum    = power_sum_avx2;
+	k->power_max    = power_max_avx2;
+}
+
+// vim: tabstop=8:softtabstop=8:shiftwidth=8:noexpandtab
@@ -0,0 +1,529 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* AVX-512 (F + BW) kernels, 16 complex samples per vector, see kernels.c for the reference */
+
+#include "kernels.h"
+#include <string.h>
+#include <immintrin.h>
+
+/* unpack and pack work within 128 bit lanes, they undo each other */
+static __m512i madd_pair(__m512i a, __m512i b, __m512i c, int hi)
+{
+	if (hi) {
+		return _mm512_madd_epi16(_mm512_unpackhi_epi16(a, b), c);}
+	return _mm512_madd_epi16(_mm512_unpacklo_epi16(a, b), c);
+}
+
+static __m512i load(const void *p)
+{
+	return _mm512_loadu_si512(p);
+}
+
+static void store(void *p, __m512i v)
+{
+	_mm512_storeu_si512(p, v);
+}
+
+static void rotate16_90_avx512(const int16_t *in, int16_t *out, uint32_t len)
+{
+	uint32_t i;
+	/* lanes 2, 4, 5 and 7 of every 8 */
+	const __mmask32 neg = 0xb4b4b4b4;
+	const __m512i zero = _mm512_setzero_si512();
+	__m512i v;
+	__mmask32 tail;
+	for (i=0; i<len; i+=32) {
+		tail = len - i >= 32 ? 0xffffffff : (1u << (len - i)) - 1;
+		v = _mm512_maskz_loadu_epi16(tail, in + i);
+		v = _mm512_shufflelo_epi16(v, _MM_SHUFFLE(2,3,1,0));
+		v = _mm512_shufflehi_epi16(v, _MM_SHUFFLE(2,3,1,0));
+		v = _mm512_mask_sub_epi16(v, neg, zero, v);
+		_mm512_mask_storeu_epi16(out + i, tail, v);
+	}
+}
+
+static void fifth_body_avx512(const int16_t *in, int16_t *out, int m, int count)
+{
+	const __m512i c15 = _mm512_set1_epi32(1 | (5 << 16));
+	const __m512i c1010 = _mm512_set1_epi16(10);
+	const __m512i c51 = _mm512_set1_epi32(5 | (1 << 16));
+	const __m512i even = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+	const __m512i odd = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+	__m512i a, b, t0, t1, t2, t3, t4, t5, lo, hi;
+	const int16_t *p;
+	int end = m + count;
+	for (; m<end; m+=16) {
+		p = in + 4*m;
+		a = load(p - 12);
+		b = load(p + 20);
+		t0 = _mm512_permutex2var_epi32(a, odd, b);
+		a = load(p - 8);
+		b = load(p + 24);
+		t1 = _mm512_permutex2var_epi32(a, even, b);
+		t2 = _mm512_permutex2var_epi32(a, odd, b);
+		a = load(p - 4);
+		b = load(p + 28);
+		t3 = _mm512_permutex2var_epi32(a, even, b);
+		t4 = _mm512_permutex2var_epi32(a, odd, b);
+		a = load(p);
+		b = load(p + 32);
+		t5 = _mm512_permutex2var_epi32(a, even, b);
+		lo = _mm512_add_epi32(madd_pair(t0, t1, c15, 0), madd_pair(t2, t3, c1010, 0));
+		lo = _mm512_srai_epi32(_mm512_add_epi32(lo, madd_pair(t4, t5, c51, 0)), 5);
+		hi = _mm512_add_epi32(madd_pair(t0, t1, c15, 1), madd_pair(t2, t3, c1010, 1));
+		hi = _mm512_srai_epi32(_mm512_add_epi32(hi, madd_pair(t4, t5, c51, 1)), 5);
+		store(out + 2*m, _mm512_packs_epi32(lo, hi));
+	}
+}
+
+static void fifth_order_avx512(int16_t *data, int length, int16_t *hist_i, int16_t *hist_q)
+{
+	fifth_order_run(data, length, hist_i, hist_q, fifth_body_avx512, 16);
+}
+
+static void fifth_decimate_avx512(const int16_t *in, int16_t *out, int n)
+{
+	fifth_decimate_run(in, out, n, fifth_body_avx512, 16);
+}
+
+static void split_iq_avx512(const int16_t *in, int16_t *out_i, int16_t *out_q, int n)
+/* I sign extended from the low half of each 32 bit pair, Q from the high half */
+{
+	const __m512i order = _mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7);
+	__m512i a, b;
+	int k;
+	for (k=0; k+32<=n; k+=32) {
+		a = load(in + 2*k);
+		b = load(in + 2*k + 32);
+		store(out_i + k, _mm512_permutexvar_epi64(order, _mm512_packs_epi32(
+			_mm512_srai_epi32(_mm512_slli_epi32(a, 16), 16), _mm512_srai_epi32(_mm512_slli_epi32(b, 16), 16))));
+		store(out_q + k, _mm512_permutexvar_epi64(order, _mm512_packs_epi32(
+			_mm512_srai_epi32(a, 16), _mm512_srai_epi32(b, 16))));
+	}
+	for (; k<n; k++) {
+		out_i[k] = in[2*k];
+		out_q[k] = in[2*k+1];
+	}
+}
+
+static __m128i fold512(__m512i v)
+/* 4 lanes, each the sum of 4 */
+{
+	__m256i h = _mm256_add_epi32(_mm512_castsi512_si256(v), _mm512_extracti64x4_epi64(v, 1));
+	return _mm_add_epi32(_mm256_castsi256_si128(h), _mm256_extracti128_si256(h, 1));
+}
+
+static void fir_iq_avx512(const int16_t *x_i, const int16_t *x_q, int16_t *out, int n, int step,
+	const int16_t *coef, int len, int shift)
+{
+	const __m128i round = _mm_set1_epi32(1 << (shift - 1));
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	__m512i c, acc_i, acc_q;
+	__m128i s_i, s_q, t;
+	int32_t iq;
+	int m, j;
+	for (m=0; m<n; m++) {
+		acc_i = _mm512_setzero_si512();
+		acc_q = _mm512_setzero_si512();
+		for (j=0; j<len; j+=32) {
+			c = load(coef + j);
+			acc_i = _mm512_add_epi32(acc_i, _mm512_madd_epi16(load(x_i + j), c));
+			acc_q = _mm512_add_epi32(acc_q, _mm512_madd_epi16(load(x_q + j), c));
+		}
+		s_i = fold512(acc_i);
+		s_q = fold512(acc_q);
+		t = _mm_add_epi32(_mm_unpacklo_epi32(s_i, s_q), _mm_unpackhi_epi32(s_i, s_q));
+		t = _mm_add_epi32(t, _mm_srli_si128(t, 8));
+		t = _mm_sra_epi32(_mm_add_epi32(t, round), count);
+		iq = _mm_cvtsi128_si32(_mm_packs_epi32(t, t));
+		memcpy(out + 2*m, &iq, sizeof(iq));
+		x_i += step;
+		x_q += step;
+	}
+}
+
+static int32_t coef_pair(const int16_t *c)
+/* c[0] in the low half, to pair with the older of two samples */
+{
+	return (int32_t)((uint16_t)c[0] | ((uint32_t)(uint16_t)c[1] << 16));
+}
+
+static __m512i fir_short32(const int16_t *x, const __m512i *c, int len, __m512i round, __m128i count)
+/* outputs 0..31 of one channel, saturated to int16, the unpacks and
+   the pack both stay within 128 bit lanes so the order comes out right */
+{
+	__m512i a, b, lo = round, hi = round;
+	int j;
+	for (j=0; j<len; j+=2) {
+		a = load(x + j);
+		b = load(x + j + 1);
+		lo = _mm512_add_epi32(lo, _mm512_madd_epi16(_mm512_unpacklo_epi16(a, b), c[j/2]));
+		hi = _mm512_add_epi32(hi, _mm512_madd_epi16(_mm512_unpackhi_epi16(a, b), c[j/2]));
+	}
+	return _mm512_packs_epi32(_mm512_sra_epi32(lo, count), _mm512_sra_epi32(hi, count));
+}
+
+static void fir_short_body_avx512(const int16_t *x_i, const int16_t *x_q, int16_t *out, int n,
+	const int16_t *coef, int len, int shift)
+{
+	/* 64 bit lanes of the unpacked halves in output order */
+	const __m512i first = _mm512_set_epi64(11, 10, 3, 2, 9, 8, 1, 0);
+	const __m512i second = _mm512_set_epi64(15, 14, 7, 6, 13, 12, 5, 4);
+	const __m512i round = _mm512_set1_epi32(1 << (shift - 1));
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	__m512i c[FIR_SHORT/2], i, q, lo, hi;
+	int m, j;
+	for (j=0; j<len; j+=2) {
+		c[j/2] = _mm512_set1_epi32(coef_pair(coef + j));}
+	for (m=0; m<n; m+=32) {
+		i = fir_short32(x_i + m, c, len, round, count);
+		q = fir_short32(x_q + m, c, len, round, count);
+		lo = _mm512_unpacklo_epi16(i, q);
+		hi = _mm512_unpackhi_epi16(i, q);
+		store(out + 2*m, _mm512_permutex2var_epi64(lo, first, hi));
+		store(out + 2*m + 32, _mm512_permutex2var_epi64(lo, second, hi));
+	}
+}
+
+static void fir_short_avx512(const int16_t *x_i, const int16_t *x_q, int16_t *out, int n,
+	const int16_t *coef, int len, int shift)
+{
+	fir_short_run(x_i, x_q, out, n, coef, len, shift, fir_short_body_avx512, 32);
+}
+
+static int32_t dot16_avx512(const int16_t *x, const int16_t *coef, int len)
+{
+	__m512i acc = _mm512_setzero_si512();
+	__m128i s;
+	int j;
+	for (j=0; j<len; j+=32) {
+		acc = _mm512_add_epi32(acc, _mm512_madd_epi16(load(x + j), load(coef + j)));}
+	s = fold512(acc);
+	s = _mm_add_epi32(s, _mm_srli_si128(s, 8));
+	s = _mm_add_epi32(s, _mm_srli_si128(s, 4));
+	return _mm_cvtsi128_si32(s);
+}
+
+static void fm_disc_body_avx512(const int16_t *iq, int16_t *out, int m, int count)
+/* the same steps as fm_disc_one() in kernels.c, 16 samples at a time */
+{
+	const __m512i sign = _mm512_set1_epi32((int)0x80000000);
+	const __m512 one = _mm512_set1_ps(1.0f), zero = _mm512_setzero_ps();
+	__m512i a, b, v;
+	__m512 ar, aj, br, bj, cr, cj, ax, ay, x, s, r;
+	int k;
+	for (k=m; k<m+count; k+=16) {
+		a = load(iq + 2*k);
+		b = load(iq + 2*k - 2);
+		ar = _mm512_cvtepi32_ps(_mm512_srai_epi32(_mm512_slli_epi32(a, 16), 16));
+		aj = _mm512_cvtepi32_ps(_mm512_srai_epi32(a, 16));
+		br = _mm512_cvtepi32_ps(_mm512_srai_epi32(_mm512_slli_epi32(b, 16), 16));
+		bj = _mm512_cvtepi32_ps(_mm512_srai_epi32(b, 16));
+		cr = _mm512_add_ps(_mm512_mul_ps(ar, br), _mm512_mul_ps(aj, bj));
+		cj = _mm512_sub_ps(_mm512_mul_ps(aj, br), _mm512_mul_ps(ar, bj));
+		ax = _mm512_abs_ps(cr);
+		ay = _mm512_abs_ps(cj);
+		x = _mm512_div_ps(_mm512_min_ps(ax, ay), _mm512_max_ps(_mm512_max_ps(ax, ay), one));
+		s = _mm512_mul_ps(x, x);
+		r = _mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(ATAN_P9), s), _mm512_set1_ps(ATAN_P7));
+		r = _mm512_add_ps(_mm512_mul_ps(r, s), _mm512_set1_ps(ATAN_P5));
+		r = _mm512_add_ps(_mm512_mul_ps(r, s), _mm512_set1_ps(ATAN_P3));
+		r = _mm512_add_ps(_mm512_mul_ps(r, s), _mm512_set1_ps(ATAN_P1));
+		r = _mm512_mul_ps(x, r);
+		r = _mm512_mask_sub_ps(r, _mm512_cmp_ps_mask(ay, ax, _CMP_GT_OQ), _mm512_set1_ps(ATAN_PI_2), r);
+		r = _mm512_mask_sub_ps(r, _mm512_cmp_ps_mask(cr, zero, _CMP_LT_OQ), _mm512_set1_ps(ATAN_PI), r);
+		r = _mm512_castsi512_ps(_mm512_mask_xor_epi32(_mm512_castps_si512(r),
+			_mm512_cmp_ps_mask(cj, zero, _CMP_LT_OQ), _mm512_castps_si512(r), sign));
+		v = _mm512_cvttps_epi32(_mm512_mul_ps(r, _mm512_set1_ps(ATAN_SCALE)));
+		_mm256_storeu_si256((__m256i *)(out + k), _mm512_cvtsepi32_epi16(v));
+	}
+}
+
+static void fm_disc_avx512(const int16_t *iq, int16_t *out, int n, int pre_r, int pre_j)
+{
+	fm_disc_run(iq, out, n, pre_r, pre_j, fm_disc_body_avx512, 16);
+}
+
+static void remove_dc_avx512(int16_t *data, int length)
+{
+	int i, j, n = length / 2;
+	int64_t sum_i = 0, sum_q = 0;
+	int16_t ave_i, ave_q;
+	__m512i v, acc_i, acc_q, ave;
+	/* flush the 32 bit lanes before they could overflow */
+	for (i=0; i+16<=n; ) {
+		acc_i = _mm512_setzero_si512();
+		acc_q = _mm512_setzero_si512();
+		for (j=0; j<32768 && i+16<=n; j++, i+=16) {
+			v = load(data + 2*i);
+			acc_i = _mm512_add_epi32(acc_i, _mm512_srai_epi32(_mm512_slli_epi32(v, 16), 16));
+			acc_q = _mm512_add_epi32(acc_q, _mm512_srai_epi32(v, 16));
+		}
+		sum_i += _mm512_reduce_add_epi64(_mm512_add_epi64(
+			_mm512_cvtepi32_epi64(_mm512_castsi512_si256(acc_i)),
+			_mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(acc_i, 1))));
+		sum_q += _mm512_reduce_add_epi64(_mm512_add_epi64(
+			_mm512_cvtepi32_epi64(_mm512_castsi512_si256(acc_q)),
+			_mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(acc_q, 1))));
+	}
+	for (; i<n; i++) {
+		sum_i += data[2*i];
+		sum_q += data[2*i+1];
+	}
+	ave_i = (int16_t)(sum_i / (int64_t)(length));
+	ave_q = (int16_t)(sum_q / (int64_t)(length - 1));
+	ave = _mm512_set1_epi32((int32_t)((uint16_t)ave_i | ((uint32_t)(uint16_t)ave_q << 16)));
+	for (i=0; i+16<=n; i+=16) {
+		store(data + 2*i, _mm512_sub_epi16(load(data + 2*i), ave));}
+	for (; i<n; i++) {
+		data[2*i]   -= ave_i;
+		data[2*i+1] -= ave_q;
+	}
+}
+
+static __m256i round8(const int16_t *in)
+{
+	__m512i v = _mm512_adds_epi16(load(in), _mm512_set1_epi16(128));
+	return _mm512_cvtsepi16_epi8(_mm512_srai_epi16(v, 8));
+}
+
+static void cs16_to_cs8_avx512(const int16_t *in, int8_t *out, size_t n)
+{
+	size_t i;
+	for (i=0; i+32<=n; i+=32) {
+		_mm256_storeu_si256((__m256i *)(out + i), round8(in + i));}
+	for (; i<n; i++) {
+		int v = (in[i] + 128) >> 8;
+		out[i] = (int8_t)(v > 127 ? 127 : v);
+	}
+}
+
+static void cs16_to_cu8_avx512(const int16_t *in, uint8_t *out, size_t n)
+{
+	size_t i;
+	const __m256i flip = _mm256_set1_epi8((char)0x80);
+	for (i=0; i+32<=n; i+=32) {
+		_mm256_storeu_si256((__m256i *)(out + i), _mm256_xor_si256(round8(in + i), flip));}
+	for (; i<n; i++) {
+		int v = (in[i] + 128) >> 8;
+		out[i] = (uint8_t)((v > 127 ? 127 : v) + 128);
+	}
+}
+
+static void cs16_to_cf32_avx512(const int16_t *in, float *out, size_t n)
+{
+	size_t i;
+	const __m512 scale = _mm512_set1_ps(1.0f / 32768.0f);
+	__m512i v;
+	for (i=0; i+16<=n; i+=16) {
+		v = _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i *)(in + i)));
+		_mm512_storeu_ps(out + i, _mm512_mul_ps(_mm512_cvtepi32_ps(v), scale));
+	}
+	for (; i<n; i++) {
+		out[i] = (float)in[i] * (1.0f / 32768.0f);}
+}
+
+static void widen8_avx512(const uint8_t *in, int16_t *out, size_t n, uint8_t flip)
+{
+	size_t i;
+	const __m256i f = _mm256_set1_epi8((char)flip);
+	__m256i v;
+	for (i=0; i+32<=n; i+=32) {
+		v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(in + i)), f);
+		store(out + i, _mm512_slli_epi16(_mm512_cvtepi8_epi16(v), 8));
+	}
+	for (; i<n; i++) {
+		out[i] = (int16_t)((int8_t)(in[i] ^ flip) * 256);}
+}
+
+static void cs8_to_cs16_avx512(const int8_t *in, int16_t *out, size_t n)
+{
+	widen8_avx512((const uint8_t *)in, out, n, 0);
+}
+
+static void cu8_to_cs16_avx512(const uint8_t *in, int16_t *out, size_t n)
+{
+	widen8_avx512(in, out, n, 0x80);
+}
+
+static void cf32_to_cs16_avx512(const float *in, int16_t *out, size_t n)
+/* already clamped, so the saturating narrow is a plain one */
+{
+	size_t i;
+	float v;
+	__m512 x;
+	for (i=0; i+16<=n; i+=16) {
+		x = _mm512_mul_ps(_mm512_loadu_ps(in + i), _mm512_set1_ps(32768.0f));
+		x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(-32768.0f)), _mm512_set1_ps(32767.0f));
+		_mm256_storeu_si256((__m256i *)(out + i), _mm512_cvtsepi32_epi16(_mm512_cvtps_epi32(x)));
+	}
+	for (; i<n; i++) {
+		v = in[i] * 32768.0f;
+		if (!(v >= -32768.0f)) {
+			v = -32768.0f;}
+		if (v > 32767.0f) {
+			v = 32767.0f;}
+		out[i] = (int16_t)_mm_cvtss_si32(_mm_set_ss(v));
+	}
+}
+
+static void flip8_avx512(const uint8_t *in, uint8_t *out, size_t n)
+{
+	size_t i;
+	const __m512i f = _mm512_set1_epi8((char)0x80);
+	for (i=0; i+64<=n; i+=64) {
+		store(out + i, _mm512_xor_si512(load(in + i), f));}
+	for (; i<n; i++) {
+		out[i] = in[i] ^ 0x80;}
+}
+
+static void window_cs16_avx512(const int16_t *iq, const float *win, float *out, int len)
+{
+	int j;
+	__m512i v;
+	__m512 w;
+	const __m512i lo = _mm512_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7);
+	const __m512i hi = _mm512_setr_epi32(8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15);
+	for (j=0; j+16<=len; j+=16) {
+		v = load(iq + 2*j);
+		w = _mm512_loadu_ps(win + j);
+		_mm512_storeu_ps(out + 2*j, _mm512_mul_ps(_mm512_cvtepi32_ps(
+			_mm512_cvtepi16_epi32(_mm512_castsi512_si256(v))), _mm512_permutexvar_ps(lo, w)));
+		_mm512_storeu_ps(out + 2*j + 16, _mm512_mul_ps(_mm512_cvtepi32_ps(
+			_mm512_cvtepi16_epi32(_mm512_extracti64x4_epi64(v, 1))), _mm512_permutexvar_ps(hi, w)));
+	}
+	for (; j<len; j++) {
+		out[2*j]   = (float)iq[2*j]   * win[j];
+		out[2*j+1] = (float)iq[2*j+1] * win[j];
+	}
+}
+
+static __m512 cmul(__m512 a, const float *t, int s)
+/* see fft_radix4_scalar() for the twiddle layout */
+{
+	return _mm512_add_ps(_mm512_mul_ps(a, _mm512_loadu_ps(t)),
+		_mm512_mul_ps(_mm512_permute_ps(a, 0xb1), _mm512_loadu_ps(t + 2*s)));
+}
+
+static void fft_radix4_avx512(float *data, const float *tw, int n, int s)
+{
+	int g, j;
+	float *p;
+	/* xor_ps needs AVX512DQ, flip the sign bits as integers */
+	const __m512i neg_im = _mm512_set1_epi64((long long)0x8000000000000000ULL);
+	__m512 a0, a1, a2, a3, A0, A1, S, D;
+	if (s < 8) {
+		fft_radix4_avx2(data, tw, n, s);
+		return;
+	}
+	for (g=0; g<n; g+=4*s) {
+		for (j=0; j<s; j+=8) {
+			p = data + 2*(g + j);
+			a0 = _mm512_loadu_ps(p);
+			a1 = cmul(_mm512_loadu_ps(p + 2*s), tw + 2*j, s);
+			a2 = cmul(_mm512_loadu_ps(p + 4*s), tw + 4*s + 2*j, s);
+			a3 = cmul(_mm512_loadu_ps(p + 6*s), tw + 8*s + 2*j, s);
+			A0 = _mm512_add_ps(a0, a1);
+			A1 = _mm512_sub_ps(a0, a1);
+			S  = _mm512_add_ps(a2, a3);
+			D  = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(
+				_mm512_permute_ps(_mm512_sub_ps(a2, a3), 0xb1)), neg_im));
+			_mm512_storeu_ps(p,       _mm512_add_ps(A0, S));
+			_mm512_storeu_ps(p + 2*s, _mm512_add_ps(A1, D));
+			_mm512_storeu_ps(p + 4*s, _mm512_sub_ps(A0, S));
+			_mm512_storeu_ps(p + 6*s, _mm512_sub_ps(A1, D));
+		}
+	}
+}
+
+static __m512 power16(const float *iq)
+/* |x|^2 of 16 complex samples */
+{
+	const __m512i evens = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+	__m512 a = _mm512_loadu_ps(iq);
+	__m512 b = _mm512_loadu_ps(iq + 16);
+	a = _mm512_mul_ps(a, a);
+	b = _mm512_mul_ps(b, b);
+	a = _mm512_add_ps(a, _mm512_permute_ps(a, 0xb1));
+	b = _mm512_add_ps(b, _mm512_permute_ps(b, 0xb1));
+	return _mm512_permutex2var_ps(a, evens, b);
+}
+
+static __m256 high256(__m512 v)
+{
+	return _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1));
+}
+
+static void power_sum_avx512(const float *iq, double *avg, int len)
+{
+	int j;
+	__m512 p;
+	for (j=0; j+16<=len; j+=16) {
+		p = power16(iq + 2*j);
+		_mm512_storeu_pd(avg + j,     _mm512_add_pd(_mm512_loadu_pd(avg + j),
+			_mm512_cvtps_pd(_mm512_castps512_ps256(p))));
+		_mm512_storeu_pd(avg + j + 8, _mm512_add_pd(_mm512_loadu_pd(avg + j + 8),
+			_mm512_cvtps_pd(high256(p))));
+	}
+	for (; j<len; j++) {
+		avg[j] += (double)(iq[2*j] * iq[2*j] + iq[2*j+1] * iq[2*j+1]);}
+}
+
+static void power_max_avx512(const float *iq, double *avg, int len)
+{
+	int j;
+	double p;
+	__m512 v;
+	for (j=0; j+16<=len; j+=16) {
+		v = power16(iq + 2*j);
+		_mm512_storeu_pd(avg + j,     _mm512_max_pd(_mm512_loadu_pd(avg + j),
+			_mm512_cvtps_pd(_mm512_castps512_ps256(v))));
+		_mm512_storeu_pd(avg + j + 8, _mm512_max_pd(_mm512_loadu_pd(avg + j + 8),
+			_mm512_cvtps_pd(high256(v))));
+	}
+	for (; j<len; j++) {
+		p = (double)(iq[2*j] * iq[2*j] + iq[2*j+1] * iq[2*j+1]);
+		if (p > avg[j]) {
+			avg[j] = p;}
+	}
+}
+
+void dsp_init_avx512(struct dsp_kernels *k)
+{
+	k->name         = "avx512";
+	k->rotate16_90  = rotate16_90_avx512;
+	k->fifth_order  = fifth_order_avx512;
+	k->fifth_decimate = fifth_decimate_avx512;
+	k->split_iq     = split_iq_avx512;
+	k->fir_iq       = fir_iq_avx512;
+	k->fir_short    = fir_short_avx512;
+	k->dot16        = dot16_avx512;
+	k->fm_disc      = fm_disc_avx512;
+	k->remove_dc    = remove_dc_avx512;
+	k->cs16_to_cs8  = cs16_to_cs8_avx512;
+	k->cs16_to_cu8  = cs16_to_cu8_avx512;
+	k->cs16_to_cf32 = cs16_to_cf32_avx512;
+	k->cs8_to_cs16  = cs8_to_cs16_avx512;
+	k->cu8_to_cs16  = cu8_to_cs16_avx512;
+	k->cf32_to_cs16 = cf32_to_cs16_avx512;
+	k->flip8        = flip8_avx512;
+	k->window_cs16  = window_cs16_avx512;
+	k->fft_radix4   = fft_radix4_avx512;
+	k->power_sum    = power_sum_avx512;
+	k->power_max    = power_max_avx512;
+}
+
+// vim: tabstop=8:softtabstop=8:shiftwidth=8:noexpandtab
@@ -0,0 +1,528 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* SSE2 kernels, 4 complex samples per vector, see kernels.c for the reference */
+
+#include "kernels.h"
+#include <string.h>
+#include <emmintrin.h>
+
+static __m128i even32(__m128i a, __m128i b)
+{
+	return _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2,0,2,0)));
+}
+
+static __m128i odd32(__m128i a, __m128i b)
+{
+	return _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(3,1,3,1)));
+}
+
+static __m128i madd_pair(__m128i a, __m128i b, __m128i c, int hi)
+{
+	if (hi) {
+		return _mm_madd_epi16(_mm_unpackhi_epi16(a, b), c);}
+	return _mm_madd_epi16(_mm_unpacklo_epi16(a, b), c);
+}
+
+static void rotate16_90_sse2(const int16_t *in, int16_t *out, uint32_t len)
+{
+	uint32_t i;
+	const __m128i neg = _mm_setr_epi16(0, 0, -1, 0, -1, -1, 0, -1);
+	__m128i v;
+	for (i=0; i+8<=len; i+=8) {
+		v = _mm_loadu_si128((const __m128i *)(in + i));
+		v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2,3,1,0));
+		v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2,3,1,0));
+		v = _mm_sub_epi16(_mm_xor_si128(v, neg), neg);
+		_mm_storeu_si128((__m128i *)(out + i), v);
+	}
+}
+
+static void fifth_body_sse2(const int16_t *in, int16_t *out, int m, int count)
+{
+	const __m128i c15 = _mm_setr_epi16(1, 5, 1, 5, 1, 5, 1, 5);
+	const __m128i c1010 = _mm_set1_epi16(10);
+	const __m128i c51 = _mm_setr_epi16(5, 1, 5, 1, 5, 1, 5, 1);
+	__m128i a, b, t0, t1, t2, t3, t4, t5, lo, hi;
+	const int16_t *p;
+	int end = m + count;
+	for (; m<end; m+=4) {
+		/* input 2m+k for k = -6, -4, -2, 0 split into even and odd samples */
+		p = in + 4*m;
+		a = _mm_loadu_si128((const __m128i *)(p - 12));
+		b = _mm_loadu_si128((const __m128i *)(p - 4));
+		t0 = odd32(a, b);
+		a = _mm_loadu_si128((const __m128i *)(p - 8));
+		b = _mm_loadu_si128((const __m128i *)(p));
+		t1 = even32(a, b);
+		t2 = odd32(a, b);
+		a = _mm_loadu_si128((const __m128i *)(p - 4));
+		b = _mm_loadu_si128((const __m128i *)(p + 4));
+		t3 = even32(a, b);
+		t4 = odd32(a, b);
+		a = _mm_loadu_si128((const __m128i *)(p));
+		b = _mm_loadu_si128((const __m128i *)(p + 8));
+		t5 = even32(a, b);
+		lo = _mm_add_epi32(madd_pair(t0, t1, c15, 0), madd_pair(t2, t3, c1010, 0));
+		lo = _mm_srai_epi32(_mm_add_epi32(lo, madd_pair(t4, t5, c51, 0)), 5);
+		hi = _mm_add_epi32(madd_pair(t0, t1, c15, 1), madd_pair(t2, t3, c1010, 1));
+		hi = _mm_srai_epi32(_mm_add_epi32(hi, madd_pair(t4, t5, c51, 1)), 5);
+		_mm_storeu_si128((__m128i *)(out + 2*m), _mm_packs_epi32(lo, hi));
+	}
+}
+
+static void fifth_order_sse2(int16_t *data, int length, int16_t *hist_i, int16_t *hist_q)
+{
+	fifth_order_run(data, length, hist_i, hist_q, fifth_body_sse2, 4);
+}
+
+static void fifth_decimate_sse2(const int16_t *in, int16_t *out, int n)
+{
+	fifth_decimate_run(in, out, n, fifth_body_sse2, 4);
+}
+
+static void split_iq_sse2(const int16_t *in, int16_t *out_i, int16_t *out_q, int n)
+/* I sign extended from the low half of each 32 bit pair, Q from the high half */
+{
+	__m128i a, b;
+	int k;
+	for (k=0; k+8<=n; k+=8) {
+		a = _mm_loadu_si128((const __m128i *)(in + 2*k));
+		b = _mm_loadu_si128((const __m128i *)(in + 2*k + 8));
+		_mm_storeu_si128((__m128i *)(out_i + k), _mm_packs_epi32(
+			_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16)));
+		_mm_storeu_si128((__m128i *)(out_q + k), _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16)));
+	}
+	for (; k<n; k++) {
+		out_i[k] = in[2*k];
+		out_q[k] = in[2*k+1];
+	}
+}
+
+static __m128i fir_sum(__m128i acc_i, __m128i acc_q)
+/* the lanes of each added up, I in lane 0 and Q in lane 1 */
+{
+	__m128i t = _mm_add_epi32(_mm_unpacklo_epi32(acc_i, acc_q), _mm_unpackhi_epi32(acc_i, acc_q));
+	return _mm_add_epi32(t, _mm_srli_si128(t, 8));
+}
+
+static void fir_iq_sse2(const int16_t *x_i, const int16_t *x_q, int16_t *out, int n, int step,
+	const int16_t *coef, int len, int shift)
+{
+	const __m128i round = _mm_set1_epi32(1 << (shift - 1));
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	__m128i c, acc_i, acc_q, v;
+	int32_t iq;
+	int m, j;
+	for (m=0; m<n; m++) {
+		acc_i = _mm_setzero_si128();
+		acc_q = _mm_setzero_si128();
+		for (j=0; j<len; j+=8) {
+			c = _mm_loadu_si128((const __m128i *)(coef + j));
+			acc_i = _mm_add_epi32(acc_i, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(x_i + j)), c));
+			acc_q = _mm_add_epi32(acc_q, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(x_q + j)), c));
+		}
+		v = _mm_sra_epi32(_mm_add_epi32(fir_sum(acc_i, acc_q), round), count);
+		iq = _mm_cvtsi128_si32(_mm_packs_epi32(v, v));
+		memcpy(out + 2*m, &iq, sizeof(iq));
+		x_i += step;
+		x_q += step;
+	}
+}
+
+static int32_t coef_pair(const int16_t *c)
+/* c[0] in the low half, to pair with the older of two samples */
+{
+	return (int32_t)((uint16_t)c[0] | ((uint32_t)(uint16_t)c[1] << 16));
+}
+
+static __m128i fir_short8(const int16_t *x, const __m128i *c, int len, __m128i round, __m128i count)
+/* outputs 0..7 of one channel, saturated to int16 */
+{
+	__m128i a, b, lo = round, hi = round;
+	int j;
+	for (j=0; j<len; j+=2) {
+		a = _mm_loadu_si128((const __m128i *)(x + j));
+		b = _mm_loadu_si128((const __m128i *)(x + j + 1));
+		lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), c[j/2]));
+		hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), c[j/2]));
+	}
+	return _mm_packs_epi32(_mm_sra_epi32(lo, count), _mm_sra_epi32(hi, count));
+}
+
+static void fir_short_body_sse2(const int16_t *x_i, const int16_t *x_q, int16_t *out, int n,
+	const int16_t *coef, int len, int shift)
+{
+	const __m128i round = _mm_set1_epi32(1 << (shift - 1));
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	__m128i c[FIR_SHORT/2], i, q;
+	int m, j;
+	for (j=0; j<len; j+=2) {
+		c[j/2] = _mm_set1_epi32(coef_pair(coef + j));}
+	for (m=0; m<n; m+=8) {
+		i = fir_short8(x_i + m, c, len, round, count);
+		q = fir_short8(x_q + m, c, len, round, count);
+		_mm_storeu_si128((__m128i *)(out + 2*m), _mm_unpacklo_epi16(i, q));
+		_mm_storeu_si128((__m128i *)(out + 2*m + 8), _mm_unpackhi_epi16(i, q));
+	}
+}
+
+static void fir_short_sse2(const int16_t *x_i, const int16_t *x_q, int16_t *out, int n,
+	const int16_t *coef, int len, int shift)
+{
+	fir_short_run(x_i, x_q, out, n, coef, len, shift, fir_short_body_sse2, 8);
+}
+
+static int32_t dot16_sse2(const int16_t *x, const int16_t *coef, int len)
+{
+	__m128i acc = _mm_setzero_si128();
+	int j;
+	for (j=0; j<len; j+=8) {
+		acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(x + j)),
+			_mm_loadu_si128((const __m128i *)(coef + j))));}
+	acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 8));
+	acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 4));
+	return _mm_cvtsi128_si32(acc);
+}
+
+static void fm_disc_body_sse2(const int16_t *iq, int16_t *out, int m, int count)
+/* the same steps as fm_disc_one() in kernels.c, 4 samples at a time */
+{
+	const __m128 sign = _mm_set1_ps(-0.0f), one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+	__m128i a, b, v;
+	__m128 ar, aj, br, bj, cr, cj, ax, ay, x, s, r, t;
+	int k;
+	for (k=m; k<m+count; k+=4) {
+		a = _mm_loadu_si128((const __m128i *)(iq + 2*k));
+		b = _mm_loadu_si128((const __m128i *)(iq + 2*k - 2));
+		ar = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16));
+		aj = _mm_cvtepi32_ps(_mm_srai_epi32(a, 16));
+		br = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+		bj = _mm_cvtepi32_ps(_mm_srai_epi32(b, 16));
+		cr = _mm_add_ps(_mm_mul_ps(ar, br), _mm_mul_ps(aj, bj));
+		cj = _mm_sub_ps(_mm_mul_ps(aj, br), _mm_mul_ps(ar, bj));
+		ax = _mm_andnot_ps(sign, cr);
+		ay = _mm_andnot_ps(sign, cj);
+		x = _mm_div_ps(_mm_min_ps(ax, ay), _mm_max_ps(_mm_max_ps(ax, ay), one));
+		s = _mm_mul_ps(x, x);
+		r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ATAN_P9), s), _mm_set1_ps(ATAN_P7));
+		r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_P5));
+		r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_P3));
+		r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_P1));
+		r = _mm_mul_ps(x, r);
+		t = _mm_cmpgt_ps(ay, ax);
+		r = _mm_or_ps(_mm_and_ps(t, _mm_sub_ps(_mm_set1_ps(ATAN_PI_2), r)), _mm_andnot_ps(t, r));
+		t = _mm_cmplt_ps(cr, zero);
+		r = _mm_or_ps(_mm_and_ps(t, _mm_sub_ps(_mm_set1_ps(ATAN_PI), r)), _mm_andnot_ps(t, r));
+		r = _mm_xor_ps(r, _mm_and_ps(_mm_cmplt_ps(cj, zero), sign));
+		v = _mm_cvttps_epi32(_mm_mul_ps(r, _mm_set1_ps(ATAN_SCALE)));
+		_mm_storel_epi64((__m128i *)(out + k), _mm_packs_epi32(v, v));
+	}
+}
+
+static void fm_disc_sse2(const int16_t *iq, int16_t *out, int n, int pre_r, int pre_j)
+{
+	fm_disc_run(iq, out, n, pre_r, pre_j, fm_disc_body_sse2, 4);
+}
+
+static void remove_dc_sse2(int16_t *data, int length)
+{
+	int i, j, n = length / 2;
+	int32_t lanes[4];
+	int64_t sum_i = 0, sum_q = 0;
+	int16_t ave_i, ave_q;
+	__m128i v, acc_i, acc_q, ave;
+	/* flush the 32 bit lanes before they could overflow */
+	for (i=0; i+4<=n; ) {
+		acc_i = _mm_setzero_si128();
+		acc_q = _mm_setzero_si128();
+		for (j=0; j<32768 && i+4<=n; j++, i+=4) {
+			v = _mm_loadu_si128((__m128i *)(data + 2*i));
+			acc_i = _mm_add_epi32(acc_i, _mm_srai_epi32(_mm_slli_epi32(v, 16), 16));
+			acc_q = _mm_add_epi32(acc_q, _mm_srai_epi32(v, 16));
+		}
+		_mm_storeu_si128((__m128i *)lanes, acc_i);
+		sum_i += (int64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+		_mm_storeu_si128((__m128i *)lanes, acc_q);
+		sum_q += (int64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+	for (; i<n; i++) {
+		sum_i += data[2*i];
+		sum_q += data[2*i+1];
+	}
+	ave_i = (int16_t)(sum_i / (int64_t)(length));
+	ave_q = (int16_t)(sum_q / (int64_t)(length - 1));
+	ave = _mm_set1_epi32((int32_t)((uint16_t)ave_i | ((uint32_t)(uint16_t)ave_q << 16)));
+	for (i=0; i+4<=n; i+=4) {
+		v = _mm_loadu_si128((__m128i *)(data + 2*i));
+		_mm_storeu_si128((__m128i *)(data + 2*i), _mm_sub_epi16(v, ave));
+	}
+	for (; i<n; i++) {
+		data[2*i]   -= ave_i;
+		data[2*i+1] -= ave_q;
+	}
+}
+
+static __m128i round8(__m128i v)
+{
+	return _mm_srai_epi16(_mm_adds_epi16(v, _mm_set1_epi16(128)), 8);
+}
+
+static void cs16_to_cs8_sse2(const int16_t *in, int8_t *out, size_t n)
+{
+	size_t i;
+	__m128i a, b;
+	for (i=0; i+16<=n; i+=16) {
+		a = round8(_mm_loadu_si128((__m128i *)(in + i)));
+		b = round8(_mm_loadu_si128((__m128i *)(in + i + 8)));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi16(a, b));
+	}
+	for (; i<n; i++) {
+		int v = (in[i] + 128) >> 8;
+		out[i] = (int8_t)(v > 127 ? 127 : v);
+	}
+}
+
+static void cs16_to_cu8_sse2(const int16_t *in, uint8_t *out, size_t n)
+{
+	size_t i;
+	const __m128i flip = _mm_set1_epi8((char)0x80);
+	__m128i a, b;
+	for (i=0; i+16<=n; i+=16) {
+		a = round8(_mm_loadu_si128((__m128i *)(in + i)));
+		b = round8(_mm_loadu_si128((__m128i *)(in + i + 8)));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_xor_si128(_mm_packs_epi16(a, b), flip));
+	}
+	for (; i<n; i++) {
+		int v = (in[i] + 128) >> 8;
+		out[i] = (uint8_t)((v > 127 ? 127 : v) + 128);
+	}
+}
+
+static void cs16_to_cf32_sse2(const int16_t *in, float *out, size_t n)
+{
+	size_t i;
+	const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+	__m128i v, lo, hi;
+	for (i=0; i+8<=n; i+=8) {
+		v = _mm_loadu_si128((__m128i *)(in + i));
+		lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		_mm_storeu_ps(out + i,     _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+	for (; i<n; i++) {
+		out[i] = (float)in[i] * (1.0f / 32768.0f);}
+}
+
+static void widen8_sse2(const uint8_t *in, int16_t *out, size_t n, uint8_t flip)
+/* the byte lands in the high half of each word, which is the multiply by 256 */
+{
+	size_t i;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i f = _mm_set1_epi8((char)flip);
+	__m128i v;
+	for (i=0; i+16<=n; i+=16) {
+		v = _mm_xor_si128(_mm_loadu_si128((__m128i *)(in + i)), f);
+		_mm_storeu_si128((__m128i *)(out + i),     _mm_unpacklo_epi8(zero, v));
+		_mm_storeu_si128((__m128i *)(out + i + 8), _mm_unpackhi_epi8(zero, v));
+	}
+	for (; i<n; i++) {
+		out[i] = (int16_t)((int8_t)(in[i] ^ flip) * 256);}
+}
+
+static void cs8_to_cs16_sse2(const int8_t *in, int16_t *out, size_t n)
+{
+	widen8_sse2((const uint8_t *)in, out, n, 0);
+}
+
+static void cu8_to_cs16_sse2(const uint8_t *in, int16_t *out, size_t n)
+{
+	widen8_sse2(in, out, n, 0x80);
+}
+
+static __m128i round16(const float *in)
+/* max returns the second operand for NaN, so NaN clamps to -32768 */
+{
+	__m128 v = _mm_mul_ps(_mm_loadu_ps(in), _mm_set1_ps(32768.0f));
+	v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-32768.0f)), _mm_set1_ps(32767.0f));
+	return _mm_cvtps_epi32(v);
+}
+
+static void cf32_to_cs16_sse2(const float *in, int16_t *out, size_t n)
+{
+	size_t i;
+	float v;
+	for (i=0; i+8<=n; i+=8) {
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(round16(in + i), round16(in + i + 4)));}
+	for (; i<n; i++) {
+		v = in[i] * 32768.0f;
+		if (!(v >= -32768.0f)) {
+			v = -32768.0f;}
+		if (v > 32767.0f) {
+			v = 32767.0f;}
+		out[i] = (int16_t)_mm_cvtss_si32(_mm_set_ss(v));
+	}
+}
+
+static void flip8_sse2(const uint8_t *in, uint8_t *out, size_t n)
+{
+	size_t i;
+	const __m128i f = _mm_set1_epi8((char)0x80);
+	for (i=0; i+16<=n; i+=16) {
+		_mm_storeu_si128((__m128i *)(out + i), _mm_xor_si128(_mm_loadu_si128((__m128i *)(in + i)), f));}
+	for (; i<n; i++) {
+		out[i] = in[i] ^ 0x80;}
+}
+
+static void window_cs16_sse2(const int16_t *iq, const float *win, float *out, int len)
+{
+	int j;
+	__m128i v;
+	__m128 w;
+	for (j=0; j+4<=len; j+=4) {
+		v = _mm_loadu_si128((__m128i *)(iq + 2*j));
+		w = _mm_loadu_ps(win + j);
+		_mm_storeu_ps(out + 2*j, _mm_mul_ps(_mm_cvtepi32_ps(
+			_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)), _mm_unpacklo_ps(w, w)));
+		_mm_storeu_ps(out + 2*j + 4, _mm_mul_ps(_mm_cvtepi32_ps(
+			_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)), _mm_unpackhi_ps(w, w)));
+	}
+	for (; j<len; j++) {
+		out[2*j]   = (float)iq[2*j]   * win[j];
+		out[2*j+1] = (float)iq[2*j+1] * win[j];
+	}
+}
+
+static __m128 swap_ri(__m128 a)
+{
+	return _mm_shuffle_ps(a, a, _MM_SHUFFLE(2,3,0,1));
+}
+
+static __m128 cmul(__m128 a, const float *t, int s)
+/* see fft_radix4_scalar() for the twiddle layout */
+{
+	return _mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(t)), _mm_mul_ps(swap_ri(a), _mm_loadu_ps(t + 2*s)));
+}
+
+void fft_radix4_sse2(float *data, const float *tw, int n, int s)
+{
+	int g, j;
+	float *p;
+	const __m128 neg_im = _mm_castsi128_ps(_mm_setr_epi32(0, (int)0x80000000, 0, (int)0x80000000));
+	__m128 a0, a1, a2, a3, A0, A1, S, D;
+	if (s == 1) {
+		/* one group of 4 per pair of vectors, no twiddles */
+		for (g=0; g<n; g+=4) {
+			p = data + 2*g;
+			a0 = _mm_loadu_ps(p);
+			a1 = _mm_loadu_ps(p + 4);
+			A0 = _mm_add_ps(_mm_movelh_ps(a0, a1), _mm_movehl_ps(a1, a0));
+			A1 = _mm_sub_ps(_mm_movelh_ps(a0, a1), _mm_movehl_ps(a1, a0));
+			D = _mm_xor_ps(swap_ri(A1), _mm_setr_ps(0.0f, 0.0f, 0.0f, -0.0f));
+			S = _mm_movehl_ps(D, A0);
+			A0 = _mm_movelh_ps(A0, A1);
+			_mm_storeu_ps(p,     _mm_add_ps(A0, S));
+			_mm_storeu_ps(p + 4, _mm_sub_ps(A0, S));
+		}
+		return;
+	}
+	for (g=0; g<n; g+=4*s) {
+		for (j=0; j<s; j+=2) {
+			p = data + 2*(g + j);
+			a0 = _mm_loadu_ps(p);
+			a1 = cmul(_mm_loadu_ps(p + 2*s), tw + 2*j, s);
+			a2 = cmul(_mm_loadu_ps(p + 4*s), tw + 4*s + 2*j, s);
+			a3 = cmul(_mm_loadu_ps(p + 6*s), tw + 8*s + 2*j, s);
+			A0 = _mm_add_ps(a0, a1);
+			A1 = _mm_sub_ps(a0, a1);
+			S  = _mm_add_ps(a2, a3);
+			D  = _mm_xor_ps(swap_ri(_mm_sub_ps(a2, a3)), neg_im);
+			_mm_storeu_ps(p,       _mm_add_ps(A0, S));
+			_mm_storeu_ps(p + 2*s, _mm_add_ps(A1, D));
+			_mm_storeu_ps(p + 4*s, _mm_sub_ps(A0, S));
+			_mm_storeu_ps(p + 6*s, _mm_sub_ps(A1, D));
+		}
+	}
+}
+
+static __m128 power4(const float *iq)
+/* |x|^2 of 4 complex samples */
+{
+	__m128 a = _mm_loadu_ps(iq);
+	__m128 b = _mm_loadu_ps(iq + 4);
+	a = _mm_mul_ps(a, a);
+	b = _mm_mul_ps(b, b);
+	a = _mm_add_ps(a, swap_ri(a));
+	b = _mm_add_ps(b, swap_ri(b));
+	return _mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0));
+}
+
+static void power_sum_sse2(const float *iq, double *avg, int len)
+{
+	int j;
+	__m128 p;
+	for (j=0; j+4<=len; j+=4) {
+		p = power4(iq + 2*j);
+		_mm_storeu_pd(avg + j,     _mm_add_pd(_mm_loadu_pd(avg + j),     _mm_cvtps_pd(p)));
+		_mm_storeu_pd(avg + j + 2, _mm_add_pd(_mm_loadu_pd(avg + j + 2), _mm_cvtps_pd(_mm_movehl_ps(p, p))));
+	}
+	for (; j<len; j++) {
+		avg[j] += (double)(iq[2*j] * iq[2*j] + iq[2*j+1] * iq[2*j+1]);}
+}
+
+static void power_max_sse2(const float *iq, double *avg, int len)
+{
+	int j;
+	double p;
+	__m128 v;
+	for (j=0; j+4<=len; j+=4) {
+		v = power4(iq + 2*j);
+		_mm_storeu_pd(avg + j,     _mm_max_pd(_mm_loadu_pd(avg + j),     _mm_cvtps_pd(v)));
+		_mm_storeu_pd(avg + j + 2, _mm_max_pd(_mm_loadu_pd(avg + j + 2), _mm_cvtps_pd(_mm_movehl_ps(v, v))));
+	}
+	for (; j<len; j++) {
+		p = (double)(iq[2*j] * iq[2*j] + iq[2*j+1] * iq[2*j+1]);
+		if (p > avg[j]) {
+			avg[j] = p;}
+	}
+}
+
+void dsp_init_sse2(struct dsp_kernels *k)
+{
+	k->name         = "sse2";
+	k->rotate16_90  = rotate16_90_sse2;
+	k->fifth_order  = fifth_order_sse2;
+	k->fifth_decimate = fifth_decimate_sse2;
+	k->split_iq     = split_iq_sse2;
+	k->fir_iq       = fir_iq_sse2;
+	k->fir_short    = fir_short_sse2;
+	k->dot16        = dot16_sse2;
+	k->fm_disc      = fm_disc_sse2;
+	k->remove_dc    = remove_dc_sse2;
+	k->cs16_to_cs8  = cs16_to_cs8_sse2;
+	k->cs16_to_cu8  = cs16_to_cu8_sse2;
+	k->cs16_to_cf32 = cs16_to_cf32_sse2;
+	k->cs8_to_cs16  = cs8_to_cs16_sse2;
+	k->cu8_to_cs16  = cu8_to_cs16_sse2;
+	k->cf32_to_cs16 = cf32_to_cs16_sse2;
+	k->flip8        = flip8_sse2;
+	k->window_cs16  = window_cs16_sse2;
+	k->fft_radix4   = fft_radix4_sse2;
+	k->power_sum    = power_sum_sse2;
+	k->power_max    = power_max_sse2;
+}
+
+// vim: tabstop=8:softtabstop=8:shiftwidth=8:noexpandtab
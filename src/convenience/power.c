@@ -0,0 +1,95 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* integration and CSV output of rx_power */
+
+#include "power.h"
+#include <math.h>
+
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+void rms_power(struct tuning_state *ts, int peak_hold)
+/* for bins between 1MHz and 2MHz */
+{
+	int i, s;
+	int16_t *buf = ts->buf16;
+	int buf_len = ts->buf_len;
+	int64_t p, t;
+	double dc, err;
+
+	p = t = 0L;
+	for (i=0; i<buf_len; i++) {
+		s = (int)buf[i];
+		t += (int64_t)s;
+		p += (int64_t)s * (int64_t)s;
+	}
+	/* correct for dc offset in squares */
+	dc = (double)t / (double)buf_len;
+	err = t * 2 * dc - dc * dc * buf_len;
+	p -= (int64_t)round(err);
+
+	if (!peak_hold) {
+		ts->avg[0] += (double)p;
+	} else {
+		ts->avg[0] = MAX(ts->avg[0], (double)p);
+	}
+	ts->samples += 1;
+}
+
+void csv_dbm(FILE *file, struct tuning_state *ts)
+{
+	int i, len, ds, i1, i2, bw2, bin_count;
+	double tmp;
+	double dbm;
+	len = 1 << ts->bin_e;
+	ds = ts->downsample;
+	/* fix FFT stuff quirks */
+	if (ts->bin_e > 0) {
+		/* nuke DC component (not effective for all windows) */
+		ts->avg[0] = ts->avg[1];
+		/* FFT is translated by 180 degrees */
+		for (i=0; i<len/2; i++) {
+			tmp = ts->avg[i];
+			ts->avg[i] = ts->avg[i+len/2];
+			ts->avg[i+len/2] = tmp;
+		}
+	}
+	/* Hz low, Hz high, Hz step, samples, dbm, dbm, ... */
+	bin_count = (int)((double)len * (1.0 - ts->crop));
+	bw2 = (int)(((double)ts->rate * (double)bin_count) / (len * 2 * ds));
+	fprintf(file, "%lli, %lli, %.2f, %i, ", (long long)ts->freq - bw2, (long long)ts->freq + bw2,
+		(double)ts->rate / (double)(len*ds), ts->samples);
+	// something seems off with the dbm math
+	i1 = 0 + (int)((double)len * ts->crop * 0.5);
+	i2 = (len-1) - (int)((double)len * ts->crop * 0.5);
+	for (i=i1; i<=i2; i++) {
+		dbm  = (double)ts->avg[i];
+		dbm /= (double)ts->rate;
+		dbm /= (double)ts->samples;
+		dbm  = 10 * log10(dbm);
+		fprintf(file, "%.2f, ", dbm);
+	}
+	dbm = (double)ts->avg[i2] / ((double)ts->rate * (double)ts->samples);
+	if (ts->bin_e == 0) {
+		dbm = ((double)ts->avg[0] / \
+		((double)ts->rate * (double)ts->samples));}
+	dbm  = 10 * log10(dbm);
+	fprintf(file, "%.2f\n", dbm);
+	for (i=0; i<len; i++) {
+		ts->avg[i] = 0.0;
+	}
+	ts->samples = 0;
+}
+
+// vim: tabstop=8:softtabstop=8:shiftwidth=8:noexpandtab
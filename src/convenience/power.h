@@ -0,0 +1,62 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __POWER_H
+#define __POWER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* rx_power's per hop integration and its CSV lines */
+
+struct tuning_state
+/* one per tuning range */
+{
+	int64_t freq;
+	int rate;
+	int bin_e;
+	double *avg;  /* length == 2^bin_e */
+	int samples;
+	int downsample;
+	int downsample_passes;  /* for the recursive filter */
+	double crop;
+	//pthread_rwlock_t avg_lock;
+	//pthread_mutex_t avg_mutex;
+	/* having the iq buffer here is wasteful, but will avoid contention */
+	int16_t *buf16;
+	int buf_len;
+	int busy;  /* buf16 is queued for an FFT worker, under jobs_m */
+	int settle_usec;  /* from the settle table, -1 for -S */
+	//int *comp_fir;
+	//pthread_rwlock_t buf_lock;
+	//pthread_mutex_t buf_mutex;
+};
+
+/*!
+ * Integrate the power of buf16 into avg[0], for bins of a whole hop
+ *
+ * \param ts hop with a full buffer
+ * \param peak_hold keep the maximum instead of the sum
+ */
+void rms_power(struct tuning_state *ts, int peak_hold);
+
+/*!
+ * Write one CSV line of the averaged bins and start over
+ *
+ * \param file output
+ * \param ts hop, avg[] and samples are reset
+ */
+void csv_dbm(FILE *file, struct tuning_state *ts);
+
+#endif /*__POWER_H*/
@@ -0,0 +1,179 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* single producer, single consumer ring of fixed size slots */
+
+#include "ring.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+/* interlocked operations are full barriers */
+#define ring_load(p)		((unsigned)InterlockedCompareExchange((volatile LONG *)(p), 0, 0))
+#define ring_store(p, v)	InterlockedExchange((volatile LONG *)(p), (LONG)(v))
+#else
+/* seq_cst so that the waiting flag and head form a proper store/load pair */
+#define ring_load(p)		__atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define ring_store(p, v)	__atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#endif
+
+/* head and tail run modulo 2*depth so that full and empty differ and a
+ * wrap never moves a slot, whatever the depth */
+static unsigned ring_next(struct ring_buffer *r, unsigned c)
+{
+	c++;
+	return c == 2 * r->depth ? 0 : c;
+}
+
+static unsigned ring_used(struct ring_buffer *r, unsigned head, unsigned tail)
+{
+	return head >= tail ? head - tail : head + 2 * r->depth - tail;
+}
+
+static size_t ring_index(struct ring_buffer *r, unsigned c)
+{
+	return c < r->depth ? c : c - r->depth;
+}
+
+int ring_init(struct ring_buffer *r, unsigned depth, size_t slot_size)
+{
+	memset(r, 0, sizeof(*r));
+	if (depth < 1) {
+		depth = 1;}
+	if (depth > UINT_MAX / 2) {
+		return -1;}
+	r->data = malloc(depth * slot_size);
+	r->lens = calloc(depth, sizeof(size_t));
+	if (!r->data || !r->lens) {
+		free(r->data);
+		free(r->lens);
+		return -1;
+	}
+	r->slot_size = slot_size;
+	r->depth = depth;
+	pthread_mutex_init(&r->m, NULL);
+	pthread_cond_init(&r->ready, NULL);
+	return 0;
+}
+
+void ring_free(struct ring_buffer *r)
+{
+	pthread_mutex_destroy(&r->m);
+	pthread_cond_destroy(&r->ready);
+	free(r->data);
+	free(r->lens);
+	r->data = NULL;
+	r->lens = NULL;
+}
+
+void *ring_write_slot(struct ring_buffer *r)
+{
+	unsigned used = ring_used(r, r->head, ring_load(&r->tail));
+	if (used >= r->depth) {
+		r->overruns++;
+		return NULL;
+	}
+	return r->data + ring_index(r, r->head) * r->slot_size;
+}
+
+void ring_write_commit(struct ring_buffer *r, size_t len)
+{
+	unsigned used;
+	r->lens[ring_index(r, r->head)] = len;
+	ring_store(&r->head, ring_next(r, r->head));
+	used = ring_used(r, r->head, ring_load(&r->tail));
+	if (used > r->high_water) {
+		ring_store(&r->high_water, used);}
+	if (ring_load(&r->waiting)) {
+		pthread_mutex_lock(&r->m);
+		pthread_cond_signal(&r->ready);
+		pthread_mutex_unlock(&r->m);
+	}
+}
+
+void *ring_read_slot(struct ring_buffer *r, size_t *len)
+{
+	size_t i;
+	if (ring_load(&r->head) == r->tail) {
+		return NULL;}
+	i = ring_index(r, r->tail);
+	if (len) {
+		*len = r->lens[i];}
+	return r->data + i * r->slot_size;
+}
+
+void ring_read_release(struct ring_buffer *r)
+{
+	ring_store(&r->tail, ring_next(r, r->tail));
+}
+
+void ring_wait(struct ring_buffer *r)
+{
+	pthread_mutex_lock(&r->m);
+	ring_store(&r->waiting, 1);
+	if (ring_load(&r->head) == r->tail && !r->closed) {
+		pthread_cond_wait(&r->ready, &r->m);}
+	ring_store(&r->waiting, 0);
+	pthread_mutex_unlock(&r->m);
+}
+
+void ring_close(struct ring_buffer *r)
+{
+	pthread_mutex_lock(&r->m);
+	ring_store(&r->closed, 1);
+	pthread_cond_broadcast(&r->ready);
+	pthread_mutex_unlock(&r->m);
+}
+
+int ring_push(struct ring_buffer *r, void *ptr)
+{
+	void **slot = ring_write_slot(r);
+	if (!slot) {
+		return -1;}
+	*slot = ptr;
+	ring_write_commit(r, 1);
+	return 0;
+}
+
+void *ring_pop(struct ring_buffer *r)
+{
+	void *ptr;
+	void **slot = ring_read_slot(r, NULL);
+	if (!slot) {
+		return NULL;}
+	ptr = *slot;
+	ring_read_release(r);
+	return ptr;
+}
+
+int ring_closed(struct ring_buffer *r)
+{
+	return ring_load(&r->closed) != 0;
+}
+
+unsigned ring_high_water(struct ring_buffer *r)
+{
+	return ring_load(&r->high_water);
+}
+
+unsigned ring_count(struct ring_buffer *r)
+{
+	unsigned tail = ring_load(&r->tail);
+	return ring_used(r, ring_load(&r->head), tail);
+}
+
+// vim: tabstop=8:softtabstop=8:shiftwidth=8:noexpandtab
@@ -0,0 +1,151 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __RING_H
+#define __RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * Bounded single-producer/single-consumer ring of pre-allocated slots.
+ *
+ * The data path is lock-free: the producer only ever touches head and
+ * the consumer only ever touches tail.  The mutex/cond pair is used
+ * solely to park the consumer when the ring runs dry, and the producer
+ * only takes it when the consumer is actually parked.
+ */
+
+struct ring_buffer
+{
+	uint8_t *data;
+	size_t  *lens;
+	size_t   slot_size;
+	unsigned depth;
+	unsigned head;       /* write position mod 2*depth, producer owned */
+	unsigned tail;       /* read position mod 2*depth, consumer owned */
+	int      waiting;
+	int      closed;
+	unsigned overruns;   /* slots dropped because the ring was full */
+	unsigned high_water; /* maximum number of slots in use */
+	pthread_mutex_t m;
+	pthread_cond_t  ready;
+};
+
+/*!
+ * Allocate the ring and all of its slots
+ *
+ * \param r the ring
+ * \param depth number of slots
+ * \param slot_size size of each slot in bytes
+ * \return 0 on success
+ */
+int ring_init(struct ring_buffer *r, unsigned depth, size_t slot_size);
+
+/*!
+ * Release the slots, the ring must no longer be in use
+ *
+ * \param r the ring
+ */
+void ring_free(struct ring_buffer *r);
+
+/*!
+ * Get the next free slot for the producer, never blocks
+ *
+ * \param r the ring
+ * \return slot to fill, or NULL (and an overrun is counted) when full
+ */
+void *ring_write_slot(struct ring_buffer *r);
+
+/*!
+ * Publish the slot obtained from ring_write_slot() to the consumer
+ *
+ * \param r the ring
+ * \param len caller defined fill level of the slot
+ */
+void ring_write_commit(struct ring_buffer *r, size_t len);
+
+/*!
+ * Get the oldest filled slot for the consumer, never blocks
+ *
+ * \param r the ring
+ * \param len fill level passed to ring_write_commit(), may be NULL
+ * \return slot to process, or NULL when empty
+ */
+void *ring_read_slot(struct ring_buffer *r, size_t *len);
+
+/*!
+ * Hand the slot obtained from ring_read_slot() back to the producer
+ *
+ * \param r the ring
+ */
+void ring_read_release(struct ring_buffer *r);
+
+/*!
+ * Block the consumer until a slot is available or the ring is closed
+ *
+ * \param r the ring
+ */
+void ring_wait(struct ring_buffer *r);
+
+/*!
+ * Wake up the consumer for good, used on shutdown
+ *
+ * \param r the ring
+ */
+void ring_close(struct ring_buffer *r);
+
+/*!
+ * Queue a pointer on a ring created with slot_size sizeof(void *)
+ *
+ * \param r the ring
+ * \param ptr pointer to pass along
+ * \return 0 on success, -1 (and an overrun is counted) when full
+ */
+int ring_push(struct ring_buffer *r, void *ptr);
+
+/*!
+ * Dequeue a pointer from a ring created with slot_size sizeof(void *)
+ *
+ * \param r the ring
+ * \return oldest pointer, or NULL when empty
+ */
+void *ring_pop(struct ring_buffer *r);
+
+/*!
+ * Check whether ring_close() has been called, safe from any thread
+ *
+ * \param r the ring
+ * \return 1 when closed
+ */
+int ring_closed(struct ring_buffer *r);
+
+/*!
+ * Number of slots currently filled
+ *
+ * \param r the ring
+ * \return slots in use
+ */
+unsigned ring_count(struct ring_buffer *r);
+
+/*!
+ * Most slots ever in use at once, safe from any thread
+ *
+ * \param r the ring
+ * \return high water mark
+ */
+unsigned ring_high_water(struct ring_buffer *r);
+
+#endif /*__RING_H*/
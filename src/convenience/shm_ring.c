@@ -0,0 +1,320 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* single producer, many consumer broadcast ring in shared memory */
+
+#include "shm_ring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define SHM_RING_MAGIC		0x51495852  /* "RXIQ" */
+#define SHM_RING_VERSION	1
+#define SHM_RING_HEADER_SIZE	4096
+#define SHM_RING_POLL_USEC	500
+
+struct shm_ring_header
+{
+	uint32_t magic;       /* stored last, once the rest is valid */
+	uint32_t version;
+	char format[16];
+	uint32_t elem_size;
+	uint32_t slot_count;
+	uint32_t slot_elems;
+	uint32_t slot_size;   /* bytes, slot header included */
+	double rate;
+	double freq;
+	uint64_t head;        /* blocks published */
+	uint32_t closed;
+};
+
+struct shm_slot
+{
+	uint64_t seq;         /* block number + 1, 0 while it is rewritten */
+	int64_t time_ns;
+	uint32_t elems;
+	int32_t flags;
+	uint8_t pad[40];      /* keeps the samples cache line aligned */
+};
+
+#define load_acquire(p)		__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define store_release(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static struct shm_slot *slot_at(struct shm_ring *r, uint64_t seq)
+{
+	return (struct shm_slot *)(r->slots + (size_t)(seq % r->hdr->slot_count) * r->hdr->slot_size);
+}
+
+#ifndef _WIN32
+
+static int shm_path(char *path, size_t len, const char *name)
+{
+	if (!name[0] || strchr(name, '/') || strlen(name) + 2 > len) {
+		fprintf(stderr, "Invalid shared memory name '%s'.\n", name);
+		return -1;
+	}
+	snprintf(path, len, "/%s", name);
+	return 0;
+}
+
+int shm_ring_create(struct shm_ring *r, const char *name, const char *format, size_t elem_size,
+	double rate, double freq, unsigned size_mb)
+{
+	int fd;
+	void *map;
+	size_t slot_size, count;
+	struct shm_ring_header *h;
+	memset(r, 0, sizeof(*r));
+	if (shm_path(r->name, sizeof(r->name), name) != 0) {
+		return -1;}
+	slot_size = sizeof(struct shm_slot) + SHM_RING_SLOT_ELEMS * elem_size;
+	slot_size = (slot_size + 63) & ~(size_t)63;
+	count = ((size_t)size_mb << 20) / slot_size;
+	if (count < 4) {
+		count = 4;}
+	/* a stale ring from a crashed producer is simply replaced */
+	shm_unlink(r->name);
+	fd = shm_open(r->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+		perror("shm_open");
+		return -1;
+	}
+	r->map_size = SHM_RING_HEADER_SIZE + count * slot_size;
+	if (ftruncate(fd, (off_t)r->map_size) != 0) {
+		perror("ftruncate");
+		close(fd);
+		shm_unlink(r->name);
+		return -1;
+	}
+	map = mmap(NULL, r->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		shm_unlink(r->name);
+		return -1;
+	}
+	h = map;
+	r->hdr = h;
+	r->slots = (uint8_t *)map + SHM_RING_HEADER_SIZE;
+	r->producer = 1;
+	h->version = SHM_RING_VERSION;
+	snprintf(h->format, sizeof(h->format), "%s", format);
+	h->elem_size = (uint32_t)elem_size;
+	h->slot_count = (uint32_t)count;
+	h->slot_elems = SHM_RING_SLOT_ELEMS;
+	h->slot_size = (uint32_t)slot_size;
+	h->rate = rate;
+	h->freq = freq;
+	store_release(&h->magic, SHM_RING_MAGIC);
+	return 0;
+}
+
+void shm_ring_publish(struct shm_ring *r, const void *buf, size_t elems, int flags, long long time_ns)
+{
+	struct shm_ring_header *h = r->hdr;
+	struct shm_slot *slot;
+	const uint8_t *in = buf;
+	uint64_t seq;
+	size_t n, done = 0;
+	while (done < elems) {
+		n = elems - done;
+		if (n > h->slot_elems) {
+			n = h->slot_elems;}
+		seq = h->head;
+		slot = slot_at(r, seq);
+		/* readers still in this slot notice the change of seq */
+		__atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		memcpy((uint8_t *)slot + sizeof(struct shm_slot), in + done * h->elem_size, n * h->elem_size);
+		slot->elems = (uint32_t)n;
+		slot->flags = flags;
+		slot->time_ns = time_ns + (long long)((double)done * 1e9 / h->rate);
+		store_release(&slot->seq, seq + 1);
+		store_release(&h->head, seq + 1);
+		done += n;
+	}
+}
+
+int shm_ring_attach(struct shm_ring *r, const char *name)
+{
+	int fd;
+	void *map;
+	struct stat st;
+	struct shm_ring_header *h;
+	memset(r, 0, sizeof(*r));
+	if (shm_path(r->name, sizeof(r->name), name) != 0) {
+		return -1;}
+	fd = shm_open(r->name, O_RDONLY, 0);
+	if (fd < 0) {
+		fprintf(stderr, "No IQ broadcast named '%s' (start rx_sdr -P %s first).\n", name, name);
+		return -1;
+	}
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < SHM_RING_HEADER_SIZE) {
+		fprintf(stderr, "IQ broadcast '%s' is not ready.\n", name);
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+	h = map;
+	r->hdr = h;
+	r->map_size = (size_t)st.st_size;
+	r->slots = (uint8_t *)map + SHM_RING_HEADER_SIZE;
+	if (load_acquire(&h->magic) != SHM_RING_MAGIC || h->version != SHM_RING_VERSION ||
+	    SHM_RING_HEADER_SIZE + (size_t)h->slot_count * h->slot_size > r->map_size) {
+		fprintf(stderr, "IQ broadcast '%s' is not ready or of another version.\n", name);
+		munmap(map, r->map_size);
+		r->hdr = NULL;
+		return -1;
+	}
+	/* live, whatever is in the ring already is history */
+	r->cursor = load_acquire(&h->head);
+	return 0;
+}
+
+int shm_ring_acquire(struct shm_ring *r, const void **buf, int *flags, long long *time_ns, long timeout_us)
+{
+	struct shm_ring_header *h = r->hdr;
+	struct shm_slot *slot;
+	uint64_t head;
+	long waited = 0;
+	struct timespec pause = {0, SHM_RING_POLL_USEC * 1000};
+	while (1) {
+		head = load_acquire(&h->head);
+		if (r->cursor < head) {
+			break;}
+		if (load_acquire(&h->closed)) {
+			return SHM_RING_CLOSED;}
+		if (waited >= timeout_us) {
+			return SHM_RING_TIMEOUT;}
+		nanosleep(&pause, NULL);
+		waited += SHM_RING_POLL_USEC;
+	}
+	slot = slot_at(r, r->cursor);
+	/* one slot of slack, the producer may be rewriting the oldest */
+	if (head - r->cursor >= h->slot_count || load_acquire(&slot->seq) != r->cursor + 1) {
+		r->lost += head - 1 - r->cursor;
+		r->cursor = head - 1;
+		return SHM_RING_LAPPED;
+	}
+	*buf = (const uint8_t *)slot + sizeof(struct shm_slot);
+	*flags = slot->flags;
+	*time_ns = slot->time_ns;
+	r->held = 1;
+	return slot->elems <= h->slot_elems ? (int)slot->elems : (int)h->slot_elems;
+}
+
+int shm_ring_release(struct shm_ring *r)
+{
+	uint64_t seq;
+	if (!r->held) {
+		return 0;}
+	/* the samples have been read before seq is checked again */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	seq = __atomic_load_n(&slot_at(r, r->cursor)->seq, __ATOMIC_RELAXED);
+	r->held = 0;
+	r->cursor++;
+	if (seq != r->cursor) {
+		r->lost++;
+		return -1;
+	}
+	return 0;
+}
+
+void shm_ring_close(struct shm_ring *r)
+{
+	if (!r->hdr) {
+		return;}
+	if (r->producer) {
+		store_release(&r->hdr->closed, 1);
+		shm_unlink(r->name);
+	}
+	munmap(r->hdr, r->map_size);
+	r->hdr = NULL;
+}
+
+#else
+
+int shm_ring_create(struct shm_ring *r, const char *name, const char *format, size_t elem_size,
+	double rate, double freq, unsigned size_mb)
+{
+	fprintf(stderr, "IQ broadcasts are not supported on this platform.\n");
+	return -1;
+}
+
+void shm_ring_publish(struct shm_ring *r, const void *buf, size_t elems, int flags, long long time_ns)
+{
+}
+
+int shm_ring_attach(struct shm_ring *r, const char *name)
+{
+	fprintf(stderr, "IQ broadcasts are not supported on this platform.\n");
+	return -1;
+}
+
+int shm_ring_acquire(struct shm_ring *r, const void **buf, int *flags, long long *time_ns, long timeout_us)
+{
+	return SHM_RING_CLOSED;
+}
+
+int shm_ring_release(struct shm_ring *r)
+{
+	return 0;
+}
+
+void shm_ring_close(struct shm_ring *r)
+{
+}
+
+#endif
+
+const char *shm_ring_format(struct shm_ring *r)
+{
+	return r->hdr->format;
+}
+
+size_t shm_ring_elem_size(struct shm_ring *r)
+{
+	return r->hdr->elem_size;
+}
+
+double shm_ring_rate(struct shm_ring *r)
+{
+	return r->hdr->rate;
+}
+
+double shm_ring_freq(struct shm_ring *r)
+{
+	return r->hdr->freq;
+}
+
+unsigned shm_ring_slot_count(struct shm_ring *r)
+{
+	return r->hdr->slot_count;
+}
+
+// vim: tabstop=8:softtabstop=8:shiftwidth=8:noexpandtab
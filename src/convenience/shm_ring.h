@@ -0,0 +1,125 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __SHM_RING_H
+#define __SHM_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * One producer broadcasting IQ blocks to any number of processes
+ * through a POSIX shared memory ring.
+ *
+ * The producer never waits: every block goes into the next slot,
+ * overwriting the oldest one.  Each slot carries the sequence number
+ * of its block, so a consumer keeps its own cursor, reads the samples
+ * in place and finds out afterwards (seqlock style) whether the
+ * producer lapped it in the meantime.  Consumers map the ring read
+ * only and poll for new blocks.
+ */
+
+#define SHM_RING_SLOT_ELEMS	16384
+
+/* shm_ring_acquire() results besides a number of elements */
+#define SHM_RING_TIMEOUT	0
+#define SHM_RING_CLOSED		-1
+#define SHM_RING_LAPPED		-2
+
+struct shm_ring_header;
+
+struct shm_ring
+{
+	struct shm_ring_header *hdr;
+	uint8_t *slots;
+	size_t map_size;
+	char name[64];
+	int producer;
+	uint64_t cursor;      /* consumer: sequence number of the next block */
+	int held;             /* consumer: the block at cursor is being read */
+	uint64_t lost;        /* consumer: blocks overwritten before they were read */
+};
+
+/*!
+ * Create (or replace) a ring and publish the stream parameters
+ *
+ * \param r ring to set up as the producer
+ * \param name shared memory name, without the leading slash
+ * \param format SoapySDR stream format of the samples
+ * \param elem_size bytes per element
+ * \param rate sample rate in Hz
+ * \param freq center frequency in Hz
+ * \param size_mb approximate size of all slots together
+ * \return 0 on success
+ */
+int shm_ring_create(struct shm_ring *r, const char *name, const char *format, size_t elem_size,
+	double rate, double freq, unsigned size_mb);
+
+/*!
+ * Copy a block into the ring, split over several slots when needed
+ *
+ * \param r the producer's ring
+ * \param buf samples in the ring's format
+ * \param elems number of elements
+ * \param flags SoapySDR stream flags of the block
+ * \param time_ns time of the first sample
+ */
+void shm_ring_publish(struct shm_ring *r, const void *buf, size_t elems, int flags, long long time_ns);
+
+/*!
+ * Attach to a ring as one more consumer, starting with the next block
+ *
+ * \param r ring to set up as a consumer
+ * \param name shared memory name given to the producer
+ * \return 0 on success
+ */
+int shm_ring_attach(struct shm_ring *r, const char *name);
+
+/*!
+ * Wait for the next block, pair every success with shm_ring_release()
+ *
+ * \param r the consumer's ring
+ * \param buf set to the samples inside the ring
+ * \param flags stream flags of the block
+ * \param time_ns time of the first sample
+ * \param timeout_us how long to wait for the producer
+ * \return number of elements, or one of the SHM_RING_ codes
+ */
+int shm_ring_acquire(struct shm_ring *r, const void **buf, int *flags, long long *time_ns, long timeout_us);
+
+/*!
+ * Done with the block from shm_ring_acquire()
+ *
+ * \param r the consumer's ring
+ * \return 0, or -1 when the producer overwrote the block while it was read
+ */
+int shm_ring_release(struct shm_ring *r);
+
+/*!
+ * Stream parameters published by the producer
+ */
+const char *shm_ring_format(struct shm_ring *r);
+size_t shm_ring_elem_size(struct shm_ring *r);
+double shm_ring_rate(struct shm_ring *r);
+double shm_ring_freq(struct shm_ring *r);
+unsigned shm_ring_slot_count(struct shm_ring *r);
+
+/*!
+ * Detach, the producer also marks the ring closed and removes its name
+ *
+ * \param r the ring
+ */
+void shm_ring_close(struct shm_ring *r);
+
+#endif /*__SHM_RING_H*/
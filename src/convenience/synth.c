@@ -0,0 +1,161 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* synthetic IQ for running the tools without hardware */
+
+#ifdef _WIN32
+#define _USE_MATH_DEFINES
+#endif
+
+#include "synth.h"
+#include <string.h>
+#include <math.h>
+
+/* phasors are recomputed from the double phase this often */
+#define SYNTH_CHUNK	1024
+
+void synth_init(struct synth *s, uint64_t seed)
+{
+	memset(s, 0, sizeof(*s));
+	s->rng = seed ? seed : 1;
+}
+
+int synth_add(struct synth *s, enum synth_kind kind, double freq, double level_db, double param, double mod)
+{
+	struct synth_signal *g;
+	if (s->count >= SYNTH_MAX_SIGNALS) {
+		return -1;}
+	g = &s->sig[s->count++];
+	memset(g, 0, sizeof(*g));
+	g->kind = kind;
+	g->freq = freq;
+	g->amp = pow(10.0, level_db / 20.0);
+	g->param = param;
+	g->mod = mod;
+	/* noise power is split over I and Q */
+	if (kind == SYNTH_NOISE) {
+		g->amp /= sqrt(2.0);}
+	return 0;
+}
+
+static uint64_t xorshift(uint64_t *state)
+{
+	uint64_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*state = x;
+	return x;
+}
+
+static float gauss(uint64_t *state)
+/* four 16 bit uniforms, close enough to unit variance gaussian */
+{
+	uint64_t r = xorshift(state);
+	int sum = (int)(r & 0xffff) + (int)((r >> 16) & 0xffff) + (int)((r >> 32) & 0xffff) + (int)(r >> 48);
+	return (float)(sum - 131070) * (1.0f / 37837.0f);
+}
+
+static int in_band(struct synth_signal *g, double freq, double rate)
+{
+	double reach = rate / 2;
+	if (g->kind == SYNTH_NOISE) {
+		return 1;}
+	if (g->kind == SYNTH_FM) {
+		reach += g->param;}
+	return fabs(g->freq - freq) < reach;
+}
+
+static void render_signal(struct synth *s, struct synth_signal *g, float *iq, size_t n, double freq, double rate)
+{
+	size_t i, j, m;
+	float cr, ci, wr, wi, mwr, mwi, t, a, sr, si, mi, mr, vr, vi, gain;
+	double step = 2.0 * M_PI * (g->freq - freq) / rate;
+	double mod_step = 2.0 * M_PI * g->mod / rate;
+	double beta = g->mod > 0.0 ? g->param / g->mod : 0.0;
+	double time;
+	if (g->kind == SYNTH_NOISE) {
+		for (i=0; i<2*n; i++) {
+			iq[i] += (float)g->amp * gauss(&s->rng);}
+		return;
+	}
+	wr = (float)cos(step);
+	wi = (float)sin(step);
+	mwr = (float)cos(mod_step);
+	mwi = (float)sin(mod_step);
+	for (i=0; i<n; i+=m) {
+		m = n - i < SYNTH_CHUNK ? n - i : SYNTH_CHUNK;
+		cr = (float)cos(g->phase);
+		ci = (float)sin(g->phase);
+		mr = (float)cos(g->mod_phase);
+		mi = (float)sin(g->mod_phase);
+		a = (float)g->amp;
+		for (j=i; j<i+m; j++) {
+			switch (g->kind) {
+			case SYNTH_FM:
+				/* the carrier phasor times exp(j beta sin(mod)) */
+				sr = cosf((float)beta * mi);
+				si = sinf((float)beta * mi);
+				vr = cr*sr - ci*si;
+				vi = cr*si + ci*sr;
+				break;
+			case SYNTH_AM:
+				gain = 1.0f + (float)g->param * mi;
+				vr = cr * gain;
+				vi = ci * gain;
+				break;
+			case SYNTH_BURST:
+				time = s->time + (double)j / rate;
+				gain = fmod(time, g->mod) < g->param ? 1.0f : 0.0f;
+				vr = cr * gain;
+				vi = ci * gain;
+				break;
+			default:
+				vr = cr;
+				vi = ci;
+				break;
+			}
+			iq[2*j]   += a * vr;
+			iq[2*j+1] += a * vi;
+			t  = cr*wr - ci*wi;
+			ci = cr*wi + ci*wr;
+			cr = t;
+			if (g->kind == SYNTH_FM || g->kind == SYNTH_AM) {
+				t  = mr*mwr - mi*mwi;
+				mi = mr*mwi + mi*mwr;
+				mr = t;
+			}
+		}
+		g->phase = fmod(g->phase + step * m, 2.0 * M_PI);
+		g->mod_phase = fmod(g->mod_phase + mod_step * m, 2.0 * M_PI);
+	}
+}
+
+void synth_render(struct synth *s, float *iq, size_t n, double freq, double rate)
+{
+	int k;
+	memset(iq, 0, 2 * n * sizeof(float));
+	for (k=0; k<s->count; k++) {
+		if (in_band(&s->sig[k], freq, rate)) {
+			render_signal(s, &s->sig[k], iq, n, freq, rate);
+		} else {
+			/* keep the modulation running while it is out of view */
+			s->sig[k].mod_phase = fmod(s->sig[k].mod_phase + 2.0 * M_PI * s->sig[k].mod * n / rate, 2.0 * M_PI);
+		}
+	}
+	s->time += (double)n / rate;
+}
+
+// vim: tabstop=8:softtabstop=8:shiftwidth=8:noexpandtab
@@ -0,0 +1,89 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __SYNTH_H
+#define __SYNTH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Deterministic IQ from a list of signals at absolute frequencies,
+ * rendered around whatever center frequency and rate are asked for,
+ * so a sweep or a scan sees the same band a receiver would.
+ */
+
+#define SYNTH_MAX_SIGNALS	16
+
+enum synth_kind
+{
+	SYNTH_TONE,
+	SYNTH_FM,     /* param: deviation in Hz, mod: tone in Hz */
+	SYNTH_AM,     /* param: depth 0..1, mod: tone in Hz */
+	SYNTH_NOISE,  /* white over the whole band, freq is unused */
+	SYNTH_BURST   /* param: seconds on, mod: period in seconds */
+};
+
+struct synth_signal
+{
+	enum synth_kind kind;
+	double freq;       /* Hz */
+	double amp;        /* full scale is 1.0 */
+	double param;
+	double mod;
+	double phase;      /* carrier, radians */
+	double mod_phase;
+};
+
+struct synth
+{
+	struct synth_signal sig[SYNTH_MAX_SIGNALS];
+	int count;
+	uint64_t rng;
+	double time;       /* seconds rendered so far */
+};
+
+/*!
+ * Start with no signals
+ *
+ * \param s generator to set up
+ * \param seed noise seed, the same seed gives the same samples
+ */
+void synth_init(struct synth *s, uint64_t seed);
+
+/*!
+ * Add a signal
+ *
+ * \param s the generator
+ * \param kind what to add
+ * \param freq carrier in Hz
+ * \param level_db power in dB full scale
+ * \param param see enum synth_kind
+ * \param mod see enum synth_kind
+ * \return 0 on success, -1 when full
+ */
+int synth_add(struct synth *s, enum synth_kind kind, double freq, double level_db, double param, double mod);
+
+/*!
+ * Render the next samples as seen by a receiver tuned to freq
+ *
+ * \param s the generator
+ * \param iq interleaved complex floats
+ * \param n number of complex samples
+ * \param freq center frequency in Hz
+ * \param rate sample rate in Hz
+ */
+void synth_render(struct synth *s, float *iq, size_t n, double freq, double rate);
+
+#endif /*__SYNTH_H*/
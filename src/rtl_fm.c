@@ -54,6 +54,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 #ifndef _WIN32
 #include <unistd.h>
@@ -73,6 +74,9 @@
 #include <pthread.h>
 
 #include "convenience.h"
+#include "ring.h"
+#include "kernels.h"
+#include "demod.h"
 #include <SoapySDR/Device.h>
 #include <SoapySDR/Formats.h>
 
@@ -81,17 +85,29 @@
 #define MAXIMUM_OVERSAMPLE		16
 #define MAXIMUM_BUF_LENGTH		(MAXIMUM_OVERSAMPLE * DEFAULT_BUF_LENGTH)
 #define BUFFER_DUMP				4096
+#define DEFAULT_RING_DEPTH		8
+#define CHANNEL_ATTEN			60.0  /* dB, the channel filter without -F */
+#define CHANNEL_MIN_STEP		4     /* left to it after the fifth_order halvings */
 
 #define FREQUENCIES_LIMIT		1000
 
+#define STATS_BUCKETS			24
+
+/* the counters have a single writer each, the stats thread reads them concurrently */
+#ifdef _MSC_VER
+#define stat_load(p)		((uint64_t)InterlockedCompareExchange64((volatile LONG64 *)(p), 0, 0))
+#define stat_store(p, v)	InterlockedExchange64((volatile LONG64 *)(p), (LONG64)(v))
+#define stat_add(p, v)		InterlockedExchangeAdd64((volatile LONG64 *)(p), (LONG64)(v))
+#else
+#define stat_load(p)		__atomic_load_n((p), __ATOMIC_RELAXED)
+#define stat_store(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#define stat_add(p, v)		__atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#endif
+
 static volatile int do_exit = 0;
 static int lcm_post[17] = {1,1,1,3,1,5,3,7,1,9,5,11,3,13,7,15,1};
 static int ACTUAL_BUF_LENGTH;
 
-static int *atan_lut = NULL;
-static int atan_lut_size = 131072; /* 512 KB */
-static int atan_lut_coef = 8;
-
 static int verbosity = 0;
 static int printLevels = 0;
 static int printLevelNo = 1;
@@ -101,6 +117,14 @@ static double levelSum = 0.0;
 
 static int tmp_stdout = -1;
 
+struct sample_block
+/* one capture, processed in place from raw I/Q down to audio */
+{
+	int16_t *buf;  /* MAXIMUM_BUF_LENGTH samples */
+	int	  len;
+	int64_t time_ns;  /* first sample on the local clock, only with -S */
+};
+
 struct dongle_state
 {
 	int	  exit_flag;
@@ -113,50 +137,23 @@ struct dongle_state
 	uint32_t rate;
 	uint32_t bandwidth;
 	char *gain_str;
-	int16_t  buf16[MAXIMUM_BUF_LENGTH];
 	int	  ppm_error;
 	int	  offset_tuning;
 	int	  direct_sampling;
 	int	  mute;
+	int	  zero_copy;  /* process straight out of the driver's buffers */
+	uint64_t dropped;
+	const char *format;  /* stream format, CS16 or the 8 bit native ones */
+	size_t elem_size;
+	uint8_t *buf8;  /* readStream target for 8 bit formats, widened into a block */
+	int16_t *dump;  /* drains the stream when no block is free */
+	struct iq_input *input;  /* another tool's samples instead of the device */
+	double nco_phase;  /* the input is mixed to where the device would be tuned */
+	double nco_step;   /* radians per sample */
+	struct ring_buffer pool;  /* free blocks, returned by the output thread */
 	struct demod_state *demod_target;
 };
 
-struct demod_state
-{
-	int	  exit_flag;
-	pthread_t thread;
-	int16_t  lowpassed[MAXIMUM_BUF_LENGTH];
-	int	  lp_len;
-	int16_t  lp_i_hist[10][6];
-	int16_t  lp_q_hist[10][6];
-	int16_t  result[MAXIMUM_BUF_LENGTH];
-	int16_t  droop_i_hist[9];
-	int16_t  droop_q_hist[9];
-	int	  result_len;
-	int	  rate_in;
-	int	  rate_out;
-	int	  rate_out2;
-	int	  now_r, now_j;
-	int	  pre_r, pre_j;
-	int	  prev_index;
-	int	  downsample;	/* min 1, max 256 */
-	int	  post_downsample;
-	int	  output_scale;
-	int	  squelch_level, conseq_squelch, squelch_hits, terminate_on_squelch, squelch_zero;
-	int	  downsample_passes;
-	int	  comp_fir_size;
-	int	  custom_atan;
-	int	  deemph, deemph_a;
-	int	  now_lpr;
-	int	  prev_lpr_index;
-	int	  dc_block_audio, dc_avg, adc_block_const;
-	int	  dc_block_raw, dc_avgI, dc_avgQ, rdc_block_const;
-	void	 (*mode_demod)(struct demod_state*);
-	pthread_rwlock_t rw;
-	pthread_cond_t ready;
-	pthread_mutex_t ready_m;
-	struct output_state *output_target;
-};
 
 struct output_state
 {
@@ -164,13 +161,10 @@ struct output_state
 	pthread_t thread;
 	FILE	 *file;
 	char	 *filename;
-	int16_t  result[MAXIMUM_BUF_LENGTH];
-	int	  result_len;
 	int	  rate;
 	int	  wav_format;
-	pthread_rwlock_t rw;
-	pthread_cond_t ready;
-	pthread_mutex_t ready_m;
+	struct ring_buffer ring;  /* blocks from the demod thread */
+	struct dongle_state *dongle_target;
 };
 
 struct controller_state
@@ -186,11 +180,41 @@ struct controller_state
 	pthread_mutex_t hop_m;
 };
 
+enum stage_id {STAGE_READ, STAGE_CONVERT, STAGE_DEMOD, STAGE_WRITE, STAGE_LATENCY, STAGES};
+
+struct stage_stats
+/* time per block spent in one stage, written only by the thread running it, read with stat_load() */
+{
+	uint64_t count;
+	uint64_t samples;
+	uint64_t sum_ns;
+	uint64_t max_ns;
+	uint64_t hist[STATS_BUCKETS];  /* bucket k: below 2^k us, the last one open ended */
+};
+
+struct stats_state
+{
+	int	  enabled;
+	pthread_t thread;
+	FILE	 *file;
+	char	 *filename;
+	double	  interval;
+	int64_t   start_ns;
+	struct stage_stats stage[STAGES];
+	uint64_t  overflows;
+	uint64_t  timeouts;
+	int64_t   clock_offset;  /* local minus stream clock, for stream time stamps */
+	int	  have_offset;
+};
+
 // multiple of these, eventually
 struct dongle_state dongle;
+static struct iq_input input;
 struct demod_state demod;
 struct output_state output;
 struct controller_state controller;
+static struct stats_state stats;
+static struct metric *hops_metric, *squelch_metric;
 
 void usage(void)
 {
@@ -207,6 +231,9 @@ void usage(void)
 		"\t	raw mode outputs 2x16 bit IQ pairs\n"
 		"\t[-s sample_rate (default: 24k)]\n"
 		"\t[-d device key/value query (ex: 0, 1, driver=rtlsdr, driver=hackrf)]\n"
+		"\t	shm=name: the samples of rx_sdr -P name, tuned by mixing\n"
+		"\t	file=path,rate=Hz,freq=Hz[,format=CU8]: a recording, as fast as possible\n"
+		"\t	synth=[signals][,format=CU8][,samples=N][,realtime=1]: generated, tunable\n"
 		"\t[-g tuner gain(s) (ex: 20, 40, LNA=40,VGA=20,AMP=0)]\n"
 		"\t[-w tuner_bandwidth (default: automatic. enables offset tuning)]\n"
 		"\t[-C channel number (ex: 0)]\n"
@@ -233,14 +260,19 @@ void usage(void)
 		"\t	offset: enable offset tuning (only e4000 tuner)\n"
 		"\t	zero:   emit zeros when squelch active\n"
 		"\t	wav:    generate WAV header\n"
+		"\t	zerocopy: read the driver's buffers directly, when supported\n"
 		"\t[-q dc_avg_factor for option rdc (default: 9)]\n"
+		"\t[-b ring_depth, sample blocks in flight between threads (default: 8)]\n"
+		"\t[-S stats_file, per stage timing as JSON lines, '-' for stderr (default: off)]\n"
+		"\t[-I stats_interval in seconds (default: 1)]\n"
+		"\t[-x metrics, Prometheus text on unix:path or rewritten to a file (default: off)]\n"
 		"\tfilename ('-' means stdout)\n"
 		"\t	omitting the filename also uses stdout\n\n"
 		"Experimental options:\n"
 		"\t[-r resample_rate (default: none / same as -s)]\n"
 		"\t[-t squelch_delay (default: 10)]\n"
 		"\t	+values will mute/scan, -values will exit\n"
-		"\t[-F fir_size (default: off)]\n"
+		"\t[-F fir_size (default: off, a windowed sinc filter instead)]\n"
 		"\t	enables low-leakage downsample filter\n"
 		"\t	size can be 0 or 9.  0 has bad roll off\n"
 		"\t[-A std/fast/lut/ale choose atan math (default: std)]\n"
@@ -306,27 +338,6 @@ double log2(double n)
 }
 #endif
 
-void rotate16_90(int16_t *buf, uint32_t len)
-/* 90 rotation is 1+0j, 0+1j, -1+0j, 0-1j
-   or [0, 1, -3, 2, -4, -5, 7, -6] */
-{
-	uint32_t i;
-	int16_t tmp;
-	for (i=0; i<len; i+=8) {
-		tmp = - buf[i+3];
-		buf[i+3] = buf[i+2];
-		buf[i+2] = tmp;
-
-		buf[i+4] = - buf[i+4];
-		buf[i+5] = - buf[i+5];
-
-		tmp = - buf[i+6];
-		buf[i+6] = buf[i+7];
-		buf[i+7] = tmp;
-	}
-}
-
-
 void rotate_90(unsigned char *buf, uint32_t len)
 /* 90 rotation is 1+0j, 0+1j, -1+0j, 0-1j
    or [0, 1, -3, 2, -4, -5, 7, -6] */
@@ -348,377 +359,40 @@ void rotate_90(unsigned char *buf, uint32_t len)
 	}
 }
 
-void low_pass(struct demod_state *d)
-/* simple square window FIR */
+static int16_t clamp16(float x)
 {
-	int i=0, i2=0;
-	while (i < d->lp_len) {
-		d->now_r += d->lowpassed[i];
-		d->now_j += d->lowpassed[i+1];
-		i += 2;
-		d->prev_index++;
-		if (d->prev_index < d->downsample) {
-			continue;
-		}
-		d->lowpassed[i2]   = d->now_r; // * d->output_scale;
-		d->lowpassed[i2+1] = d->now_j; // * d->output_scale;
-		d->prev_index = 0;
-		d->now_r = 0;
-		d->now_j = 0;
-		i2 += 2;
-	}
-	d->lp_len = i2;
+	if (x > 32767.0f) {
+		return 32767;}
+	if (x < -32768.0f) {
+		return -32768;}
+	return (int16_t)lrintf(x);
 }
 
-int low_pass_simple(int16_t *signal2, int len, int step)
-// no wrap around, length must be multiple of step
+void translate(const int16_t *in, int16_t *out, uint32_t len, struct dongle_state *s)
+/* complex mix by nco_step, the phasor is recomputed every 1024 samples */
 {
-	int i, i2, sum;
-	for(i=0; i < len; i+=step) {
-		sum = 0;
-		for(i2=0; i2<step; i2++) {
-			sum += (int)signal2[i + i2];
+	uint32_t i, j, n;
+	float cr, ci, wr, wi, t, x, y;
+	double step = s->nco_step;
+	wr = (float)cos(step);
+	wi = (float)sin(step);
+	for (i=0; i<len; i+=2*n) {
+		n = (len - i) / 2 < 1024 ? (len - i) / 2 : 1024;
+		cr = (float)cos(s->nco_phase);
+		ci = (float)sin(s->nco_phase);
+		for (j=i; j<i+2*n; j+=2) {
+			x = (float)in[j];
+			y = (float)in[j+1];
+			out[j]   = clamp16(x*cr - y*ci);
+			out[j+1] = clamp16(x*ci + y*cr);
+			t  = cr*wr - ci*wi;
+			ci = cr*wi + ci*wr;
+			cr = t;
 		}
-		//signal2[i/step] = (int16_t)(sum / step);
-		signal2[i/step] = (int16_t)(sum);
-	}
-	signal2[i/step + 1] = signal2[i/step];
-	return len / step;
-}
-
-void low_pass_real(struct demod_state *s)
-/* simple square window FIR */
-// add support for upsampling?
-{
-	int i=0, i2=0;
-	int fast = (int)s->rate_out;
-	int slow = s->rate_out2;
-	while (i < s->result_len) {
-		s->now_lpr += s->result[i];
-		i++;
-		s->prev_lpr_index += slow;
-		if (s->prev_lpr_index < fast) {
-			continue;
-		}
-		s->result[i2] = (int16_t)(s->now_lpr / (fast/slow));
-		s->prev_lpr_index -= fast;
-		s->now_lpr = 0;
-		i2 += 1;
-	}
-	s->result_len = i2;
-}
-
-void fifth_order(int16_t *data, int length, int16_t *hist)
-/* for half of interleaved data */
-{
-	int i;
-	int16_t a, b, c, d, e, f;
-	a = hist[1];
-	b = hist[2];
-	c = hist[3];
-	d = hist[4];
-	e = hist[5];
-	f = data[0];
-	/* a downsample should improve resolution, so don't fully shift */
-	data[0] = (a + (b+e)*5 + (c+d)*10 + f) >> 4;
-	for (i=4; i<length; i+=4) {
-		a = c;
-		b = d;
-		c = e;
-		d = f;
-		e = data[i-2];
-		f = data[i];
-		data[i/2] = (a + (b+e)*5 + (c+d)*10 + f) >> 4;
+		s->nco_phase = fmod(s->nco_phase + step * n, 2.0 * M_PI);
 	}
-	/* archive */
-	hist[0] = a;
-	hist[1] = b;
-	hist[2] = c;
-	hist[3] = d;
-	hist[4] = e;
-	hist[5] = f;
 }
 
-void generic_fir(int16_t *data, int length, int *fir, int16_t *hist)
-/* Okay, not at all generic.  Assumes length 9, fix that eventually. */
-{
-	int d, temp, sum;
-	for (d=0; d<length; d+=2) {
-		temp = data[d];
-		sum = 0;
-		sum += (hist[0] + hist[8]) * fir[1];
-		sum += (hist[1] + hist[7]) * fir[2];
-		sum += (hist[2] + hist[6]) * fir[3];
-		sum += (hist[3] + hist[5]) * fir[4];
-		sum +=			hist[4]  * fir[5];
-		data[d] = sum >> 15 ;
-		hist[0] = hist[1];
-		hist[1] = hist[2];
-		hist[2] = hist[3];
-		hist[3] = hist[4];
-		hist[4] = hist[5];
-		hist[5] = hist[6];
-		hist[6] = hist[7];
-		hist[7] = hist[8];
-		hist[8] = temp;
-	}
-}
-
-/* define our own complex math ops
-   because ARMv5 has no hardware float */
-
-void multiply(int ar, int aj, int br, int bj, int *cr, int *cj)
-{
-	*cr = ar*br - aj*bj;
-	*cj = aj*br + ar*bj;
-}
-
-int polar_discriminant(int ar, int aj, int br, int bj)
-{
-	int cr, cj;
-	double angle;
-	multiply(ar, aj, br, -bj, &cr, &cj);
-	angle = atan2((double)cj, (double)cr);
-	return (int)(angle / 3.14159 * (1<<14));
-}
-
-int fast_atan2(int y, int x)
-/* pre scaled for int16 */
-{
-	int yabs, angle;
-	int pi4=(1<<12), pi34=3*(1<<12);  // note pi = 1<<14
-	if (x==0 && y==0) {
-		return 0;
-	}
-	yabs = y;
-	if (yabs < 0) {
-		yabs = -yabs;
-	}
-	if (x >= 0) {
-		angle = pi4  - pi4 * (x-yabs) / (x+yabs);
-	} else {
-		angle = pi34 - pi4 * (x+yabs) / (yabs-x);
-	}
-	if (y < 0) {
-		return -angle;
-	}
-	return angle;
-}
-
-int polar_disc_fast(int ar, int aj, int br, int bj)
-{
-	int cr, cj;
-	multiply(ar, aj, br, -bj, &cr, &cj);
-	return fast_atan2(cj, cr);
-}
-
-int atan_lut_init(void)
-{
-	int i = 0;
-
-	atan_lut = malloc(atan_lut_size * sizeof(int));
-
-	for (i = 0; i < atan_lut_size; i++) {
-		atan_lut[i] = (int) (atan((double) i / (1<<atan_lut_coef)) / 3.14159 * (1<<14));
-	}
-
-	return 0;
-}
-
-int polar_disc_lut(int ar, int aj, int br, int bj)
-{
-	int cr, cj, x, x_abs;
-
-	multiply(ar, aj, br, -bj, &cr, &cj);
-
-	/* special cases */
-	if (cr == 0 || cj == 0) {
-		if (cr == 0 && cj == 0)
-			{return 0;}
-		if (cr == 0 && cj > 0)
-			{return 1 << 13;}
-		if (cr == 0 && cj < 0)
-			{return -(1 << 13);}
-		if (cj == 0 && cr > 0)
-			{return 0;}
-		if (cj == 0 && cr < 0)
-			{return 1 << 14;}
-	}
-
-	/* real range -32768 - 32768 use 64x range -> absolute maximum: 2097152 */
-	x = (cj << atan_lut_coef) / cr;
-	x_abs = abs(x);
-
-	if (x_abs >= atan_lut_size) {
-		/* we can use linear range, but it is not necessary */
-		return (cj > 0) ? 1<<13 : -(1<<13);
-	}
-
-	if (x > 0) {
-		return (cj > 0) ? atan_lut[x] : atan_lut[x] - (1<<14);
-	} else {
-		return (cj > 0) ? (1<<14) - atan_lut[-x] : -atan_lut[-x];
-	}
-
-	return 0;
-}
-
-int esbensen(int ar, int aj, int br, int bj)
-/*
-  input signal: s(t) = a*exp(-i*w*t+p)
-  a = amplitude, w = angular freq, p = phase difference
-  solve w
-  s' = -i(w)*a*exp(-i*w*t+p)
-  s'*conj(s) = -i*w*a*a
-  s'*conj(s) / |s|^2 = -i*w
-*/
-{
-	int cj, dr, dj;
-	int scaled_pi = 2608; /* 1<<14 / (2*pi) */
-	dr = (br - ar) * 2;
-	dj = (bj - aj) * 2;
-	cj = bj*dr - br*dj; /* imag(ds*conj(s)) */
-	return (scaled_pi * cj / (ar*ar+aj*aj+1));
-}
-
-void fm_demod(struct demod_state *fm)
-{
-	int i, pcm;
-	int16_t *lp = fm->lowpassed;
-	pcm = polar_discriminant(lp[0], lp[1],
-		fm->pre_r, fm->pre_j);
-	fm->result[0] = (int16_t)pcm;
-	for (i = 2; i < (fm->lp_len-1); i += 2) {
-		switch (fm->custom_atan) {
-		case 0:
-			pcm = polar_discriminant(lp[i], lp[i+1],
-				lp[i-2], lp[i-1]);
-			break;
-		case 1:
-			pcm = polar_disc_fast(lp[i], lp[i+1],
-				lp[i-2], lp[i-1]);
-			break;
-		case 2:
-			pcm = polar_disc_lut(lp[i], lp[i+1],
-				lp[i-2], lp[i-1]);
-			break;
-		case 3:
-			pcm = esbensen(lp[i], lp[i+1],
-				lp[i-2], lp[i-1]);
-			break;
-		}
-		fm->result[i/2] = (int16_t)pcm;
-	}
-	fm->pre_r = lp[fm->lp_len - 2];
-	fm->pre_j = lp[fm->lp_len - 1];
-	fm->result_len = fm->lp_len/2;
-}
-
-void am_demod(struct demod_state *fm)
-// todo, fix this extreme laziness
-{
-	int i, pcm;
-	int16_t *lp = fm->lowpassed;
-	int16_t *r  = fm->result;
-	for (i = 0; i < fm->lp_len; i += 2) {
-		// hypot uses floats but won't overflow
-		//r[i/2] = (int16_t)hypot(lp[i], lp[i+1]);
-		pcm = lp[i] * lp[i];
-		pcm += lp[i+1] * lp[i+1];
-		r[i/2] = (int16_t)sqrt(pcm) * fm->output_scale;
-	}
-	fm->result_len = fm->lp_len/2;
-	// lowpass? (3khz)  highpass?  (dc)
-}
-
-void usb_demod(struct demod_state *fm)
-{
-	int i, pcm;
-	int16_t *lp = fm->lowpassed;
-	int16_t *r  = fm->result;
-	for (i = 0; i < fm->lp_len; i += 2) {
-		pcm = lp[i] + lp[i+1];
-		r[i/2] = (int16_t)pcm * fm->output_scale;
-	}
-	fm->result_len = fm->lp_len/2;
-}
-
-void lsb_demod(struct demod_state *fm)
-{
-	int i, pcm;
-	int16_t *lp = fm->lowpassed;
-	int16_t *r  = fm->result;
-	for (i = 0; i < fm->lp_len; i += 2) {
-		pcm = lp[i] - lp[i+1];
-		r[i/2] = (int16_t)pcm * fm->output_scale;
-	}
-	fm->result_len = fm->lp_len/2;
-}
-
-void raw_demod(struct demod_state *fm)
-{
-	int i;
-	for (i = 0; i < fm->lp_len; i++) {
-		fm->result[i] = (int16_t)fm->lowpassed[i];
-	}
-	fm->result_len = fm->lp_len;
-}
-
-void deemph_filter(struct demod_state *fm)
-{
-	static int avg;  // cheating...
-	int i, d;
-	// de-emph IIR
-	// avg = avg * (1 - alpha) + sample * alpha;
-	for (i = 0; i < fm->result_len; i++) {
-		d = fm->result[i] - avg;
-		if (d > 0) {
-			avg += (d + fm->deemph_a/2) / fm->deemph_a;
-		} else {
-			avg += (d - fm->deemph_a/2) / fm->deemph_a;
-		}
-		fm->result[i] = (int16_t)avg;
-	}
-}
-
-void dc_block_audio_filter(struct demod_state *fm)
-{
-	int i, avg;
-	int64_t sum = 0;
-	for (i=0; i < fm->result_len; i++) {
-		sum += fm->result[i];
-	}
-	avg = sum / fm->result_len;
-	avg = (avg + fm->dc_avg * fm->adc_block_const) / ( fm->adc_block_const + 1 );
-	for (i=0; i < fm->result_len; i++) {
-		fm->result[i] -= avg;
-	}
-	fm->dc_avg = avg;
-}
-
-void dc_block_raw_filter(struct demod_state *fm, int16_t *buf, int len)
-{
-	/* derived from dc_block_audio_filter,
-		running over the raw I/Q components
-	*/
-	int i, avgI, avgQ;
-	int64_t sumI = 0;
-	int64_t sumQ = 0;
-	for (i = 0; i < len; i += 2) {
-		sumI += buf[i];
-		sumQ += buf[i+1];
-	}
-	avgI = sumI / ( len / 2 );
-	avgQ = sumQ / ( len / 2 );
-	avgI = (avgI + fm->dc_avgI * fm->rdc_block_const) / ( fm->rdc_block_const + 1 );
-	avgQ = (avgQ + fm->dc_avgQ * fm->rdc_block_const) / ( fm->rdc_block_const + 1 );
-	for (i = 0; i < len; i += 2) {
-		buf[i] -= avgI;
-		buf[i+1] -= avgQ;
-	}
-	fm->dc_avgI = avgI;
-	fm->dc_avgQ = avgQ;
-}
 int mad(int16_t *samples, int len, int step)
 /* mean average deviation */
 {
@@ -740,12 +414,12 @@ int rms(int16_t *samples, int len, int step)
 /* largely lifted from rtl_power */
 {
 	int i;
-	long p, t, s;
+	int64_t p, t, s;
 	double dc, err;
 
 	p = t = 0L;
 	for (i=0; i<len; i+=step) {
-		s = (long)samples[i];
+		s = (int64_t)samples[i];
 		t += s;
 		p += s * s;
 	}
@@ -756,30 +430,71 @@ int rms(int16_t *samples, int len, int step)
 	return (int)sqrt((p-err) / len);
 }
 
+int squelch_rms(struct demod_state *d)
+/* lowpassed is full scale 16 bit, report levels in the units of
+   the old 8 bit front end so -l and -L values stay comparable */
+{
+	int64_t sr = rms(d->lowpassed, d->lp_len, 1);
+	return (int)(sr * d->downsample / 256);
+}
+
+static int demod_filters_init(struct demod_state *d)
+/* downsample is up to the controller, call once it settled it */
+{
+	double h[FIR_MAX_TAPS];
+	struct fir_taps *t;
+	int k, n, ds = d->downsample, ds_p = d->downsample_passes;
+	if (d->rate_out2 > 0 && d->rate_out2 != d->rate_out) {
+		if (fir_resampler_init(&d->resample, d->rate_out, d->rate_out2) != 0) {
+			return -1;}
+		if (verbosity) {
+			fprintf(stderr, "resampler: %d to %d Hz, %d phases of %d taps\n",
+				d->rate_out, d->rate_out2, d->resample.rows, d->resample.len);}
+	}
+	if (ds_p) {
+		if (d->comp_fir_size != 9 || ds_p > CIC_TABLE_MAX) {
+			return 0;}
+		for (k=0; k<9; k++) {
+			h[k] = cic_9_tables[ds_p][k+1] / 32768.0;}
+		t = fir_taps_new(h, 9, 1);
+		return t ? fir_init(&d->droop, t) : -1;
+	}
+	if (ds <= 1) {
+		return 0;}
+	/* halve with fifth_order first while the step stays even, each pass
+	   halves the taps per input sample.  Its zeros at the Nyquist rate
+	   keep what folds onto the channel over 100 dB down, and with at
+	   least CHANNEL_MIN_STEP left its droop stays under 1 dB */
+	for (d->channel_passes=0; ds % 2 == 0 && ds / 2 >= CHANNEL_MIN_STEP; d->channel_passes++) {
+		ds /= 2;}
+	/* whatever folds below 3/8 of the output rate is in the stopband */
+	n = fir_kaiser_taps(0.25 / ds, CHANNEL_ATTEN);
+	fir_kaiser_lowpass(h, n, 0.5 / ds, CHANNEL_ATTEN);
+	t = fir_taps_new(h, n, ds);
+	if (verbosity && t) {
+		fprintf(stderr, "channel filter: %d fifth_order passes, then %d taps decimating by %d\n",
+			d->channel_passes, n, ds);}
+	return t ? fir_init(&d->channel, t) : -1;
+}
+
 void full_demod(struct demod_state *d)
 {
 	int i, ds_p;
 	int sr = 0;
 	ds_p = d->downsample_passes;
 	if (ds_p) {
-		for (i=0; i < ds_p; i++) {
-			fifth_order(d->lowpassed,   (d->lp_len >> i), d->lp_i_hist[i]);
-			fifth_order(d->lowpassed+1, (d->lp_len >> i) - 1, d->lp_q_hist[i]);
-		}
-		d->lp_len = d->lp_len >> ds_p;
+		d->lp_len = cic_decimate(&d->cic, d->lowpassed, d->lp_len, ds_p, 0);
 		/* droop compensation */
-		if (d->comp_fir_size == 9 && ds_p <= CIC_TABLE_MAX) {
-			generic_fir(d->lowpassed, d->lp_len,
-				cic_9_tables[ds_p], d->droop_i_hist);
-			generic_fir(d->lowpassed+1, d->lp_len-1,
-				cic_9_tables[ds_p], d->droop_q_hist);
-		}
-	} else {
-		low_pass(d);
+		if (d->droop.taps) {
+			d->lp_len = fir_decimate(&d->droop, d->lowpassed, d->lp_len);}
+	} else if (d->channel.taps) {
+		if (d->channel_passes) {
+			d->lp_len = cic_decimate(&d->cic, d->lowpassed, d->lp_len, d->channel_passes, 0);}
+		d->lp_len = fir_decimate(&d->channel, d->lowpassed, d->lp_len);
 	}
 	/* power squelch */
 	if (d->squelch_level) {
-		sr = rms(d->lowpassed, d->lp_len, 1);
+		sr = squelch_rms(d);
 		if (sr < d->squelch_level) {
 			d->squelch_hits++;
 			for (i=0; i<d->lp_len; i++) {
@@ -791,7 +506,7 @@ void full_demod(struct demod_state *d)
 
 	if (printLevels) {
 		if (!sr)
-			sr = rms(d->lowpassed, d->lp_len, 1);
+			sr = squelch_rms(d);
 		--printLevelNo;
 		if (printLevels) {
 			levelSum += sr;
@@ -817,49 +532,177 @@ void full_demod(struct demod_state *d)
 		deemph_filter(d);}
 	if (d->dc_block_audio) {
 		dc_block_audio_filter(d);}
-	if (d->rate_out2 > 0) {
-		low_pass_real(d);
-		//arbitrary_resample(d->result, d->result, d->result_len, d->result_len * d->rate_out2 / d->rate_out);
+	if (d->resample.bank) {
+		/* result is the block's whole buffer */
+		d->result_len = fir_resample(&d->resample, d->result, d->result_len, MAXIMUM_BUF_LENGTH);}
+}
+
+static int64_t now_ns(void)
+{
+#ifdef _WIN32
+	return (int64_t)GetTickCount64() * 1000000;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static void stage_add(enum stage_id id, int64_t ns, int samples)
+{
+	struct stage_stats *st = &stats.stage[id];
+	uint64_t us;
+	int k = 0;
+	if (ns < 0) {
+		ns = 0;}
+	for (us = (uint64_t)ns / 1000; us && k < STATS_BUCKETS - 1; us >>= 1) {
+		k++;}
+	stat_add(&st->hist[k], 1);
+	stat_add(&st->count, 1);
+	stat_add(&st->samples, (uint64_t)samples);
+	stat_add(&st->sum_ns, (uint64_t)ns);
+	if ((uint64_t)ns > st->max_ns) {
+		stat_store(&st->max_ns, (uint64_t)ns);}
+}
+
+static int64_t block_time(int64_t arrival, int flags, long long timeNs, int elems)
+/* local time of the first sample of a buffer that just arrived */
+{
+	int64_t span = dongle.rate ? (int64_t)((double)elems * 1e9 / dongle.rate) : 0;
+	int64_t offset;
+	if (dongle.input && dongle.input->offline) {
+		return arrival;}
+	if (!(flags & SOAPY_SDR_HAS_TIME)) {
+		return arrival - span;}
+	/* the stream clock is mapped by the quickest delivery seen so far */
+	offset = arrival - span - timeNs;
+	if (!stats.have_offset || offset < stats.clock_offset) {
+		stats.clock_offset = offset;
+		stats.have_offset = 1;
+	}
+	return timeNs + stats.clock_offset;
+}
+
+static void stats_dump(void)
+/* one JSON object per line, every number is a total since the start */
+{
+	static const char *names[STAGES] = {"read", "convert", "demod", "write", "latency"};
+	struct stage_stats *st;
+	uint64_t hist[STATS_BUCKETS];
+	FILE *f = stats.file;
+	int i, k, n;
+	fprintf(f, "{\"time\":%.3f,\"dropped\":%llu,\"overflows\":%llu,\"overwritten\":%llu,\"timeouts\":%llu,",
+		(double)(now_ns() - stats.start_ns) / 1e9, (unsigned long long)stat_load(&dongle.dropped),
+		(unsigned long long)stat_load(&stats.overflows), (unsigned long long)input.shm.lost,
+		(unsigned long long)stat_load(&stats.timeouts));
+	fprintf(f, "\"queues\":{\"depth\":%u,\"free\":%u,\"demod\":%u,\"demod_high\":%u,\"output\":%u,\"output_high\":%u},",
+		dongle.pool.depth, ring_count(&dongle.pool), ring_count(&demod.ring), ring_high_water(&demod.ring),
+		ring_count(&output.ring), ring_high_water(&output.ring));
+	fprintf(f, "\"stages\":{");
+	for (i=0; i<STAGES; i++) {
+		st = &stats.stage[i];
+		for (k=0; k<STATS_BUCKETS; k++) {
+			hist[k] = stat_load(&st->hist[k]);}
+		for (n=STATS_BUCKETS; n > 1 && !hist[n-1]; n--) {}
+		fprintf(f, "%s\"%s\":{\"count\":%llu,\"samples\":%llu,\"sum_ns\":%llu,\"max_ns\":%llu,\"hist_us\":[",
+			i ? "," : "", names[i], (unsigned long long)stat_load(&st->count),
+			(unsigned long long)stat_load(&st->samples), (unsigned long long)stat_load(&st->sum_ns),
+			(unsigned long long)stat_load(&st->max_ns));
+		for (k=0; k<n; k++) {
+			fprintf(f, "%s%llu", k ? "," : "", (unsigned long long)hist[k]);}
+		fprintf(f, "]}");
 	}
+	fprintf(f, "}}\n");
+	fflush(f);
 }
 
-// buf: buffer
-// len: number of elements in buf
-static void rtlsdr_callback(int16_t *buf, uint32_t len, void *ctx)
+static void *stats_thread_fn(void *arg)
+{
+	int64_t next = stats.start_ns;
+	int64_t step = (int64_t)(stats.interval * 1e9);
+	while (!do_exit) {
+		usleep(50000);
+		if (now_ns() < next + step) {
+			continue;}
+		next += step;
+		stats_dump();
+	}
+	return 0;
+}
+
+// b: free block to fill, or already filled by readStream
+// raw: the samples in s->format, b->buf, s->buf8 or a driver buffer
+// len: number of values (I or Q) in raw
+static void rtlsdr_callback(struct sample_block *b, const void *raw, uint32_t len, void *ctx)
 {
 	int i;
 	struct dongle_state *s = ctx;
 	struct demod_state *d;
+	int16_t *buf = b->buf;
+	const int16_t *in = raw;
+	int64_t t = stats.enabled ? now_ns() : 0;
 
-	if (do_exit) {
-		return;}
-	if (!s) {
-		return;}
 	d  = s->demod_target;
+	/* 8 bit samples are widened into the block first, like SoapySDR would */
+	if (strcmp(s->format, SOAPY_SDR_CS8) == 0) {
+		dsp.cs8_to_cs16(raw, buf, len);
+		in = buf;
+	} else if (strcmp(s->format, SOAPY_SDR_CU8) == 0) {
+		dsp.cu8_to_cs16(raw, buf, len);
+		in = buf;
+	} else if (strcmp(s->format, SOAPY_SDR_CS12) == 0) {
+		dsp.cs12_to_cs16(raw, buf, len);
+		in = buf;
+	} else if (strcmp(s->format, SOAPY_SDR_CF32) == 0) {
+		dsp.cf32_to_cs16(raw, buf, len);
+		in = buf;
+	}
+	/* the up-mixing copies out of a driver buffer, other stages work in place */
+	if (in != buf && (s->mute || d->dc_block_raw || s->offset_tuning)) {
+		memcpy(buf, in, len * sizeof(int16_t));
+		in = buf;
+	}
 	if (s->mute) {
 		for (i=0; i<s->mute; i++) {
 			buf[i] = 0;}
 		s->mute = 0;
 	}
-	/* 1st: convert to 16 bit - to allow easier calculation of DC */
-	for (i=0; i<(int)len; i++) {
-		s->buf16[i] = ( (int16_t)buf[i] / 32767.0 * 128.0 + 0.4);
-		// TODO: remove downconversion from 16-bit to 8-bit
-	}
-	/* 2nd: do DC filtering BEFORE up-mixing */
+	/* 1st: do DC filtering BEFORE up-mixing, on the full 16 bit samples */
 	if (d->dc_block_raw) {
-		dc_block_raw_filter(d, s->buf16, (int)len);
+		dc_block_raw_filter(d, buf, (int)len);
+	}
+	/* a fixed input is mixed to the frequency the device would be tuned to */
+	if (s->input && !s->input->tunable) {
+		translate(in, buf, len, s);
+		in = buf;
 	}
-	/* 3rd: up-mixing */
+	/* 2nd: up-mixing */
 	if (!s->offset_tuning) {
-		rotate16_90(s->buf16, (int)len);
+		dsp.rotate16_90(in, buf, len);
 		/* rotate_90(buf, len); */
 	}
-	pthread_rwlock_wrlock(&d->rw);
-	memcpy(d->lowpassed, s->buf16, 2*len);
-	d->lp_len = len;
-	pthread_rwlock_unlock(&d->rw);
-	safe_cond_signal(&d->ready, &d->ready_m);
+	b->len = (int)len;
+	if (stats.enabled) {
+		stage_add(STAGE_CONVERT, now_ns() - t, (int)len / 2);}
+	ring_push(&d->ring, b);
+}
+
+static struct sample_block *free_block(struct dongle_state *s)
+/* a live stream never waits for the demodulator, a recording does */
+{
+	struct sample_block *b = ring_pop(&s->pool);
+	while (!b && s->input && s->input->offline && !do_exit) {
+		ring_wait(&s->pool);
+		b = ring_pop(&s->pool);
+	}
+	return b;
+}
+
+static void drain_pipeline(struct dongle_state *s, struct sample_block *held)
+/* wait for the demodulator and the output to finish every block */
+{
+	while (!do_exit && ring_count(&s->pool) + (held != NULL) < s->pool.depth) {
+		usleep(1000);}
 }
 
 int generate_header(struct demod_state *d, struct output_state *o);
@@ -867,15 +710,18 @@ static void *dongle_thread_fn(void *arg)
 {
 	struct dongle_state *s = arg;
 
-	SoapySDRDevice_activateStream(s->dev, s->stream, 0, 0, 0);
-	size_t samples_per_buffer = MAXIMUM_BUF_LENGTH/2; //fix for int16 storage
-	size_t elemsize = SoapySDR_formatToSize(SOAPY_SDR_CS16);
-	int16_t *buf = malloc(samples_per_buffer * elemsize);
-	memset(buf, 0, samples_per_buffer * elemsize);
-	if (!buf) {
-		perror("malloc");
-		exit(1);
+	struct sample_block *b = NULL;
+	struct stream_reader reader;
+	const void *raw;
+	int off, n;
+
+	if (s->input) {
+		verbose_input_reader(&reader, s->input);
+	} else {
+		SoapySDRDevice_activateStream(s->dev, s->stream, 0, 0, 0);
+		verbose_stream_reader(&reader, s->dev, s->stream, s->zero_copy);
 	}
+	size_t samples_per_buffer = MAXIMUM_BUF_LENGTH/2; //fix for int16 storage
 
 	suppress_stdout_stop(tmp_stdout);
 
@@ -884,30 +730,77 @@ static void *dongle_thread_fn(void *arg)
 	}
 
 	int r = 0;
+	int64_t t0 = 0, t1, first = 0;
 	do
 	{
-		void *buffs[] = {buf};
+		/* never wait for the demodulator, drain into the dump instead */
+		if (!b) {
+			b = free_block(s);}
+		void *buffs[] = {!b ? (void *)s->dump : s->elem_size == 2 ? (void *)s->buf8 : (void *)b->buf};
 		int flags = 0;
 		long long timeNs = 0;
 		long timeoutNs = 1000000;
 
-		r = SoapySDRDevice_readStream(s->dev, s->stream, buffs, samples_per_buffer, &flags, &timeNs, timeoutNs);
+		if (stats.enabled) {
+			t0 = now_ns();}
+		r = stream_acquire(&reader, &raw, buffs[0], samples_per_buffer, &flags, &timeNs, timeoutNs);
 		//fprintf(stderr, "ret=%d\n", r);
+		if (stats.enabled && r > 0) {
+			t1 = now_ns();
+			stage_add(STAGE_READ, t1 - t0, r);
+			first = block_time(t1, flags, timeNs, r);
+		}
 
-		if (r >= 0) {
+		if (r >= 0 && reader.direct) {
+			/* a driver buffer may span several blocks */
+			for (off = 0; off < r; off += n) {
+				n = r - off < (int)samples_per_buffer ? r - off : (int)samples_per_buffer;
+				if (!b) {
+					b = free_block(s);}
+				if (!b) {
+					stat_add(&s->dropped, 1);
+					break;
+				}
+				b->time_ns = first + (int64_t)((double)off * 1e9 / s->rate);
+				rtlsdr_callback(b, (const uint8_t *)raw + off * s->elem_size, n * 2, s);
+				b = NULL;
+			}
+			stream_release(&reader);
+		} else if (r >= 0) {
+			if (!b) {
+				stat_add(&s->dropped, 1);
+				continue;
+			}
 			// r is number of elements read, elements=complex pairs, so buffer length in bytes is twice
-			rtlsdr_callback(buf, r * 2, s);
+			b->time_ns = first;
+			rtlsdr_callback(b, raw, r * 2, s);
+			b = NULL;
 		} else {
 			if (r == SOAPY_SDR_OVERFLOW) {
+				stat_add(&stats.overflows, 1);
 				fprintf(stderr, "O");
 				fflush(stderr);
 				continue;
 			}
+			if (r == SOAPY_SDR_TIMEOUT) {
+				stat_add(&stats.timeouts, 1);}
+			if (r == SOAPY_SDR_TIMEOUT && s->input) {
+				continue;}
+			if (r == STREAM_EOF) {
+				fprintf(stderr, "End of input.\n");
+				drain_pipeline(s, b);
+				do_exit = 1;
+				break;
+			}
 			fprintf(stderr, "readStream read failed: %d\n", r);
 			break;
 		}
-	} while(1);
+	} while(!do_exit);
 	fprintf(stderr, "dongle_thread_fn terminated\n");
+	if (b) {
+		free(b->buf);
+		free(b);
+	}
 
 	//rtlsdr_read_async(s->dev, rtlsdr_callback, s, 0, s->buf_len);
 	return 0;
@@ -917,29 +810,37 @@ static void *demod_thread_fn(void *arg)
 {
 	struct demod_state *d = arg;
 	struct output_state *o = d->output_target;
+	struct sample_block *b;
+	int64_t t = 0;
 	while (!do_exit) {
-		safe_cond_wait(&d->ready, &d->ready_m);
-		pthread_rwlock_wrlock(&d->rw);
+		b = ring_pop(&d->ring);
+		if (!b) {
+			ring_wait(&d->ring);
+			continue;
+		}
+		d->lowpassed = d->result = b->buf;
+		d->lp_len = b->len;
+		if (stats.enabled) {
+			t = now_ns();}
 		full_demod(d);
-		pthread_rwlock_unlock(&d->rw);
+		if (stats.enabled) {
+			stage_add(STAGE_DEMOD, now_ns() - t, b->len / 2);}
 		if (d->exit_flag) {
 			do_exit = 1;
 		}
 		bool squelch_active = (d->squelch_level && d->squelch_hits > d->conseq_squelch);
+		metric_set(squelch_metric, squelch_active);
 		if (squelch_active && !d->squelch_zero) {
 			d->squelch_hits = d->conseq_squelch + 1;  /* hair trigger */
 			safe_cond_signal(&controller.hop, &controller.hop_m);
-			continue;
+			/* nothing to write, the output thread recycles it */
+			d->result_len = 0;
 		}
-		pthread_rwlock_wrlock(&o->rw);
 		if (squelch_active && d->squelch_zero) {
-			memset(o->result, 0, 2*d->result_len);
-		} else {
-			memcpy(o->result, d->result, 2*d->result_len);
+			memset(d->result, 0, 2*d->result_len);
 		}
-		o->result_len = d->result_len;
-		pthread_rwlock_unlock(&o->rw);
-		safe_cond_signal(&o->ready, &o->ready_m);
+		b->len = d->result_len;
+		ring_push(&o->ring, b);
 	}
 	return 0;
 }
@@ -947,12 +848,24 @@ static void *demod_thread_fn(void *arg)
 static void *output_thread_fn(void *arg)
 {
 	struct output_state *s = arg;
+	struct sample_block *b;
+	int64_t t = 0, done;
 	while (!do_exit) {
 		// use timedwait and pad out under runs
-		safe_cond_wait(&s->ready, &s->ready_m);
-		pthread_rwlock_rdlock(&s->rw);
-		fwrite(s->result, 2, s->result_len, s->file);
-		pthread_rwlock_unlock(&s->rw);
+		b = ring_pop(&s->ring);
+		if (!b) {
+			ring_wait(&s->ring);
+			continue;
+		}
+		if (b->len && stats.enabled) {
+			t = now_ns();
+			fwrite(b->buf, 2, b->len, s->file);
+			done = now_ns();
+			stage_add(STAGE_WRITE, done - t, b->len);
+			stage_add(STAGE_LATENCY, done - b->time_ns, b->len);
+		} else if (b->len) {
+			fwrite(b->buf, 2, b->len, s->file);}
+		ring_push(&s->dongle_target->pool, b);
 	}
 	return 0;
 }
@@ -965,10 +878,13 @@ static void optimal_settings(int freq, int rate)
 	struct dongle_state *d = &dongle;
 	struct demod_state *dm = &demod;
 	struct controller_state *cs = &controller;
-	dm->downsample = (1000000 / dm->rate_in) + 1;
-	if (dm->downsample_passes) {
-		dm->downsample_passes = (int)log2(dm->downsample) + 1;
-		dm->downsample = 1 << dm->downsample_passes;
+	/* a fixed input's rate can not change, input_settings() already fitted downsample to it */
+	if (!d->input || d->input->tunable) {
+		dm->downsample = (1000000 / dm->rate_in) + 1;
+		if (dm->downsample_passes) {
+			dm->downsample_passes = (int)log2(dm->downsample) + 1;
+			dm->downsample = 1 << dm->downsample_passes;
+		}
 	}
 	if (verbosity) {
 		fprintf(stderr, "downsample_passes = %d (= # of fifth_order() iterations), downsample = %d\n", dm->downsample_passes, dm->downsample );
@@ -985,13 +901,14 @@ static void optimal_settings(int freq, int rate)
 	capture_freq += cs->edge * dm->rate_in / 2;
 	if (verbosity)
 		fprintf(stderr, "optimal_settings(freq = %d): capture_freq +=  cs->edge * dm->rate_in / 2 = %d * %d / 2 = %d\n", freq, cs->edge, dm->rate_in, capture_freq );
-	dm->output_scale = (1<<15) / (128 * dm->downsample);
-	if (dm->output_scale < 1) {
-		dm->output_scale = 1;}
-	if (dm->mode_demod == &fm_demod) {
-		dm->output_scale = 1;}
 	d->freq = (uint32_t)capture_freq;
 	d->rate = (uint32_t)capture_rate;
+	if (d->input && !d->input->tunable) {
+		d->rate = (uint32_t)d->input->rate;
+		d->nco_step = 2.0 * M_PI * (d->input->freq - (double)d->freq) / d->input->rate;
+		if (fabs(d->input->freq - (double)freq) > d->input->rate / 2) {
+			fprintf(stderr, "Warning: %d Hz is outside of the input.\n", freq);}
+	}
 	if (verbosity)
 		fprintf(stderr, "optimal_settings(freq = %d) delivers freq %.0f, rate %.0f\n", freq, (double)d->freq, (double)d->rate );
 }
@@ -1012,9 +929,9 @@ static void *controller_thread_fn(void *arg)
 
 	/* set up primary channel */
 	optimal_settings(s->freqs[0], demod.rate_in);
-	if (dongle.direct_sampling) {
+	if (dongle.direct_sampling && !dongle.input) {
 		verbose_direct_sampling(dongle.dev, dongle.direct_sampling);}
-	if (dongle.offset_tuning) {
+	if (dongle.offset_tuning && !dongle.input) {
 		verbose_offset_tuning(dongle.dev);}
 
 	/* Set the frequency */
@@ -1023,7 +940,10 @@ static void *controller_thread_fn(void *arg)
 		if (!dongle.offset_tuning)
 			fprintf(stderr, "  frequency is away from parametrized one, to avoid negative impact from dc\n");
 	}
-	verbose_set_frequency(dongle.dev, dongle.freq, dongle.channel);
+	if (!dongle.input) {
+		verbose_set_frequency(dongle.dev, dongle.freq, dongle.channel);}
+	else {
+		input_set_frequency(dongle.input, dongle.freq);}
 	fprintf(stderr, "Oversampling input by: %ix.\n", demod.downsample);
 	fprintf(stderr, "Oversampling output by: %ix.\n", demod.post_downsample);
 	fprintf(stderr, "Buffer size: %0.2fms\n",
@@ -1032,7 +952,10 @@ static void *controller_thread_fn(void *arg)
 	/* Set the sample rate */
 	if (verbosity)
 		fprintf(stderr, "verbose_set_sample_rate(%.0f Hz)\n", (double)dongle.rate);
-	verbose_set_sample_rate(dongle.dev, dongle.rate, dongle.channel);
+	if (!dongle.input) {
+		verbose_set_sample_rate(dongle.dev, dongle.rate, dongle.channel);}
+	else {
+		input_set_rate(dongle.input, dongle.rate);}
 	fprintf(stderr, "Output at %u Hz.\n", demod.rate_in/demod.post_downsample);
 
 	SoapySDRKwargs args = {0};
@@ -1042,8 +965,12 @@ static void *controller_thread_fn(void *arg)
 			continue;}
 		/* hacky hopping */
 		s->freq_now = (s->freq_now + 1) % s->freq_len;
+		metric_add(hops_metric, 1);
 		optimal_settings(s->freqs[s->freq_now], demod.rate_in);
-		SoapySDRDevice_setFrequency(dongle.dev, SOAPY_SDR_RX, 0, (double)dongle.freq, &args);
+		if (!dongle.input) {
+			SoapySDRDevice_setFrequency(dongle.dev, SOAPY_SDR_RX, 0, (double)dongle.freq, &args);}
+		else {
+			input_set_frequency(dongle.input, dongle.freq);}
 		dongle.mute = BUFFER_DUMP;
 	}
 	return 0;
@@ -1079,6 +1006,59 @@ void dongle_init(struct dongle_state *s)
 	s->demod_target = &demod;
 	s->bandwidth = 0;
 	s->channel = 0;
+	s->dropped = 0;
+	s->format = SOAPY_SDR_CS16;
+	s->elem_size = 4;
+}
+
+int pipeline_init(struct dongle_state *s, struct demod_state *d, struct output_state *o, int depth)
+/* every block lives in exactly one of the three rings */
+{
+	int i;
+	struct sample_block *b;
+	s->dump = malloc(MAXIMUM_BUF_LENGTH * sizeof(int16_t));
+	s->buf8 = malloc(MAXIMUM_BUF_LENGTH);
+	if (!s->dump || !s->buf8) {
+		return -1;}
+	if (ring_init(&s->pool, depth, sizeof(struct sample_block *)) != 0 ||
+	    ring_init(&d->ring, depth, sizeof(struct sample_block *)) != 0 ||
+	    ring_init(&o->ring, depth, sizeof(struct sample_block *)) != 0) {
+		return -1;}
+	for (i=0; i<depth; i++) {
+		b = malloc(sizeof(struct sample_block));
+		if (!b) {
+			return -1;}
+		b->buf = malloc(MAXIMUM_BUF_LENGTH * sizeof(int16_t));
+		if (!b->buf) {
+			return -1;}
+		b->len = 0;
+		ring_push(&s->pool, b);
+	}
+	return 0;
+}
+
+void pipeline_cleanup(struct dongle_state *s, struct demod_state *d, struct output_state *o)
+{
+	struct sample_block *b;
+	struct ring_buffer *rings[3] = {&s->pool, &d->ring, &o->ring};
+	int i;
+	if (s->dropped) {
+		fprintf(stderr, "Dropped %llu blocks, demodulator too slow (%u blocks, high water %u)\n",
+			(unsigned long long)s->dropped, s->pool.depth, d->ring.high_water);}
+	for (i=0; i<3; i++) {
+		while ((b = ring_pop(rings[i])) != NULL) {
+			free(b->buf);
+			free(b);
+		}
+		ring_free(rings[i]);
+	}
+	free(s->dump);
+	free(s->buf8);
+	fir_taps_free(d->channel.taps);
+	fir_free(&d->channel);
+	fir_taps_free(d->droop.taps);
+	fir_free(&d->droop);
+	fir_resampler_free(&d->resample);
 }
 
 void demod_init(struct demod_state *s)
@@ -1091,16 +1071,13 @@ void demod_init(struct demod_state *s)
 	s->squelch_hits = 11;
 	s->downsample_passes = 0;
 	s->comp_fir_size = 0;
-	s->prev_index = 0;
 	s->post_downsample = 1;	// once this works, default = 4
 	s->custom_atan = 0;
 	s->deemph = 0;
 	s->rate_out2 = -1;	// flag for disabled
 	s->mode_demod = &fm_demod;
-	s->pre_j = s->pre_r = s->now_r = s->now_j = 0;
-	s->prev_lpr_index = 0;
+	s->pre_j = s->pre_r = 0;
 	s->deemph_a = 0;
-	s->now_lpr = 0;
 	s->dc_block_audio = 0;
 	s->dc_avg = 0;
 	s->adc_block_const = 9;
@@ -1108,32 +1085,14 @@ void demod_init(struct demod_state *s)
 	s->dc_avgI = 0;
 	s->dc_avgQ = 0;
 	s->rdc_block_const = 9;
-	pthread_rwlock_init(&s->rw, NULL);
-	pthread_cond_init(&s->ready, NULL);
-	pthread_mutex_init(&s->ready_m, NULL);
+	s->ring_depth = DEFAULT_RING_DEPTH;
 	s->output_target = &output;
 }
 
-void demod_cleanup(struct demod_state *s)
-{
-	pthread_rwlock_destroy(&s->rw);
-	pthread_cond_destroy(&s->ready);
-	pthread_mutex_destroy(&s->ready_m);
-}
-
 void output_init(struct output_state *s)
 {
 	//s->rate = DEFAULT_SAMPLE_RATE;
-	pthread_rwlock_init(&s->rw, NULL);
-	pthread_cond_init(&s->ready, NULL);
-	pthread_mutex_init(&s->ready_m, NULL);
-}
-
-void output_cleanup(struct output_state *s)
-{
-	pthread_rwlock_destroy(&s->rw);
-	pthread_cond_destroy(&s->ready);
-	pthread_mutex_destroy(&s->ready_m);
+	s->dongle_target = &dongle;
 }
 
 void controller_init(struct controller_state *s)
@@ -1152,6 +1111,23 @@ void controller_cleanup(struct controller_state *s)
 	pthread_mutex_destroy(&s->hop_m);
 }
 
+void input_settings(struct dongle_state *s, struct demod_state *dm)
+/* the closest decimation to the input's fixed rate, rate_in follows from it */
+{
+	double rate = s->input->rate;
+	dm->downsample = (int)(rate / dm->rate_in + 0.5);
+	if (dm->downsample < 1) {
+		dm->downsample = 1;}
+	if (dm->downsample_passes) {
+		dm->downsample_passes = (int)round(log2(dm->downsample));
+		dm->downsample = 1 << dm->downsample_passes;
+	}
+	dm->rate_in = (uint32_t)(rate / dm->downsample);
+	dm->rate_out = dm->rate_in / dm->post_downsample;
+	if (verbosity) {
+		fprintf(stderr, "input: downsample = %d, rate_in = %d\n", dm->downsample, dm->rate_in);}
+}
+
 void sanity_checks(void)
 {
 	if (controller.freq_len == 0) {
@@ -1215,13 +1191,17 @@ int main(int argc, char **argv)
 	int timeConstant = 75; /* default: U.S. 75 uS */
 	int rtlagc = 0;
 	char *antenna_str = NULL;
+	char *metrics_dest = NULL;
+	/* 8 bit devices save half the copying, widened by the SIMD kernels */
+	const char *formats[] = {SOAPY_SDR_CS16, SOAPY_SDR_CS8, SOAPY_SDR_CU8, NULL};
 	dongle_init(&dongle);
 	demod_init(&demod);
 	output_init(&output);
 	controller_init(&controller);
 	dongle.dev_query = "";
+	stats.interval = 1.0;
 
-	while ((opt = getopt(argc, argv, "a:C:d:f:g:s:b:l:L:o:t:r:p:E:q:F:A:M:c:h:w:v")) != -1) {
+	while ((opt = getopt(argc, argv, "a:C:d:f:g:s:b:l:L:o:t:r:p:E:q:F:A:M:c:h:w:S:I:x:v")) != -1) {
 		switch (opt) {
 		case 'a':
 			antenna_str = optarg;
@@ -1298,10 +1278,32 @@ int main(int argc, char **argv)
 				demod.squelch_zero = 1;}
 			if (strcmp("wav",  optarg) == 0) {
 				output.wav_format = 1;}
+			if (strcmp("zerocopy",  optarg) == 0) {
+				dongle.zero_copy = 1;}
 			break;
 		case 'q':
 			demod.rdc_block_const = atoi(optarg);
 			break;
+		case 'b':
+			demod.ring_depth = atoi(optarg);
+			if (demod.ring_depth < 1) {
+				fprintf(stderr, "Ring depth must be at least 1\n");
+				exit(1);
+			}
+			break;
+		case 'S':
+			stats.filename = optarg;
+			break;
+		case 'I':
+			stats.interval = atof(optarg);
+			if (stats.interval <= 0) {
+				fprintf(stderr, "Stats interval must be positive\n");
+				exit(1);
+			}
+			break;
+		case 'x':
+			metrics_dest = optarg;
+			break;
 		case 'F':
 			demod.downsample_passes = 1;  /* truthy placeholder */
 			demod.comp_fir_size = atoi(optarg);
@@ -1367,9 +1369,22 @@ int main(int argc, char **argv)
 	if (verbosity)
 		fprintf(stderr, "verbosity set to %d\n", verbosity);
 
+	fprintf(stderr, "Using %s DSP kernels.\n", dsp_init());
+
 	/* quadruple sample_rate to limit to Δθ to ±π/2 */
 	demod.rate_in *= demod.post_downsample;
 
+	r = verbose_input_open(dongle.dev_query, &input);
+	if (r < 0) {
+		exit(1);}
+	if (r > 0) {
+		dongle.input = &input;
+		dongle.format = input.format;
+		dongle.elem_size = input.elem_size;
+		if (!input.tunable) {
+			input_settings(&dongle, &demod);}
+	}
+
 	if (!output.rate) {
 		output.rate = demod.rate_out;}
 
@@ -1386,13 +1401,22 @@ int main(int argc, char **argv)
 
 	ACTUAL_BUF_LENGTH = lcm_post[demod.post_downsample] * DEFAULT_BUF_LENGTH;
 
-	tmp_stdout = suppress_stdout_start();
-	verbose_device_search(dongle.dev_query, &dongle.dev);
-	if (!dongle.dev) {
-		fprintf(stderr, "Failed to open sdr device matching '%s'.\n", dongle.dev_query);
+	if (pipeline_init(&dongle, &demod, &output, demod.ring_depth) != 0) {
+		fprintf(stderr, "Failed to allocate %i sample blocks\n", demod.ring_depth);
 		exit(1);
 	}
-	verbose_setup_stream(dongle.dev, &dongle.stream, dongle.channel, SOAPY_SDR_CS16);
+
+	tmp_stdout = suppress_stdout_start();
+	if (!dongle.input) {
+		verbose_device_search(dongle.dev_query, &dongle.dev);
+		if (!dongle.dev) {
+			fprintf(stderr, "Failed to open sdr device matching '%s'.\n", dongle.dev_query);
+			exit(1);
+		}
+		dongle.format = verbose_native_format(dongle.dev, dongle.channel, formats);
+		dongle.elem_size = SoapySDR_formatToSize(dongle.format);
+		verbose_setup_stream(dongle.dev, &dongle.stream, dongle.channel, dongle.format);
+	}
 
 #ifndef _WIN32
 	sigact.sa_handler = sighandler;
@@ -1414,37 +1438,39 @@ int main(int argc, char **argv)
 			fprintf(stderr, "using wbfm deemphasis filter with time constant %d us\n", timeConstant );
 	}
 
-	/* Set the antenna */
-	if (NULL != antenna_str) {
-		r = verbose_antenna_str_set(dongle.dev, dongle.channel, antenna_str);
-		if (r != 0) {
-			fprintf(stderr, "Failed to set antenna");
+	if (!dongle.input) {
+		/* Set the antenna */
+		if (NULL != antenna_str) {
+			r = verbose_antenna_str_set(dongle.dev, dongle.channel, antenna_str);
+			if (r != 0) {
+				fprintf(stderr, "Failed to set antenna");
+			}
 		}
-	}
 
-	/* Set the tuner gain */
-	if (dongle.gain_str == NULL) {
-		verbose_auto_gain(dongle.dev, dongle.channel);
-	} else {
-		verbose_gain_str_set(dongle.dev, dongle.gain_str, dongle.channel);
-	}
+		/* Set the tuner gain */
+		if (dongle.gain_str == NULL) {
+			verbose_auto_gain(dongle.dev, dongle.channel);
+		} else {
+			verbose_gain_str_set(dongle.dev, dongle.gain_str, dongle.channel);
+		}
 
-	SoapySDRDevice_setGainMode(dongle.dev, SOAPY_SDR_RX, dongle.channel, rtlagc);
+		SoapySDRDevice_setGainMode(dongle.dev, SOAPY_SDR_RX, dongle.channel, rtlagc);
 
-	if (custom_ppm) verbose_ppm_set(dongle.dev, dongle.ppm_error, dongle.channel);
+		if (custom_ppm) verbose_ppm_set(dongle.dev, dongle.ppm_error, dongle.channel);
 
- 	verbose_set_bandwidth(dongle.dev, dongle.bandwidth, dongle.channel);
+		verbose_set_bandwidth(dongle.dev, dongle.bandwidth, dongle.channel);
 
-	if (verbosity && dongle.bandwidth)
-	{
-		fprintf(stderr, "Supported bandwidth values in kHz:\n");
-		size_t bw_count = 0;
-		// TODO: well, this is deprecated by getBandwidthRange? SoapySDRRange
-		double *bandwidths = SoapySDRDevice_listBandwidths(dongle.dev, SOAPY_SDR_RX, dongle.channel, &bw_count);
-		for (size_t k = 0; k < bw_count; ++k) {
-			fprintf(stderr, "%.1f ", bandwidths[k]);
+		if (verbosity && dongle.bandwidth)
+		{
+			fprintf(stderr, "Supported bandwidth values in kHz:\n");
+			size_t bw_count = 0;
+			// TODO: well, this is deprecated by getBandwidthRange? SoapySDRRange
+			double *bandwidths = SoapySDRDevice_listBandwidths(dongle.dev, SOAPY_SDR_RX, dongle.channel, &bw_count);
+			for (size_t k = 0; k < bw_count; ++k) {
+				fprintf(stderr, "%.1f ", bandwidths[k]);
+			}
+			fprintf(stderr,"\n");
 		}
-		fprintf(stderr,"\n");
 	}
 
 	if (strcmp(output.filename, "-") == 0) { /* Write samples to stdout */
@@ -1460,40 +1486,79 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (stats.filename && strcmp(stats.filename, "-") == 0) {
+		stats.file = stderr;
+	} else if (stats.filename) {
+		stats.file = fopen(stats.filename, "w");
+		if (!stats.file) {
+			fprintf(stderr, "Failed to open %s\n", stats.filename);
+			exit(1);
+		}
+	}
+	stats.enabled = stats.file != NULL;
+
+	hops_metric = metric_new(METRIC_COUNTER, "rx_fm_hops_total", "Scanner hops to the next frequency.", 1.0);
+	squelch_metric = metric_new(METRIC_GAUGE, "rx_fm_squelch_closed", "1 while the squelch mutes the output.", 1.0);
+	if (metrics_dest && verbose_metrics_start(metrics_dest, "rx_fm") != 0) {
+		exit(1);}
+
 	//r = rtlsdr_set_testmode(dongle.dev, 1);
 
 	/* Reset endpoint before we start reading from it (mandatory) */
-	verbose_reset_buffer(dongle.dev);
+	if (!dongle.input) {
+		verbose_reset_buffer(dongle.dev);}
 
 	pthread_create(&controller.thread, NULL, controller_thread_fn, (void *)(&controller));
 	usleep(100000);
+	if (demod_filters_init(&demod) != 0) {
+		fprintf(stderr, "Failed to set up the filters\n");
+		exit(1);
+	}
 	pthread_create(&output.thread, NULL, output_thread_fn, (void *)(&output));
 	pthread_create(&demod.thread, NULL, demod_thread_fn, (void *)(&demod));
 	pthread_create(&dongle.thread, NULL, dongle_thread_fn, (void *)(&dongle));
+	if (stats.enabled) {
+		stats.start_ns = now_ns();
+		pthread_create(&stats.thread, NULL, stats_thread_fn, NULL);
+	}
 
 	while (!do_exit) {
 		usleep(100000);
 	}
 
-	SoapySDRDevice_deactivateStream(dongle.dev, dongle.stream, 0, 0);
+	if (!dongle.input) {
+		SoapySDRDevice_deactivateStream(dongle.dev, dongle.stream, 0, 0);}
+	ring_close(&dongle.pool);
 	pthread_join(dongle.thread, NULL);
-	safe_cond_signal(&demod.ready, &demod.ready_m);
+	ring_close(&demod.ring);
 	pthread_join(demod.thread, NULL);
-	safe_cond_signal(&output.ready, &output.ready_m);
+	ring_close(&output.ring);
 	pthread_join(output.thread, NULL);
 	safe_cond_signal(&controller.hop, &controller.hop_m);
 	pthread_join(controller.thread, NULL);
+	if (stats.enabled) {
+		pthread_join(stats.thread, NULL);
+		stats_dump();
+		if (stats.file != stderr) {
+			fclose(stats.file);}
+	}
+
+	metrics_stop();
 
 	//dongle_cleanup(&dongle);
-	demod_cleanup(&demod);
-	output_cleanup(&output);
+	pipeline_cleanup(&dongle, &demod, &output);
 	controller_cleanup(&controller);
 
 	if (output.file != stdout) {
 		fclose(output.file);}
 
-	SoapySDRDevice_closeStream(dongle.dev, dongle.stream);
-	SoapySDRDevice_unmake(dongle.dev);
+	if (dongle.input) {
+		input_report(dongle.input);
+		input_close(dongle.input);
+	} else {
+		SoapySDRDevice_closeStream(dongle.dev, dongle.stream);
+		SoapySDRDevice_unmake(dongle.dev);
+	}
 	return EXIT_SUCCESS;
 }
 
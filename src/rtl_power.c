@@ -27,13 +27,11 @@
  * time, low, high, step, db, db, db ...
  * db optional?  raw output might be better for noise correction
  * todo:
- *	threading
  *	randomized hopping
  *	noise correction
  *	continuous IIR
  *	general astronomy usefulness
  *	multiple dongles
- *	multiple FFT workers
  *	check edge cropping for off-by-one and rounding errors
  *	1.8MS/s for hiding xtal harmonics
  */
@@ -63,10 +61,16 @@
 #include <pthread.h>
 
 #include "convenience.h"
+#include "kernels.h"
+#include "fft.h"
+#include "ring.h"
+#include "power.h"
+#include "fir.h"
 #include <SoapySDR/Device.h>
 #include <SoapySDR/Formats.h>
 
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
 
 #define DEFAULT_BUF_LENGTH		(1 * 16384)
 #define BUFFER_DUMP				DEFAULT_BUF_LENGTH
@@ -77,42 +81,47 @@
 static volatile int do_exit = 0;
 static SoapySDRDevice *dev = NULL;
 static SoapySDRStream *stream = NULL;
+static struct stream_reader reader;
+static const char *stream_format = SOAPY_SDR_CS16;
+static uint8_t *buf8 = NULL;  /* readStream target for 8 bit formats */
+static struct iq_input input;
+static int input_mode = 0;  /* another tool's samples, a single hop */
+static struct metric *retunes_metric, *retune_time_metric;
+static int input_ended = 0;
 FILE *file;
 
-int16_t* Sinewave;
-double* power_table;
-int N_WAVE, LOG2_N_WAVE;
-int next_power;
-int16_t *fft_buf;
-int *window_coefs;
+float *window_coefs;
+struct fft_plan *fft_plan;
 
-struct tuning_state
-/* one per tuning range */
+struct tuning_state *tunes = NULL;
+int tune_count = 0;
+
+#define CIC_TABLE_MAX 10
+
+/* hop rate limits, from the device when it reports them */
+int64_t maximum_rate = MAXIMUM_RATE;
+int64_t minimum_rate = MINIMUM_RATE;
+
+struct fft_worker
+/* one per FFT thread, tunes are dealt round robin so avg[] needs no lock */
 {
-	int64_t freq;
-	int rate;
-	int bin_e;
-	int64_t *avg;  /* length == 2^bin_e */
-	int samples;
-	int downsample;
-	int downsample_passes;  /* for the recursive filter */
-	double crop;
-	//pthread_rwlock_t avg_lock;
-	//pthread_mutex_t avg_mutex;
-	/* having the iq buffer here is wasteful, but will avoid contention */
-	int16_t *buf16;
-	int buf_len;
-	//int *comp_fir;
-	//pthread_rwlock_t buf_lock;
-	//pthread_mutex_t buf_mutex;
+	pthread_t thread;
+	int16_t *fft_buf;
+	float *fft_out;
+	struct ring_buffer jobs;  /* tuning_state pointers from the scanner */
+	struct fir_filter droop[CIC_TABLE_MAX + 1];  /* by downsample_passes, with -F 9 */
 };
 
-/* 10000 is enough for 10GHz b/w worst case */
-#define MAX_TUNES	10000
-struct tuning_state tunes[MAX_TUNES];
-int tune_count = 0;
+#define MAX_WORKERS	64
+struct fft_worker workers[MAX_WORKERS];
+int worker_count = 1;
+/* tunes handed out but not yet integrated, the report waits for zero */
+static int jobs_pending = 0;
+static pthread_mutex_t jobs_m = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobs_done = PTHREAD_COND_INITIALIZER;
 
 int boxcar = 1;
+static int tuner_sleep_usec = 5000;
 int comp_fir_size = 0;
 int peak_hold = 0;
 
@@ -131,11 +140,20 @@ void usage(void)
 		"\t[-C channel number (ex: 0)]\n"
 		"\t[-a antenna (ex: 'Tuner 1 50 ohm')]\n"
 		//"\t[-s avg/iir smoothing (default: avg)]\n"
-		//"\t[-t threads (default: 1)]\n"
+		"\t[-t threads (default: 1)]\n"
+		"\t (FFT workers, hops are spread across them)\n"
 		"\t[-d device key/value query (ex: 0, 1, driver=rtlsdr, driver=hackrf)]\n"
+		"\t	shm=name: the samples of rx_sdr -P name, its band in a single hop\n"
+		"\t	file=path,rate=Hz,freq=Hz[,format=CU8]: a recording, as fast as possible\n"
+		"\t	synth=[signals][,format=CU8][,samples=N][,realtime=1]: generated, swept like a device\n"
 		"\t[-g tuner gain(s) (ex: 20, 40, LNA=40,VGA=20,AMP=0)]\n"
 		"\t[-p ppm_error (default: 0)]\n"
 		"\t[-S tuner_sleep_usec (default: 5000)]\n"
+		"\t (settle time after the tune, with sample timestamps\n"
+		"\t  only the samples before it are dropped, no sleep)\n"
+		"\t[-T settle_table (default: none, -S for every hop)]\n"
+		"\t (per hop settle times for this device, see -K)\n"
+		"\t[-K calibrates the range into settle_table and exits]\n"
 		"\t[-R tuner_retry_max (default: 3)]\n"
 		"\tfilename (a '-' dumps samples to stdout)\n"
 		"\t (omitting the filename also uses stdout)\n"
@@ -154,6 +172,10 @@ void usage(void)
 		"\t[-P enables peak hold (default: off)]\n"
 		"\t[-D direct_sampling_mode, 0 (default/off), 1 (I), 2 (Q), 3 (no-mod)]\n"
 		"\t[-O enable offset tuning (default: off)]\n"
+		"\t[-B fft_backend (default: auto)]\n"
+		"\t (auto, builtin, fftw)\n"
+		"\t[-Z read the driver's buffers directly, when supported]\n"
+		"\t[-x metrics, Prometheus text on unix:path or rewritten to a file (default: off)]\n"
 		"\n"
 		"CSV FFT output columns:\n"
 		"\tdate, time, Hz low, Hz high, Hz step, samples, dbm, dbm, ...\n\n"
@@ -209,7 +231,6 @@ static void sighandler(int signum)
 
 /* {length, coef, coef, coef}  and scaled by 2^15
    for now, only length 9, optimal way to get +85% bandwidth */
-#define CIC_TABLE_MAX 10
 int cic_9_tables[][10] = {
 	{0,},
 	{9, -156,  -97, 2798, -15489, 61019, -15489, 2798,  -97, -156},
@@ -223,6 +244,7 @@ int cic_9_tables[][10] = {
 	{9, -119, -577, 5917, -26067, 77473, -26067, 5917, -577, -119},
 	{9, -199, -362, 5303, -25505, 77489, -25505, 5303, -362, -199},
 };
+struct fir_taps *droop_taps[CIC_TABLE_MAX + 1];
 
 #if defined(_MSC_VER) && (_MSC_VER < 1800)
 double log2(double n)
@@ -231,94 +253,6 @@ double log2(double n)
 }
 #endif
 
-/* FFT based on fix_fft.c by Roberts, Slaney and Bouras
-   http://www.jjj.de/fft/fftpage.html
-   16 bit ints for everything
-   -32768..+32768 maps to -1.0..+1.0
-*/
-
-void sine_table(int size)
-{
-	int i;
-	double d;
-	LOG2_N_WAVE = size;
-	N_WAVE = 1 << LOG2_N_WAVE;
-	Sinewave = malloc(sizeof(int16_t) * N_WAVE*3/4);
-	power_table = malloc(sizeof(double) * N_WAVE);
-	for (i=0; i<N_WAVE*3/4; i++)
-	{
-		d = (double)i * 2.0 * M_PI / N_WAVE;
-		Sinewave[i] = (int)round(32767*sin(d));
-		//printf("%i\n", Sinewave[i]);
-	}
-}
-
-int16_t FIX_MPY(int16_t a, int16_t b)
-/* fixed point multiply and scale */
-{
-	int c = ((int)a * (int)b) >> 14;
-	b = c & 0x01;
-	return (c >> 1) + b;
-}
-
-int fix_fft(int16_t iq[], int m)
-/* interleaved iq[], 0 <= n < 2**m, changes in place */
-{
-	int mr, nn, i, j, l, k, istep, n, shift;
-	int16_t qr, qi, tr, ti, wr, wi;
-	n = 1 << m;
-	if (n > N_WAVE)
-		{return -1;}
-	mr = 0;
-	nn = n - 1;
-	/* decimation in time - re-order data */
-	for (m=1; m<=nn; ++m) {
-		l = n;
-		do
-			{l >>= 1;}
-		while (mr+l > nn);
-		mr = (mr & (l-1)) + l;
-		if (mr <= m)
-			{continue;}
-		// real = 2*m, imag = 2*m+1
-		tr = iq[2*m];
-		iq[2*m] = iq[2*mr];
-		iq[2*mr] = tr;
-		ti = iq[2*m+1];
-		iq[2*m+1] = iq[2*mr+1];
-		iq[2*mr+1] = ti;
-	}
-	l = 1;
-	k = LOG2_N_WAVE-1;
-	while (l < n) {
-		shift = 1;
-		istep = l << 1;
-		for (m=0; m<l; ++m) {
-			j = m << k;
-			wr =  Sinewave[j+N_WAVE/4];
-			wi = -Sinewave[j];
-			if (shift) {
-				wr >>= 1; wi >>= 1;}
-			for (i=m; i<n; i+=istep) {
-				j = i + l;
-				tr = FIX_MPY(wr,iq[2*j]) - FIX_MPY(wi,iq[2*j+1]);
-				ti = FIX_MPY(wr,iq[2*j+1]) + FIX_MPY(wi,iq[2*j]);
-				qr = iq[2*i];
-				qi = iq[2*i+1];
-				if (shift) {
-					qr >>= 1; qi >>= 1;}
-				iq[2*j] = qr - tr;
-				iq[2*j+1] = qi - ti;
-				iq[2*i] = qr + tr;
-				iq[2*i+1] = qi + ti;
-			}
-		}
-		--k;
-		l = istep;
-	}
-	return 0;
-}
-
 double rectangle(int i, int length)
 {
 	return 1.0;
@@ -400,35 +334,100 @@ double bartlett(int i, int length)
 	return w;
 }
 
-void rms_power(struct tuning_state *ts)
-/* for bins between 1MHz and 2MHz */
+int hop_count(int64_t span, double crop, int64_t rate)
+/* fewest evenly sized hops that fit in rate */
 {
-	int i, s;
-	int16_t *buf = ts->buf16;
-	int buf_len = ts->buf_len;
-	int64_t p, t;
-	double dc, err;
-
-	p = t = 0L;
-	for (i=0; i<buf_len; i++) {
-		s = (int)buf[i];
-		t += (int64_t)s;
-		p += (int64_t)s * (int64_t)s;
-	}
-	/* correct for dc offset in squares */
-	dc = (double)t / (double)buf_len;
-	err = t * 2 * dc - dc * dc * buf_len;
-	p -= (int64_t)round(err);
+	int i;
+	i = (int)((double)span / ((double)rate * (1.0 - crop)));
+	if (i < 1) {
+		i = 1;}
+	while ((int64_t)((double)(span / i) / (1.0 - crop)) > rate) {
+		i++;}
+	return i;
+}
 
-	if (!peak_hold) {
-		ts->avg[0] += p;
-	} else {
-		ts->avg[0] = MAX(ts->avg[0], p);
+double sweep_cost(int64_t span, int64_t max_size, double crop, int64_t rate)
+/* estimated seconds per sweep, hops x (settle + capture) */
+{
+	int hops, bins = 1;
+	int64_t bw_used, capture;
+	hops = hop_count(span, crop, rate);
+	bw_used = (int64_t)((double)(span / hops) / (1.0 - crop));
+	if (bw_used < minimum_rate) {
+		bw_used = rate;}
+	while (bins < (1<<21) && (double)bw_used / bins > (double)max_size) {
+		bins <<= 1;}
+	capture = MAX(2 * bins, DEFAULT_BUF_LENGTH);
+	return hops * ((double)tuner_sleep_usec / 1e6 + (double)capture / (double)bw_used);
+}
+
+void device_rates(size_t channel, int64_t span, int64_t max_size, double crop)
+/* pick the hop rate with the shortest sweep from what the device offers */
+{
+	size_t i, n = 0, ranges_len = 0, list_len = 0, bws_len = 0;
+	int64_t cap = INT64_MAX, lowest = INT64_MAX, *candidates;
+	double cost, best_cost = 0.0, best_bw = 0.0;
+	SoapySDRRange *ranges, *bws;
+	double *list;
+	char *driver;
+	if (input_mode) {
+		/* a synthetic input takes any rate, the defaults will do */
+		if (!input.tunable) {
+			maximum_rate = minimum_rate = (int64_t)input.rate;}
+		return;
+	}
+	ranges = SoapySDRDevice_getSampleRateRange(dev, SOAPY_SDR_RX, channel, &ranges_len);
+	list = SoapySDRDevice_listSampleRates(dev, SOAPY_SDR_RX, channel, &list_len);
+	if (ranges_len + list_len == 0) {
+		return;}
+	/* the rtl reports 3.2 MS/s but drops samples above 2.8 */
+	driver = SoapySDRDevice_getDriverKey(dev);
+	if (driver && strcmp(driver, "RTLSDR") == 0) {
+		cap = MAXIMUM_RATE;}
+	free(driver);
+	/* the analog filter limits the usable rate too */
+	bws = SoapySDRDevice_getBandwidthRange(dev, SOAPY_SDR_RX, channel, &bws_len);
+	for (i=0; i<bws_len; i++) {
+		best_bw = MAX(best_bw, bws[i].maximum);}
+	free(bws);
+	if (best_bw > 0.0 && (int64_t)best_bw < cap) {
+		cap = (int64_t)best_bw;}
+	candidates = malloc((ranges_len + list_len) * sizeof(int64_t));
+	if (!candidates) {
+		fprintf(stderr, "Error: malloc.\n");
+		exit(1);
 	}
-	ts->samples += 1;
+	for (i=0; i<ranges_len; i++) {
+		lowest = MIN(lowest, (int64_t)ranges[i].minimum);
+		if ((int64_t)ranges[i].minimum <= cap) {
+			candidates[n++] = MIN((int64_t)ranges[i].maximum, cap);}
+	}
+	for (i=0; i<list_len; i++) {
+		lowest = MIN(lowest, (int64_t)list[i]);
+		if ((int64_t)list[i] <= cap) {
+			candidates[n++] = (int64_t)list[i];}
+	}
+	free(ranges);
+	free(list);
+	if (lowest > minimum_rate && lowest != INT64_MAX) {
+		minimum_rate = lowest;}
+	for (i=0; i<n; i++) {
+		if (candidates[i] < minimum_rate) {
+			continue;}
+		cost = sweep_cost(span, max_size, crop, candidates[i]);
+		/* ties go to the lower rate, it is cheaper to process */
+		if (best_cost == 0.0 || cost < best_cost * 0.999 ||
+		    (cost <= best_cost * 1.001 && candidates[i] < maximum_rate)) {
+			best_cost = cost;
+			maximum_rate = candidates[i];
+		}
+	}
+	free(candidates);
+	if (best_cost > 0.0) {
+		fprintf(stderr, "Hop rate: %lli S/s (estimated sweep %.2fs)\n", (long long)maximum_rate, best_cost);}
 }
 
-void frequency_range(char *arg, double crop)
+void frequency_range(char *arg, double crop, size_t channel)
 /* flesh out the tunes[] for scanning */
 // do we want the fewest ranges (easy) or the fewest bins (harder)?
 {
@@ -451,22 +450,23 @@ void frequency_range(char *arg, double crop)
 	step[-1] = ':';
 	downsample = 1;
 	downsample_passes = 0;
-	/* evenly sized ranges, as close to MAXIMUM_RATE as possible */
-	// todo, replace loop with algebra
-	for (i=1; i<1500; i++) {
-		bw_seen = (upper - lower) / i;
-		bw_used = (int64_t)((double)(bw_seen) / (1.0 - crop));
-		if (bw_used > MAXIMUM_RATE) {
-			continue;}
-		tune_count = i;
-		break;
+	if (input_mode && !input.tunable) {
+		/* whatever the producer is tuned to, only the bin size is ours */
+		lower = (int64_t)(input.freq - input.rate / 2);
+		upper = lower + (int64_t)input.rate;
+		fprintf(stderr, "Input covers %lli to %lli Hz, in a single hop.\n", (long long)lower, (long long)upper);
 	}
+	device_rates(channel, upper - lower, max_size, crop);
+	/* evenly sized ranges, as close to maximum_rate as possible */
+	tune_count = hop_count(upper - lower, crop, maximum_rate);
+	bw_seen = (upper - lower) / tune_count;
+	bw_used = (int64_t)((double)(bw_seen) / (1.0 - crop));
 	/* unless small bandwidth */
-	if (bw_used < MINIMUM_RATE) {
+	if (bw_used < minimum_rate) {
 		tune_count = 1;
-		downsample = MAXIMUM_RATE / bw_used;
+		downsample = maximum_rate / bw_used;
 		if (downsample <= 0) {
-			fprintf(stderr, "unsupported bandwidth: MAXIMUM_RATE=%d, bw_used=%lli, downsample=%lli\n", MAXIMUM_RATE, (long long)bw_used, (long long)downsample);
+			fprintf(stderr, "unsupported bandwidth: maximum_rate=%lli, bw_used=%lli, downsample=%lli\n", (long long)maximum_rate, (long long)bw_used, (long long)downsample);
 			exit(1);
 		}
 		bw_used = bw_used * downsample;
@@ -475,7 +475,7 @@ void frequency_range(char *arg, double crop)
 		downsample_passes = (int)log2(downsample);
 		downsample = 1 << downsample_passes;
 		if (downsample <= 0) {
-			fprintf(stderr, "unsupported bandwidth: MAXIMUM_RATE=%d, downsample_passes=%lli, bw_used=%lli, downsample=%lli\n", MAXIMUM_RATE, (long long)downsample_passes, (long long)bw_used, (long long)downsample);
+			fprintf(stderr, "unsupported bandwidth: maximum_rate=%lli, downsample_passes=%lli, bw_used=%lli, downsample=%lli\n", (long long)maximum_rate, (long long)downsample_passes, (long long)bw_used, (long long)downsample);
 			exit(1);
 		}
 		bw_used = (int)((double)(bw_seen * downsample) / (1.0 - crop));
@@ -490,15 +490,16 @@ void frequency_range(char *arg, double crop)
 			break;}
 	}
 	/* unless giant bins */
-	if (max_size >= MINIMUM_RATE) {
+	if (max_size >= MINIMUM_RATE && (!input_mode || input.tunable)) {
 		bw_seen = max_size;
 		bw_used = max_size;
 		tune_count = (upper - lower) / bw_seen;
 		bin_e = 0;
 		crop = 0;
 	}
-	if (tune_count > MAX_TUNES) {
-		fprintf(stderr, "Error: bandwidth too wide.\n");
+	tunes = calloc(tune_count, sizeof(struct tuning_state));
+	if (!tunes) {
+		fprintf(stderr, "Error: malloc.\n");
 		exit(1);
 	}
 	buf_len = 2 * (1<<bin_e) * downsample;
@@ -515,13 +516,14 @@ void frequency_range(char *arg, double crop)
 		ts->crop = crop;
 		ts->downsample = downsample;
 		ts->downsample_passes = downsample_passes;
-		ts->avg = (int64_t*)malloc((1<<bin_e) * sizeof(int64_t));
+		ts->settle_usec = -1;
+		ts->avg = (double*)malloc((1<<bin_e) * sizeof(double));
 		if (!ts->avg) {
 			fprintf(stderr, "Error: malloc.\n");
 			exit(1);
 		}
 		for (j=0; j<(1<<bin_e); j++) {
-			ts->avg[j] = 0L;
+			ts->avg[j] = 0.0;
 		}
 		ts->buf16 = (int16_t*)malloc(buf_len * SoapySDR_formatToSize(SOAPY_SDR_CS16));
 		if (!ts->buf16) {
@@ -543,12 +545,68 @@ void frequency_range(char *arg, double crop)
 }
 
 static int16_t dump[BUFFER_DUMP * sizeof(int16_t) * 2] = {0};
-static int tuner_sleep_usec = 5000;
 static int tuner_retry_max = 3;
-void retune(SoapySDRDevice *d, SoapySDRStream *s, int64_t freq, size_t channel)
+static int hw_time = 0;  /* the stream timestamps its samples */
+
+void widen(const void *raw, int16_t *buf, int elems)
+/* stream_format samples into buf as CS16 */
+{
+	if (strcmp(stream_format, SOAPY_SDR_CS8) == 0) {
+		dsp.cs8_to_cs16(raw, buf, 2 * elems);
+	} else if (strcmp(stream_format, SOAPY_SDR_CU8) == 0) {
+		dsp.cu8_to_cs16(raw, buf, 2 * elems);
+	} else if (strcmp(stream_format, SOAPY_SDR_CS12) == 0) {
+		dsp.cs12_to_cs16(raw, buf, 2 * elems);
+	} else if (strcmp(stream_format, SOAPY_SDR_CF32) == 0) {
+		dsp.cf32_to_cs16(raw, buf, 2 * elems);
+	} else if (raw != buf) {
+		memcpy(buf, raw, elems * 2 * sizeof(int16_t));}
+}
+
+int settle_discard(long long deadline, int rate)
+/* drop samples up to the first one taken at deadline, 1 if untimed */
+{
+	int r = -1, i = 0, n, flags;
+	long long timeNs, next;
+	const void *raw;
+	/* a short probe, the backlog may already be past the deadline,
+	   driver buffers go whole and are never copied */
+	n = BUFFER_DUMP / 16;
+	while (i < tuner_retry_max) {
+		flags = 0;
+		timeNs = 0;
+		r = stream_acquire(&reader, &raw, dump, n, &flags, &timeNs, 1000000);
+		if (r >= 0) {
+			stream_release(&reader);}
+		if (r <= 0) {
+			i++;
+			continue;
+		}
+		if (!(flags & SOAPY_SDR_HAS_TIME)) {
+			return 1;}
+		next = timeNs + (long long)r * 1000000000LL / rate;
+		if (next >= deadline) {
+			return 0;}
+		/* just the rest, the next read starts with fresh samples */
+		n = (int)(((deadline - next) * rate + 999999999LL) / 1000000000LL);
+		if (n > BUFFER_DUMP) {
+			n = BUFFER_DUMP;}
+	}
+	return r < 0 ? r : -1;
+}
+
+void retune(SoapySDRDevice *d, struct tuning_state *ts, size_t channel)
 {
-	int r, i;
+	int r, i, settle;
+	long long tuned;
+	int64_t freq = ts->freq;
 
+	/* nothing to settle, the next block is already at freq */
+	if (input_mode) {
+		input_set_frequency(&input, (double)freq);
+		return;
+	}
+	settle = ts->settle_usec >= 0 ? ts->settle_usec : tuner_sleep_usec;
 	SoapySDRKwargs args = {0};
 	r = SoapySDRDevice_setFrequency(d, SOAPY_SDR_RX, channel, (double)freq, &args);
 	if (r != 0) {
@@ -556,16 +614,33 @@ void retune(SoapySDRDevice *d, SoapySDRStream *s, int64_t freq, size_t channel)
 		return;
 	}
 
+	if (hw_time) {
+		/* the tune has taken effect by the time setFrequency returns */
+		tuned = SoapySDRDevice_getHardwareTime(d, NULL);
+		r = settle_discard(tuned + (long long)settle * 1000LL, ts->rate);
+		if (r == 0) {
+			return;}
+		if (r == 1) {
+			fprintf(stderr, "Warning: no sample timestamps, falling back to -S sleeps.\n");
+			hw_time = 0;
+		} else {
+			fprintf(stderr, "Error: bad retune at %lli Hz, r=%d (try increasing -R).\n", (long long)freq, r);
+			return;
+		}
+	}
+
 	/* wait for settling and flush buffer */
-	usleep(tuner_sleep_usec);
+	usleep(settle);
 
-	void *buffs[] = {dump};
+	const void *raw;
 	int flags = 0;
 	long long timeNs = 0;
 	long timeoutNs = 1000000;
 
 	for (i = 0; i < tuner_retry_max; ++i) {
-		r = SoapySDRDevice_readStream(dev, stream, buffs, BUFFER_DUMP, &flags, &timeNs, timeoutNs);
+		r = stream_acquire(&reader, &raw, dump, BUFFER_DUMP, &flags, &timeNs, timeoutNs);
+		if (r >= 0) {
+			stream_release(&reader);}
 		if (r < 0) {
 			//fprintf(stderr, "Warning: attempt #%d of %d, bad retune at %lli Hz, r=%d, flags=%d\n", i + 1, tuner_retry_max, freq, r, flags);
 			// only logged if all attempts failed below
@@ -579,242 +654,427 @@ void retune(SoapySDRDevice *d, SoapySDRStream *s, int64_t freq, size_t channel)
 		fprintf(stderr, "Error: bad retune at %lli Hz (%i of %i attempts), r=%d, flags=%d (try increasing -S or -R).\n", (long long)freq, i + 1, tuner_retry_max, r, flags);}
 }
 
-void fifth_order(int16_t *data, int length)
-/* for half of interleaved data */
+/* settle calibration: short blocks after a retune until the power is steady */
+#define CAL_BLOCK		512
+#define CAL_WINDOW_USEC		100000
+#define CAL_TRIALS		3
+#define CAL_TOLERANCE_DB	1.0
+
+void device_id(SoapySDRDevice *d, char *buf, size_t len)
+/* driver, hardware and serial (when known) */
 {
-	int i;
-	int a, b, c, d, e, f;
-	a = data[0];
-	b = data[2];
-	c = data[4];
-	d = data[6];
-	e = data[8];
-	f = data[10];
-	/* a downsample should improve resolution, so don't fully shift */
-	/* ease in instead of being stateful */
-	data[0] = ((a+b)*10 + (c+d)*5 + d + f) >> 4;
-	data[2] = ((b+c)*10 + (a+d)*5 + e + f) >> 4;
-	data[4] = (a + (b+e)*5 + (c+d)*10 + f) >> 4;
-	for (i=12; i<length; i+=4) {
-		a = c;
-		b = d;
-		c = e;
-		d = f;
-		e = data[i-2];
-		f = data[i];
-		data[i/2] = (a + (b+e)*5 + (c+d)*10 + f) >> 4;
+	size_t i;
+	const char *serial = "";
+	char *driver = SoapySDRDevice_getDriverKey(d);
+	char *hw = SoapySDRDevice_getHardwareKey(d);
+	SoapySDRKwargs info = SoapySDRDevice_getHardwareInfo(d);
+	for (i=0; i<info.size; i++) {
+		if (strcmp(info.keys[i], "serial") == 0) {
+			serial = info.vals[i];}
 	}
+	snprintf(buf, len, "%s,%s,%s", driver ? driver : "", hw ? hw : "", serial);
+	SoapySDRKwargs_clear(&info);
+	free(driver);
+	free(hw);
 }
 
-void remove_dc(int16_t *data, int length)
-/* works on interleaved data */
+double block_db(int16_t *buf, int len)
 {
 	int i;
-	int16_t ave;
-	int64_t sum = 0L;
-	for (i=0; i < length; i+=2) {
-		sum += data[i];
+	double p = 0.0;
+	for (i=0; i<2*len; i++) {
+		p += (double)buf[i] * (double)buf[i];}
+	return 10 * log10(p / len + 1.0);
+}
+
+int measure_settle(size_t channel, struct tuning_state *from, struct tuning_state *to)
+/* usec from the tune until the block power stays near its final level */
+{
+	int i, r, blocks, steady, flags;
+	long long timeNs, tuned = 0, samples = 0;
+	double ref, *db, *end_usec;
+	int16_t cal[2 * CAL_BLOCK];
+	void *buffs[] = {dump};
+	SoapySDRKwargs args = {0};
+	blocks = (int)((double)to->rate * CAL_WINDOW_USEC / 1e6 / CAL_BLOCK);
+	if (blocks < 8) {
+		blocks = 8;}
+	db = malloc(blocks * sizeof(double));
+	end_usec = malloc(blocks * sizeof(double));
+	if (!db || !end_usec) {
+		fprintf(stderr, "Error: malloc.\n");
+		exit(1);
 	}
-	ave = (int16_t)(sum / (int64_t)(length));
-	if (ave == 0) {
-		return;}
-	for (i=0; i < length; i+=2) {
-		data[i] -= ave;
+	/* start from a settled previous hop, like in a sweep */
+	SoapySDRDevice_setFrequency(dev, SOAPY_SDR_RX, channel, (double)from->freq, &args);
+	for (i=0; i<blocks; i++) {
+		flags = 0;
+		SoapySDRDevice_readStream(dev, stream, buffs, CAL_BLOCK, &flags, &timeNs, 1000000);
+	}
+	SoapySDRDevice_setFrequency(dev, SOAPY_SDR_RX, channel, (double)to->freq, &args);
+	if (hw_time) {
+		tuned = SoapySDRDevice_getHardwareTime(dev, NULL);}
+	for (i=0; i<blocks; i++) {
+		flags = 0;
+		timeNs = 0;
+		r = SoapySDRDevice_readStream(dev, stream, buffs, CAL_BLOCK, &flags, &timeNs, 1000000);
+		if (r <= 0) {
+			free(db);
+			free(end_usec);
+			return -1;
+		}
+		samples += r;
+		widen(dump, cal, r);
+		db[i] = block_db(cal, r);
+		/* timestamps skip the backlog, otherwise it counts as unsettled */
+		if (hw_time && (flags & SOAPY_SDR_HAS_TIME)) {
+			end_usec[i] = (double)(timeNs - tuned) / 1e3 + (double)r * 1e6 / to->rate;
+		} else {
+			end_usec[i] = (double)samples * 1e6 / to->rate;}
+	}
+	/* the last quarter is the steady level */
+	ref = 0.0;
+	for (i=blocks*3/4; i<blocks; i++) {
+		ref += db[i];}
+	ref /= (double)(blocks - blocks*3/4);
+	steady = 0;
+	for (i=0; i<blocks*3/4; i++) {
+		if (fabs(db[i] - ref) > CAL_TOLERANCE_DB) {
+			steady = i + 1;}
+	}
+	r = steady ? (int)ceil(end_usec[steady-1]) : 0;
+	free(db);
+	free(end_usec);
+	return r < 0 ? 0 : r;
+}
+
+int settle_calibrate(size_t channel, const char *path)
+/* measure every hop and write the settle table */
+{
+	int i, j, r, t, worst;
+	char id[256];
+	FILE *f;
+	struct tuning_state *from;
+	device_id(dev, id, sizeof(id));
+	f = fopen(path, "w");
+	if (!f) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return -1;
+	}
+	fprintf(f, "# rx_power settle table\n");
+	fprintf(f, "# device: %s\n", id);
+	fprintf(f, "# hz usec\n");
+	worst = 0;
+	for (i=0; i<tune_count && !do_exit; i++) {
+		from = &tunes[i > 0 ? i-1 : tune_count-1];
+		r = 0;
+		for (j=0; j<CAL_TRIALS; j++) {
+			t = measure_settle(channel, from, &tunes[i]);
+			if (t < 0) {
+				fprintf(stderr, "Error: calibration read failed at %lli Hz.\n", (long long)tunes[i].freq);
+				fclose(f);
+				return -1;
+			}
+			r = MAX(r, t);
+		}
+		/* a quarter on top, in 100 usec steps */
+		r = ((r + r/4) / 100 + 1) * 100;
+		fprintf(f, "%lli %i\n", (long long)tunes[i].freq, r);
+		worst = MAX(worst, r);
+		fprintf(stderr, "\rCalibrated %i of %i hops, worst %i usec ", i+1, tune_count, worst);
+	}
+	fprintf(stderr, "\n");
+	fclose(f);
+	return 0;
+}
+
+int settle_load(const char *path)
+/* per hop settle times from the nearest frequency in the table */
+{
+	int i, j, n = 0, size = 0, best;
+	long long hz, *freqs = NULL, *grow_freqs;
+	int usec, *settles = NULL, *grow_settles;
+	char line[512], id[256], *file_id;
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return -1;
+	}
+	device_id(dev, id, sizeof(id));
+	while (fgets(line, sizeof(line), f)) {
+		if (strncmp(line, "# device: ", 10) == 0) {
+			file_id = line + 10;
+			file_id[strcspn(file_id, "\r\n")] = '\0';
+			if (strcmp(file_id, id) != 0) {
+				fprintf(stderr, "Warning: settle table is for %s, not %s, ignoring it.\n", file_id, id);
+				fclose(f);
+				free(freqs);
+				free(settles);
+				return -1;
+			}
+		}
+		if (line[0] == '#' || sscanf(line, "%lli %i", &hz, &usec) != 2) {
+			continue;}
+		if (n == size) {
+			size = size ? size * 2 : 64;
+			grow_freqs = realloc(freqs, size * sizeof(long long));
+			if (grow_freqs) {
+				freqs = grow_freqs;}
+			grow_settles = realloc(settles, size * sizeof(int));
+			if (grow_settles) {
+				settles = grow_settles;}
+			if (!grow_freqs || !grow_settles) {
+				fprintf(stderr, "Error: malloc.\n");
+				exit(1);
+			}
+		}
+		freqs[n] = hz;
+		settles[n] = usec;
+		n++;
+	}
+	fclose(f);
+	for (i=0; i<tune_count && n; i++) {
+		best = 0;
+		for (j=1; j<n; j++) {
+			if (llabs(freqs[j] - tunes[i].freq) < llabs(freqs[best] - tunes[i].freq)) {
+				best = j;}
+		}
+		tunes[i].settle_usec = settles[best];
+	}
+	free(freqs);
+	free(settles);
+	fprintf(stderr, "Loaded %i settle times from %s\n", n, path);
+	return n ? 0 : -1;
+}
+
+void integrate(struct fft_worker *w, struct tuning_state *ts)
+/* downsample, fft and accumulate one block into ts->avg */
+{
+	int j, j2, offset, bin_len, buf_len, ds, ds_p;
+	int16_t *fft_buf = w->fft_buf;
+	struct cic_state cic;
+	bin_len = 1 << ts->bin_e;
+	buf_len = ts->buf_len;
+	/* rms */
+	if (bin_len == 1) {
+		rms_power(ts, peak_hold);
+		return;
+	}
+	/* prep for fft */
+	memcpy(fft_buf, ts->buf16, buf_len * sizeof(int16_t));
+	ds = ts->downsample;
+	ds_p = ts->downsample_passes;
+	if (boxcar && ds > 1) {
+		j=2, j2=0;
+		while (j < buf_len) {
+			fft_buf[j2]   += fft_buf[j];
+			fft_buf[j2+1] += fft_buf[j+1];
+			fft_buf[j] = 0;
+			fft_buf[j+1] = 0;
+			j += 2;
+			if (j % (ds*2) == 0) {
+				j2 += 2;}
+		}
+	} else if (ds_p) {  /* recursive */
+		/* ease in by priming every pass with its first sample */
+		cic_decimate(&cic, fft_buf, buf_len, ds_p, 1);
+		/* droop compensation, eased in the same way */
+		if (ds_p <= CIC_TABLE_MAX && w->droop[ds_p].taps) {
+			fir_prime(&w->droop[ds_p], fft_buf[0], fft_buf[1]);
+			fir_decimate(&w->droop[ds_p], fft_buf, buf_len >> ds_p);
+		}
+	}
+	dsp.remove_dc(fft_buf, buf_len / ds);
+	/* window function and fft */
+	for (offset=0; offset<(buf_len/ds); offset+=(2*bin_len)) {
+		dsp.window_cs16(fft_buf+offset, window_coefs, w->fft_out, bin_len);
+		fft_forward(fft_plan, w->fft_out);
+		if (!peak_hold) {
+			dsp.power_sum(w->fft_out, ts->avg, bin_len);
+		} else {
+			dsp.power_max(w->fft_out, ts->avg, bin_len);
+		}
+		ts->samples += ds;
+	}
+}
+
+static void *fft_thread_fn(void *arg)
+{
+	struct fft_worker *w = arg;
+	struct tuning_state *ts;
+	while (1) {
+		ts = ring_pop(&w->jobs);
+		if (!ts) {
+			if (ring_closed(&w->jobs)) {
+				break;}
+			ring_wait(&w->jobs);
+			continue;
+		}
+		integrate(w, ts);
+		pthread_mutex_lock(&jobs_m);
+		ts->busy = 0;
+		jobs_pending--;
+		pthread_cond_broadcast(&jobs_done);
+		pthread_mutex_unlock(&jobs_m);
+	}
+	return 0;
+}
+
+static void droop_init(void)
+/* taps for every number of passes in use, shared by the workers */
+{
+	double h[9];
+	int i, k, p;
+	for (i=0; i<tune_count; i++) {
+		p = tunes[i].downsample_passes;
+		if (p < 1 || p > CIC_TABLE_MAX || droop_taps[p]) {
+			continue;}
+		for (k=0; k<9; k++) {
+			h[k] = cic_9_tables[p][k+1] / 32768.0;}
+		droop_taps[p] = fir_taps_new(h, 9, 1);
+		if (!droop_taps[p]) {
+			fprintf(stderr, "Error: malloc.\n");
+			exit(1);
+		}
 	}
 }
 
-void generic_fir(int16_t *data, int length, int *fir)
-/* Okay, not at all generic.  Assumes length 9, fix that eventually. */
+void workers_start(int count, int buf_len, int bin_len)
 {
-	int d, temp, sum;
-	int hist[9] = {0,};
-	/* cheat on the beginning, let it go unfiltered */
-	for (d=0; d<18; d+=2) {
-		hist[d/2] = data[d];
+	int i, p;
+	struct fft_worker *w;
+	if (count < 1) {
+		count = 1;}
+	if (count > MAX_WORKERS) {
+		count = MAX_WORKERS;}
+	worker_count = count;
+	if (comp_fir_size == 9 && !boxcar) {
+		droop_init();}
+	for (i=0; i<worker_count; i++) {
+		w = &workers[i];
+		w->fft_buf = malloc(buf_len * sizeof(int16_t) * 2);
+		w->fft_out = fft_malloc(bin_len);
+		for (p=0; p<=CIC_TABLE_MAX; p++) {
+			if (droop_taps[p] && fir_init(&w->droop[p], droop_taps[p]) != 0) {
+				fprintf(stderr, "Error: malloc.\n");
+				exit(1);
+			}
+		}
+		/* every tune is queued at most once at a time */
+		if (!w->fft_buf || !w->fft_out ||
+		    ring_init(&w->jobs, tune_count / worker_count + 1, sizeof(void *)) != 0) {
+			fprintf(stderr, "Error: malloc.\n");
+			exit(1);
+		}
+		pthread_create(&w->thread, NULL, fft_thread_fn, (void *)w);
 	}
-	for (d=18; d<length; d+=2) {
-		temp = data[d];
-		sum = 0;
-		sum += (hist[0] + hist[8]) * fir[1];
-		sum += (hist[1] + hist[7]) * fir[2];
-		sum += (hist[2] + hist[6]) * fir[3];
-		sum += (hist[3] + hist[5]) * fir[4];
-		sum +=            hist[4]  * fir[5];
-		data[d] = (int16_t)(sum >> 15) ;
-		hist[0] = hist[1];
-		hist[1] = hist[2];
-		hist[2] = hist[3];
-		hist[3] = hist[4];
-		hist[4] = hist[5];
-		hist[5] = hist[6];
-		hist[6] = hist[7];
-		hist[7] = hist[8];
-		hist[8] = temp;
+}
+
+void workers_stop(void)
+{
+	int i, p;
+	struct fft_worker *w;
+	for (i=0; i<worker_count; i++) {
+		w = &workers[i];
+		ring_close(&w->jobs);
+		pthread_join(w->thread, NULL);
+		ring_free(&w->jobs);
+		free(w->fft_buf);
+		fft_free(w->fft_out);
+		for (p=0; p<=CIC_TABLE_MAX; p++) {
+			fir_free(&w->droop[p]);}
+	}
+	for (p=0; p<=CIC_TABLE_MAX; p++) {
+		fir_taps_free(droop_taps[p]);
+		droop_taps[p] = NULL;
 	}
 }
 
-void downsample_iq(int16_t *data, int length)
+void workers_wait(void)
+/* until every queued tune has been integrated */
 {
-	fifth_order(data, length);
-	//remove_dc(data, length);
-	fifth_order(data+1, length-1);
-	//remove_dc(data+1, length-1);
+	pthread_mutex_lock(&jobs_m);
+	while (jobs_pending > 0) {
+		pthread_cond_wait(&jobs_done, &jobs_m);}
+	pthread_mutex_unlock(&jobs_m);
 }
 
-int64_t real_conj(int16_t real, int16_t imag)
-/* real(n * conj(n)) */
+int read_block(int16_t *buf, int elems, int *flags, long long *timeNs, long timeoutUs)
+/* fill buf with elems samples, readStream may come back short
+   and driver buffers are copied from only as far as needed */
 {
-	return ((int64_t)real*(int64_t)real + (int64_t)imag*(int64_t)imag);
+	int r, n, got = 0;
+	const void *raw;
+	void *target;
+	while (got < elems) {
+		target = buf8 ? (void *)buf8 : (void *)(buf + 2 * got);
+		r = stream_acquire(&reader, &raw, target, elems - got, flags, timeNs, timeoutUs);
+		/* the tail of a recording is too short for a whole block */
+		if (r <= 0) {
+			return got && r != STREAM_EOF ? got : r;}
+		n = MIN(r, elems - got);
+		widen(raw, buf + 2 * got, n);
+		stream_release(&reader);
+		got += n;
+	}
+	return got;
 }
 
 void scanner(size_t channel)
+/* retunes and reads while the workers integrate the previous hops */
 {
-	int i, j, j2, offset, bin_e, bin_len, buf_len, ds, ds_p;
-	int32_t w;
+	int i, buf_len;
 	int64_t f;
 	struct tuning_state *ts;
-	bin_e = tunes[0].bin_e;
-	bin_len = 1 << bin_e;
+	struct fft_worker *w;
 	buf_len = tunes[0].buf_len;
 	for (i=0; i<tune_count; i++) {
 		if (do_exit >= 2)
-			{return;}
+			{break;}
 		ts = &tunes[i];
-		f = (int64_t)SoapySDRDevice_getFrequency(dev, SOAPY_SDR_RX, channel);
+		if (input_mode) {
+			f = input.tunable ? (int64_t)input.freq : ts->freq;}
+		else {
+			f = (int64_t)SoapySDRDevice_getFrequency(dev, SOAPY_SDR_RX, channel);}
 
 		if (f != ts->freq) {
-			retune(dev, stream, ts->freq, channel);}
+			int64_t start = metric_clock();
+			retune(dev, ts, channel);
+			metric_add_since(retune_time_metric, start);
+			metric_add(retunes_metric, 1);
+		}
+
+		/* only when the workers fall a whole sweep behind */
+		pthread_mutex_lock(&jobs_m);
+		while (ts->busy) {
+			pthread_cond_wait(&jobs_done, &jobs_m);}
+		pthread_mutex_unlock(&jobs_m);
 
-		void *buffs[] = {ts->buf16};
 		int flags = 0;
 		long long timeNs = 0;
 		long timeoutNs = 1000000;
 		int r;
 
-		r = SoapySDRDevice_readStream(dev, stream, buffs, buf_len, &flags, &timeNs, timeoutNs);
-
-		//int n_read = 0;
-		if (r >= 0) {
-			// r is number of elements read, elements=complex pairs of 8-bits, so buffer length in bytes is twice
-			//n_read = r * 2;
-		} else {
-			fprintf(stderr, "Error: reading stream %d\n", r);
-			continue;
+		/* buf_len counts int16 values, two per element */
+		r = read_block(ts->buf16, buf_len / 2, &flags, &timeNs, timeoutNs);
+		if (r == STREAM_EOF) {
+			input_ended = 1;
+			do_exit = 1;
+			break;
 		}
-
-		/* TODO: n_read=12288 (=6144*2) but buf_len=16384?
-		if (n_read != buf_len) {
-			fprintf(stderr, "Error: dropped samples. (n_read=%d, buf_len=%d)\n", n_read, buf_len);}
-		*/
-		/* rms */
-		if (bin_len == 1) {
-			rms_power(ts);
+		if (r < 0) {
+			fprintf(stderr, "Error: reading stream %d\n", r);
 			continue;
 		}
-		/* prep for fft */
-		for (j=0; j<buf_len; j++) {
-			//fft_buf[j] = (int16_t)ts->buf8[j] - 127;
-			// Already in signed 16-bit format TODO: remove unnecessary conversion? but struct comment
-			// says "having the iq buffer here is wasteful, but will avoid contention" ... maybe need it?
-			fft_buf[j] = (int16_t)ts->buf16[j];
-		}
-		ds = ts->downsample;
-		ds_p = ts->downsample_passes;
-		if (boxcar && ds > 1) {
-			j=2, j2=0;
-			while (j < buf_len) {
-				fft_buf[j2]   += fft_buf[j];
-				fft_buf[j2+1] += fft_buf[j+1];
-				fft_buf[j] = 0;
-				fft_buf[j+1] = 0;
-				j += 2;
-				if (j % (ds*2) == 0) {
-					j2 += 2;}
-			}
-		} else if (ds_p) {  /* recursive */
-			for (j=0; j < ds_p; j++) {
-				downsample_iq(fft_buf, buf_len >> j);
-			}
-			/* droop compensation */
-			if (comp_fir_size == 9 && ds_p <= CIC_TABLE_MAX) {
-				generic_fir(fft_buf, buf_len >> j, cic_9_tables[ds_p]);
-				generic_fir(fft_buf+1, (buf_len >> j)-1, cic_9_tables[ds_p]);
-			}
-		}
-		remove_dc(fft_buf, buf_len / ds);
-		remove_dc(fft_buf+1, (buf_len / ds) - 1);
-		/* window function and fft */
-		for (offset=0; offset<(buf_len/ds); offset+=(2*bin_len)) {
-			// todo, let rect skip this
-			for (j=0; j<bin_len; j++) {
-				w =  (int32_t)fft_buf[offset+j*2];
-				w *= (int32_t)(window_coefs[j]);
-				//w /= (int32_t)(ds);
-				fft_buf[offset+j*2]   = (int16_t)w;
-				w =  (int32_t)fft_buf[offset+j*2+1];
-				w *= (int32_t)(window_coefs[j]);
-				//w /= (int32_t)(ds);
-				fft_buf[offset+j*2+1] = (int16_t)w;
-			}
-			fix_fft(fft_buf+offset, bin_e);
-			if (!peak_hold) {
-				for (j=0; j<bin_len; j++) {
-					ts->avg[j] += real_conj(fft_buf[offset+j*2], fft_buf[offset+j*2+1]);
-				}
-			} else {
-				for (j=0; j<bin_len; j++) {
-					ts->avg[j] = MAX(real_conj(fft_buf[offset+j*2], fft_buf[offset+j*2+1]), ts->avg[j]);
-				}
-			}
-			ts->samples += ds;
-		}
+		w = &workers[i % worker_count];
+		pthread_mutex_lock(&jobs_m);
+		ts->busy = 1;
+		jobs_pending++;
+		pthread_mutex_unlock(&jobs_m);
+		ring_push(&w->jobs, ts);
 	}
 }
 
-void csv_dbm(struct tuning_state *ts)
-{
-	int i, len, ds, i1, i2, bw2, bin_count;
-	int64_t tmp;
-	double dbm;
-	len = 1 << ts->bin_e;
-	ds = ts->downsample;
-	/* fix FFT stuff quirks */
-	if (ts->bin_e > 0) {
-		/* nuke DC component (not effective for all windows) */
-		ts->avg[0] = ts->avg[1];
-		/* FFT is translated by 180 degrees */
-		for (i=0; i<len/2; i++) {
-			tmp = ts->avg[i];
-			ts->avg[i] = ts->avg[i+len/2];
-			ts->avg[i+len/2] = tmp;
-		}
-	}
-	/* Hz low, Hz high, Hz step, samples, dbm, dbm, ... */
-	bin_count = (int)((double)len * (1.0 - ts->crop));
-	bw2 = (int)(((double)ts->rate * (double)bin_count) / (len * 2 * ds));
-	fprintf(file, "%lli, %lli, %.2f, %i, ", (long long)ts->freq - bw2, (long long)ts->freq + bw2,
-		(double)ts->rate / (double)(len*ds), ts->samples);
-	// something seems off with the dbm math
-	i1 = 0 + (int)((double)len * ts->crop * 0.5);
-	i2 = (len-1) - (int)((double)len * ts->crop * 0.5);
-	for (i=i1; i<=i2; i++) {
-		dbm  = (double)ts->avg[i];
-		dbm /= (double)ts->rate;
-		dbm /= (double)ts->samples;
-		dbm  = 10 * log10(dbm);
-		fprintf(file, "%.2f, ", dbm);
-	}
-	dbm = (double)ts->avg[i2] / ((double)ts->rate * (double)ts->samples);
-	if (ts->bin_e == 0) {
-		dbm = ((double)ts->avg[0] / \
-		((double)ts->rate * (double)ts->samples));}
-	dbm  = 10 * log10(dbm);
-	fprintf(file, "%.2f\n", dbm);
-	for (i=0; i<len; i++) {
-		ts->avg[i] = 0L;
-	}
-	ts->samples = 0;
-}
 
 int main(int argc, char **argv)
 {
@@ -822,7 +1082,7 @@ int main(int argc, char **argv)
 	struct sigaction sigact;
 #endif
 	char *filename = NULL;
-	int i, length, r, opt = 0;
+	int i, length, r = 0, opt = 0;
 	int f_set = 0;
 	char *gain_str = NULL;
 	char *dev_query = "";
@@ -837,15 +1097,23 @@ int main(int argc, char **argv)
 	char *freq_optarg;
 	time_t next_tick;
 	time_t time_now;
+	uint64_t next_sample = 0;
 	time_t exit_time = 0;
 	char t_str[50];
 	struct tm cal_time = {0};
 	double (*window_fn)(int, int) = rectangle;
+	int fft_backend = FFT_BACKEND_AUTO;
+	char *settle_path = NULL;
+	int calibrate = 0;
+	int zero_copy = 0;
+	char *metrics_dest = NULL;
+	/* 8 bit devices save half the copying, widened by the SIMD kernels */
+	const char *formats[] = {SOAPY_SDR_CS16, SOAPY_SDR_CS8, SOAPY_SDR_CU8, NULL};
 	int channel = 0;	
 	char *antenna_str = NULL;
 	freq_optarg = "";
 
-	while ((opt = getopt(argc, argv, "a:C:f:i:s:t:d:g:p:e:w:c:F:1PD:OS:R:h")) != -1) {
+	while ((opt = getopt(argc, argv, "a:C:f:i:s:t:d:g:p:e:w:c:F:1PD:OS:R:B:T:KZx:h")) != -1) {
 		switch (opt) {
 		case 'a':
 			antenna_str = optarg;
@@ -924,6 +1192,25 @@ int main(int argc, char **argv)
 		case 'R':
 			tuner_retry_max = atoi(optarg);
 			break;
+		case 'T':
+			settle_path = optarg;
+			break;
+		case 'K':
+			calibrate = 1;
+			break;
+		case 'Z':
+			zero_copy = 1;
+			break;
+		case 'x':
+			metrics_dest = optarg;
+			break;
+		case 'B':
+			fft_backend = fft_backend_parse(optarg);
+			if (fft_backend < 0) {
+				fprintf(stderr, "Unknown FFT backend '%s'.\n", optarg);
+				usage();
+			}
+			break;
 		case 'h':
 		default:
 			usage();
@@ -936,16 +1223,16 @@ int main(int argc, char **argv)
 		usage();
 	}
 
+	if (calibrate && !settle_path) {
+		fprintf(stderr, "Calibration needs a settle table (-T).\n");
+		usage();
+	}
+
 	if ((crop < 0.0) || (crop > 1.0)) {
 		fprintf(stderr, "Crop value outside of 0 to 1.\n");
 		exit(1);
 	}
 
-	frequency_range(freq_optarg, crop);
-
-	if (tune_count == 0) {
-		usage();}
-
 	if (argc <= optind) {
 		filename = "-";
 	} else {
@@ -956,25 +1243,56 @@ int main(int argc, char **argv)
 		interval = 1;}
 
 	fprintf(stderr, "Reporting every %i seconds\n", interval);
+	fprintf(stderr, "Using %s DSP kernels.\n", dsp_init());
 
-	r = verbose_device_search(dev_query, &dev);
-
-	if (r != 0) {
-		fprintf(stderr, "Failed to open sdr device matching '%s'.\n", dev_query);
+	input_mode = verbose_input_open(dev_query, &input);
+	if (input_mode < 0) {
+		exit(1);}
+	if (input_mode && calibrate) {
+		fprintf(stderr, "Calibration needs a device, not an input.\n");
 		exit(1);
 	}
+	if (input_mode && !input.tunable && crop > 0.0) {
+		fprintf(stderr, "Ignoring -c, the input is a single hop.\n");
+		crop = 0.0;
+	}
+
+	if (!input_mode) {
+		r = verbose_device_search(dev_query, &dev);
+		if (r != 0) {
+			fprintf(stderr, "Failed to open sdr device matching '%s'.\n", dev_query);
+			exit(1);
+		}
+	}
 
 	/* Set the antenna */
-	if (NULL != antenna_str) {
+	if (NULL != antenna_str && !input_mode) {
 		r = verbose_antenna_str_set(dev, channel, antenna_str);
 		if(r != 0){
 			fprintf(stderr, "Failed to set antenna");
 		}
 	}
 
-	verbose_setup_stream(dev, &stream, channel, SOAPY_SDR_CS16);
+	/* the hops depend on the rates the device supports */
+	frequency_range(freq_optarg, crop, channel);
+
+	if (input_mode) {
+		/* read in place, only a synthetic input is retuned */
+		stream_format = input.format;
+		verbose_input_reader(&reader, &input);
+	} else {
+		stream_format = verbose_native_format(dev, channel, formats);
+		verbose_setup_stream(dev, &stream, channel, stream_format);
+		if (SoapySDR_formatToSize(stream_format) == 2) {
+			buf8 = malloc(tunes[0].buf_len);}
 
-	SoapySDRDevice_activateStream(dev, stream, 0, 0, 0);
+		SoapySDRDevice_activateStream(dev, stream, 0, 0, 0);
+		verbose_stream_reader(&reader, dev, stream, zero_copy);
+
+		hw_time = SoapySDRDevice_hasHardwareTime(dev, NULL);
+		if (hw_time) {
+			fprintf(stderr, "Settling retunes by sample timestamp.\n");}
+	}
 
 #ifndef _WIN32
 	sigact.sa_handler = sighandler;
@@ -989,22 +1307,24 @@ int main(int argc, char **argv)
 	SetConsoleCtrlHandler( (PHANDLER_ROUTINE) sighandler, TRUE );
 #endif
 
-	if (direct_sampling) {
-		verbose_direct_sampling(dev, direct_sampling);
-	}
+	if (!input_mode) {
+		if (direct_sampling) {
+			verbose_direct_sampling(dev, direct_sampling);
+		}
 
-	if (offset_tuning) {
-		verbose_offset_tuning(dev);
-	}
+		if (offset_tuning) {
+			verbose_offset_tuning(dev);
+		}
 
-	/* Set the tuner gain */
-	if (gain_str == NULL) {
-		verbose_auto_gain(dev, channel);
-	} else {
-		verbose_gain_str_set(dev, gain_str, channel);
-	}
+		/* Set the tuner gain */
+		if (gain_str == NULL) {
+			verbose_auto_gain(dev, channel);
+		} else {
+			verbose_gain_str_set(dev, gain_str, channel);
+		}
 
-	verbose_ppm_set(dev, ppm_error, channel);
+		verbose_ppm_set(dev, ppm_error, channel);
+	}
 
 	if (strcmp(filename, "-") == 0) { /* Write log to stdout */
 		file = stdout;
@@ -1021,32 +1341,68 @@ int main(int argc, char **argv)
 	}
 
 	/* Reset endpoint before we start reading from it (mandatory) */
-	verbose_reset_buffer(dev);
+	if (!input_mode) {
+		verbose_reset_buffer(dev);
 
-	/* actually do stuff */
-	SoapySDRDevice_setSampleRate(dev, SOAPY_SDR_RX, channel, (double)tunes[0].rate);
-	sine_table(tunes[0].bin_e);
+		/* actually do stuff */
+		SoapySDRDevice_setSampleRate(dev, SOAPY_SDR_RX, channel, (double)tunes[0].rate);
+	} else {
+		input_set_rate(&input, (double)tunes[0].rate);}
+	if (calibrate) {
+		r = settle_calibrate(channel, settle_path);
+		SoapySDRDevice_deactivateStream(dev, stream, 0, 0);
+		SoapySDRDevice_closeStream(dev, stream);
+		SoapySDRDevice_unmake(dev);
+		return r ? 1 : 0;
+	}
+	if (settle_path) {
+		settle_load(settle_path);}
+	fft_plan = fft_plan_new(tunes[0].bin_e, fft_backend);
+	if (!fft_plan) {
+		fprintf(stderr, "Failed to set up the %s FFT.\n", fft_backend_name(fft_backend));
+		exit(1);
+	}
+	fprintf(stderr, "Using %s FFT.\n", fft_backend_name(fft_plan->backend));
 	next_tick = time(NULL) + interval;
 	if (exit_time) {
 		exit_time = time(NULL) + exit_time;}
-	fft_buf = malloc(tunes[0].buf_len * sizeof(int16_t) * 2);
+	/* a recording is not read in real time, its samples are the clock */
+	if (input.offline) {
+		next_sample = (uint64_t)(interval * input.rate);}
 	length = 1 << tunes[0].bin_e;
-	window_coefs = malloc(length * sizeof(int));
+	workers_start(fft_threads, tunes[0].buf_len, length);
+	fprintf(stderr, "Using %i FFT thread%s.\n", worker_count, worker_count > 1 ? "s" : "");
+	window_coefs = malloc(length * sizeof(float));
+	/* the 1/N of the old fixed point FFT */
 	for (i=0; i<length; i++) {
-		window_coefs[i] = (int)(256*window_fn(i, length));
+		window_coefs[i] = (float)(window_fn(i, length) / length);
 	}
+	retunes_metric = metric_new(METRIC_COUNTER, "rx_power_retunes_total", "Hops to another frequency.", 1.0);
+	retune_time_metric = metric_new(METRIC_COUNTER, "rx_power_retune_seconds_total",
+		"Time spent tuning and settling.", 1e-9);
+	if (metrics_dest && verbose_metrics_start(metrics_dest, "rx_power") != 0) {
+		exit(1);}
 	tzset();
 	while (!do_exit) {
 		scanner(channel);
 		time_now = time(NULL);
-		if (time_now < next_tick) {
+		if (input.offline) {
+			if (!do_exit && input.samples < next_sample) {
+				continue;}
+			next_sample += (uint64_t)(interval * input.rate);
+		} else if (time_now < next_tick) {
+			continue;}
+		/* the last hops of the sweep may still be in the workers */
+		workers_wait();
+		/* nothing left since the last line at the end of a recording */
+		if (input.offline && !tunes[0].samples) {
 			continue;}
 		// time, Hz low, Hz high, Hz step, samples, dbm, dbm, ...
 		localtime_r(&time_now, &cal_time);
 		strftime(t_str, 50, "%Y-%m-%d, %H:%M:%S", &cal_time);
 		for (i=0; i<tune_count; i++) {
 			fprintf(file, "%s, ", t_str);
-			csv_dbm(&tunes[i]);
+			csv_dbm(file, &tunes[i]);
 		}
 		fflush(file);
 		while (time(NULL) >= next_tick) {
@@ -1058,8 +1414,11 @@ int main(int argc, char **argv)
 	}
 
 	/* clean up */
+	metrics_stop();
 
-	if (do_exit) {
+	if (input_ended) {
+		fprintf(stderr, "\nEnd of input, exiting...\n");}
+	else if (do_exit) {
 		fprintf(stderr, "\nUser cancel, exiting...\n");}
 	else {
 		fprintf(stderr, "\nLibrary error %d, exiting...\n", r);}
@@ -1067,11 +1426,17 @@ int main(int argc, char **argv)
 	if (file != stdout) {
 		fclose(file);}
 
-	SoapySDRDevice_deactivateStream(dev, stream, 0, 0);
-	SoapySDRDevice_closeStream(dev, stream);
-	SoapySDRDevice_unmake(dev);
-	free(fft_buf);
+	if (input_mode) {
+		input_report(&input);
+		input_close(&input);
+	} else {
+		SoapySDRDevice_deactivateStream(dev, stream, 0, 0);
+		SoapySDRDevice_closeStream(dev, stream);
+		SoapySDRDevice_unmake(dev);
+	}
+	workers_stop();
 	free(window_coefs);
+	fft_plan_free(fft_plan);
 	//for (i=0; i<tune_count; i++) {
 	//	free(tunes[i].avg);
 	//	free(tunes[i].buf16);
@@ -22,6 +22,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <time.h>
 
 #ifndef _WIN32
 #include <unistd.h>
@@ -32,7 +33,11 @@
 #include "getopt/getopt.h"
 #endif
 
+#include <pthread.h>
+
 #include "convenience.h"
+#include "kernels.h"
+#include "ring.h"
 #include <SoapySDR/Device.h>
 #include <SoapySDR/Formats.h>
 
@@ -40,6 +45,8 @@
 #define DEFAULT_BUF_LENGTH		(16 * 16384)
 #define MINIMAL_BUF_LENGTH		512
 #define MAXIMAL_BUF_LENGTH		(256 * 16384)
+#define DEFAULT_RING_MB			64
+#define BROADCAST_MB			32
 
 #define ISFMT(a,b) (!strcmp((a),(b)))
 
@@ -47,6 +54,22 @@ static int do_exit = 0;
 static uint32_t samples_to_read = 0;
 static SoapySDRDevice *dev = NULL;
 static SoapySDRStream *stream = NULL;
+static struct metric *written_metric, *stalls_metric;
+
+struct writer_state
+{
+	pthread_t thread;
+	FILE *file;
+	char const *input_format;
+	char const *output_format;
+	size_t input_elem_size;
+	size_t output_elem_size;
+	int16_t *buf16;           /* CS16 between the two halves of a conversion */
+	void *conv;               /* converted output */
+	struct ring_buffer ring;  /* blocks from the reader, len is in elements */
+	int converted;            /* the reader already converted the ring blocks */
+	int failed;
+};
 
 void usage(void)
 {
@@ -55,18 +78,25 @@ void usage(void)
 		"Usage:\t -f frequency_to_tune_to [Hz]\n"
 		"\t[-s samplerate (default: 2048000 Hz)]\n"
 		"\t[-d device key/value query (ex: 0, 1, driver=rtlsdr, driver=hackrf)]\n"
+		"\t	shm=name: the samples of another rx_sdr -P name\n"
+		"\t	file=path,rate=Hz,freq=Hz[,format=CU8]: a recording, as fast as possible\n"
+		"\t	synth=[signals][,format=CU8][,samples=N][,realtime=1]: generated at -f and -s\n"
 		"\t[-g tuner gain(s) (ex: 20, 40, LNA=40,VGA=20,AMP=0)]\n"
 		"\t[-c channel number (ex: 0)]\n"
 		"\t[-a antenna (ex: 'Tuner 1 50 ohm')]\n"
 		"\t[-p ppm_error (default: 0)]\n"
 		"\t[-b output_block_size (default: 16 * 16384)]\n"
 		"\t[-n number of samples to read (default: 0, infinite)]\n"
-		"\t[-I input format, CU8|CS8|CS12|CS16|CF32 (default: CS16)]\n"
+		"\t[-I input format, CU8|CS8|CS12|CS16|CF32 (default: native)]\n"
 		"\t[-F output format, CU8|CS8|CS12|CS16|CF32 (default: CU8)]\n"
 		"\t[-S force sync output (default: async)]\n"
+		"\t[-m async ring size in MB (default: 64)]\n"
+		"\t[-Z read the driver's buffers directly, when supported]\n"
+		"\t[-x metrics, Prometheus text on unix:path or rewritten to a file (default: off)]\n"
+		"\t[-P name, broadcast the samples for rx tools started with -d shm=name]\n"
 		"\t[-D direct_sampling_mode, 0 (default/off), 1 (I), 2 (Q), 3 (no-mod)]\n"
 		"\t[-t SDR settings (ex: rfnotch_ctrl=false,dabnotch_ctrlb=true)]\n"
-		"\tfilename (a '-' dumps samples to stdout)\n\n");
+		"\tfilename (a '-' dumps samples to stdout, optional with -P)\n\n");
 	exit(1);
 }
 
@@ -113,33 +143,184 @@ static void sighandler(int signum)
 }
 #endif
 
+static void to_cs16(char const *fmt, const void *in, int16_t *out, size_t n)
+/* n counts int16 values, 2 per element */
+{
+	if (ISFMT(fmt, SOAPY_SDR_CU8)) {
+		dsp.cu8_to_cs16(in, out, n);
+	} else if (ISFMT(fmt, SOAPY_SDR_CS8)) {
+		dsp.cs8_to_cs16(in, out, n);
+	} else if (ISFMT(fmt, SOAPY_SDR_CS12)) {
+		dsp.cs12_to_cs16(in, out, n);
+	} else if (ISFMT(fmt, SOAPY_SDR_CF32)) {
+		dsp.cf32_to_cs16(in, out, n);
+	}
+}
+
+static void from_cs16(char const *fmt, const int16_t *in, void *out, size_t n)
+{
+	if (ISFMT(fmt, SOAPY_SDR_CU8)) {
+		dsp.cs16_to_cu8(in, out, n);
+	} else if (ISFMT(fmt, SOAPY_SDR_CS8)) {
+		dsp.cs16_to_cs8(in, out, n);
+	} else if (ISFMT(fmt, SOAPY_SDR_CS12)) {
+		dsp.cs16_to_cs12(in, out, n);
+	} else if (ISFMT(fmt, SOAPY_SDR_CF32)) {
+		dsp.cs16_to_cf32(in, out, n);
+	}
+}
+
+static int is_8bit(char const *fmt)
+{
+	return ISFMT(fmt, SOAPY_SDR_CU8) || ISFMT(fmt, SOAPY_SDR_CS8);
+}
+
+static const void *convert_block(struct writer_state *w, const void *in, int elems, void *out)
+/* input_format to output_format, returns in when they match and out otherwise,
+   everything but CU8 <-> CS8 goes through CS16 */
+{
+	size_t n = (size_t)elems * 2;  /* one element read is I and Q */
+	const int16_t *cs16 = in;
+	if (ISFMT(w->output_format, w->input_format)) {
+		// The "native" format we read in, write out no conversion needed
+		return in;
+	}
+	if (is_8bit(w->input_format) && is_8bit(w->output_format)) {
+		dsp.flip8(in, out, n);
+		return out;
+	}
+	if (ISFMT(w->output_format, SOAPY_SDR_CS16)) {
+		to_cs16(w->input_format, in, out, n);
+		return out;
+	}
+	if (!ISFMT(w->input_format, SOAPY_SDR_CS16)) {
+		to_cs16(w->input_format, in, w->buf16, n);
+		cs16 = w->buf16;
+	}
+	from_cs16(w->output_format, cs16, out, n);
+	return out;
+}
+
+int write_block(struct writer_state *w, const void *in, int elems)
+/* convert one block of input_format and write it, 0 on success */
+{
+	size_t bytes = (size_t)elems * w->output_elem_size;
+	const void *out = convert_block(w, in, elems, w->conv);
+	if (fwrite(out, 1, bytes, w->file) != bytes) {
+		return -1;}
+	metric_add(written_metric, bytes);
+	return 0;
+}
+
+static int direct_block(struct writer_state *w, const uint8_t *raw, int elems, int chunk, int sync_mode)
+/* a driver buffer, written out or converted straight into the ring
+   in pieces no longer than a block, 0 on success */
+{
+	int n;
+	void *slot;
+	const void *out;
+	for (; elems > 0; elems -= n, raw += (size_t)n * w->input_elem_size) {
+		n = elems < chunk ? elems : chunk;
+		if (sync_mode) {
+			if (write_block(w, raw, n) != 0) {
+				return -1;}
+			continue;
+		}
+		slot = ring_write_slot(&w->ring);
+		if (!slot) {
+			metric_add(stalls_metric, 1);
+			fprintf(stderr, "D");
+			fflush(stderr);
+			continue;
+		}
+		out = convert_block(w, raw, n, slot);
+		if (out != slot) {
+			memcpy(slot, out, (size_t)n * w->output_elem_size);}
+		ring_write_commit(&w->ring, n);
+	}
+	return 0;
+}
+
+static void *writer_thread_fn(void *arg)
+/* drains the ring so disk or pipe stalls never hold up readStream */
+{
+	struct writer_state *w = arg;
+	void *block;
+	size_t len;
+	int r;
+	while (1) {
+		block = ring_read_slot(&w->ring, &len);
+		if (!block) {
+			/* the reader closes after its last commit */
+			if (ring_closed(&w->ring) && ring_count(&w->ring) == 0) {
+				break;}
+			ring_wait(&w->ring);
+			continue;
+		}
+		if (w->converted) {
+			r = fwrite(block, w->output_elem_size, len, w->file) == len ? 0 : -1;
+			metric_add(written_metric, r == 0 ? (int64_t)(len * w->output_elem_size) : 0);
+		} else {
+			r = write_block(w, block, (int)len);}
+		if (r != 0) {
+			/* main reports it after the join */
+			w->failed = 1;
+			do_exit = 1;
+			break;
+		}
+		ring_read_release(&w->ring);
+	}
+	return 0;
+}
+
+static void broadcast(struct shm_ring *shm, const void *raw, int elems, int flags, long long timeNs)
+/* stamped with the device time when the driver has it, the wall clock otherwise */
+{
+	struct timespec now;
+	if (!(flags & SOAPY_SDR_HAS_TIME)) {
+		clock_gettime(CLOCK_REALTIME, &now);
+		timeNs = (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+		flags |= SOAPY_SDR_HAS_TIME;
+	}
+	shm_ring_publish(shm, raw, (size_t)elems, flags, timeNs);
+}
+
 int main(int argc, char **argv)
 {
 #ifndef _WIN32
 	struct sigaction sigact;
 #endif
 	char *filename = NULL;
-	int r, opt;
+	int r = 0, opt;
 	char *gain_str = NULL;
 	int channel = 0;
 	char *antenna_str = NULL;
 	int ppm_error = 0;
 	int sync_mode = 0;
+	int zero_copy = 0;
 	int direct_sampling = 0;
 	FILE *file;
 	int16_t *buffer;
-	uint8_t *buf8 = NULL;
-	int16_t *buf16 = NULL;
-	float *fbuf = NULL; // assumed 32-bit
+	struct writer_state writer = {0};
+	unsigned ring_mb = DEFAULT_RING_MB, ring_depth;
+	size_t slot_size;
+	struct stream_reader reader;
+	struct iq_input input;
+	int input_mode, ended = 0;
+	char *shm_name = NULL;
+	struct shm_ring shm = {0};
+	const void *raw;
 	char *dev_query = "";
 	uint32_t frequency = 100000000;
 	uint32_t samp_rate = DEFAULT_SAMPLE_RATE;
 	uint32_t out_block_size = DEFAULT_BUF_LENGTH;
-	char const *input_format = SOAPY_SDR_CS16;
+	char const *input_format = NULL;  /* the device's native format */
 	char const *output_format = SOAPY_SDR_CU8;
+	const char *formats[] = {SOAPY_SDR_CS16, SOAPY_SDR_CU8, SOAPY_SDR_CS8, SOAPY_SDR_CS12, SOAPY_SDR_CF32, NULL};
 	char *sdr_settings = NULL;
+	char *metrics_dest = NULL;
 
-	while ((opt = getopt(argc, argv, "d:f:g:c:a:s:b:n:p:D:SI:F:t:")) != -1) {
+	while ((opt = getopt(argc, argv, "d:f:g:c:a:s:b:n:p:D:SI:F:t:m:ZP:x:")) != -1) {
 		switch (opt) {
 		case 'd':
 			dev_query = optarg;
@@ -182,7 +363,6 @@ int main(int argc, char **argv)
 		case 'F':
 			output_format = parse_fmt(optarg);
 			if (!output_format) {
-				// TODO: support others? maybe after https://github.com/pothosware/SoapySDR/issues/49 Conversion support
 				fprintf(stderr, "Unsupported output format: %s\n", optarg);
 				exit(1);
 			}
@@ -193,24 +373,28 @@ int main(int argc, char **argv)
 		case 't':
 			sdr_settings = optarg;
 			break;
+		case 'm':
+			ring_mb = (unsigned)atoi(optarg);
+			break;
+		case 'Z':
+			zero_copy = 1;
+			break;
+		case 'P':
+			shm_name = optarg;
+			break;
+		case 'x':
+			metrics_dest = optarg;
+			break;
 		default:
 			usage();
 			break;
 		}
 	}
 
-	// for now only input to output in same format, input CS16 to all, and CS12 to CS16
-	if (!ISFMT(input_format, output_format)
-			&& !ISFMT(input_format, SOAPY_SDR_CS16)
-			&& (!ISFMT(input_format, SOAPY_SDR_CS12) || !ISFMT(output_format, SOAPY_SDR_CS16))) {
-		fprintf(stderr, "Unsupported input/output conversion: %s to %s\n", input_format, output_format);
-		exit(1);
-	}
-
-	if (argc <= optind) {
-		usage();
-	} else {
+	if (argc > optind) {
 		filename = argv[optind];
+	} else if (!shm_name) {
+		usage();
 	}
 
 	if(out_block_size < MINIMAL_BUF_LENGTH ||
@@ -224,26 +408,44 @@ int main(int argc, char **argv)
 		out_block_size = DEFAULT_BUF_LENGTH;
 	}
 
-	buffer = malloc(out_block_size * SoapySDR_formatToSize(SOAPY_SDR_CS16));
-	if (ISFMT(output_format, SOAPY_SDR_CS8) || ISFMT(output_format, SOAPY_SDR_CU8)) {
-		buf8 = malloc(out_block_size * SoapySDR_formatToSize(SOAPY_SDR_CS8));
-	} else if (ISFMT(output_format, SOAPY_SDR_CS16)) {
-		buf16 = malloc(out_block_size * SoapySDR_formatToSize(SOAPY_SDR_CS16));
-	} else if (ISFMT(output_format, SOAPY_SDR_CF32)) {
-		fbuf = malloc(out_block_size * SoapySDR_formatToSize(SOAPY_SDR_CF32));
-	}
-	size_t input_elem_size = SoapySDR_formatToSize(input_format);
-
 	int tmp_stdout = suppress_stdout_start();
-	// TODO: allow choosing input format, see https://www.reddit.com/r/RTLSDR/comments/4tpxv7/rx_tools_commandline_sdr_tools_for_rtlsdr_bladerf/d5ohfse?context=3
-	r = verbose_device_search(dev_query, &dev);
-
-	if (r != 0) {
-		fprintf(stderr, "Failed to open sdr device matching '%s'.\n", dev_query);
-		exit(1);
+	input_mode = verbose_input_open(dev_query, &input);
+	if (input_mode < 0) {
+		exit(1);}
+	if (input_mode) {
+		/* the producer has already chosen all of the settings, a synthetic input takes -f and -s */
+		if (input_format && !ISFMT(input_format, input.format)) {
+			fprintf(stderr, "Ignoring -I, the input is %s.\n", input.format);}
+		input_format = input.format;
+		input_set_frequency(&input, (double)frequency);
+		input_set_rate(&input, (double)samp_rate);
+		samp_rate = (uint32_t)input.rate;
+		frequency = (uint32_t)input.freq;
+		/* a recording can wait for the writer, nothing is dropped */
+		if (input.offline) {
+			sync_mode = 1;}
+	} else {
+		r = verbose_device_search(dev_query, &dev);
+		if (r != 0) {
+			fprintf(stderr, "Failed to open sdr device matching '%s'.\n", dev_query);
+			exit(1);
+		}
 	}
 
+	/* without -I read what the device delivers, the writer converts once */
+	if (!input_format) {
+		input_format = verbose_native_format(dev, channel, formats);}
+	size_t input_elem_size = SoapySDR_formatToSize(input_format);
+	buffer = malloc(out_block_size * input_elem_size);
+	writer.buf16 = malloc(out_block_size * SoapySDR_formatToSize(SOAPY_SDR_CS16));
+	writer.conv = malloc(out_block_size * SoapySDR_formatToSize(output_format));
+	writer.input_format = input_format;
+	writer.output_format = output_format;
+	writer.input_elem_size = input_elem_size;
+	writer.output_elem_size = SoapySDR_formatToSize(output_format);
+
 	fprintf(stderr, "Using output format: %s (input format %s, %d bytes per element)\n", output_format, input_format, (int)input_elem_size);
+	fprintf(stderr, "Using %s DSP kernels.\n", dsp_init());
 
 #ifndef _WIN32
 	sigact.sa_handler = sighandler;
@@ -257,35 +459,41 @@ int main(int argc, char **argv)
 	SetConsoleCtrlHandler( (PHANDLER_ROUTINE) sighandler, TRUE );
 #endif
 
-	if (direct_sampling) {
-		verbose_direct_sampling(dev, direct_sampling);
-	}
+	if (!input_mode) {
+		if (direct_sampling) {
+			verbose_direct_sampling(dev, direct_sampling);
+		}
 
-	/* Set the sample rate */
-	verbose_set_sample_rate(dev, samp_rate, channel);
+		/* Set the sample rate */
+		verbose_set_sample_rate(dev, samp_rate, channel);
 
-	/* Set the frequency */
-	verbose_set_frequency(dev, frequency, channel);
+		/* Set the frequency */
+		verbose_set_frequency(dev, frequency, channel);
 
-	if (NULL == gain_str) {
-		 /* Enable automatic gain */
-		verbose_auto_gain(dev, channel);
-	} else {
-		/* Enable manual gain */
-		verbose_gain_str_set(dev, gain_str, channel);
-	}
+		if (NULL == gain_str) {
+			 /* Enable automatic gain */
+			verbose_auto_gain(dev, channel);
+		} else {
+			/* Enable manual gain */
+			verbose_gain_str_set(dev, gain_str, channel);
+		}
 
-	/* Set the antenna */
-	if (NULL != antenna_str){
-		r = verbose_antenna_str_set(dev, channel, antenna_str);
-		if(r != 0){
-			fprintf(stderr, "Failed to set antenna");
+		/* Set the antenna */
+		if (NULL != antenna_str){
+			r = verbose_antenna_str_set(dev, channel, antenna_str);
+			if(r != 0){
+				fprintf(stderr, "Failed to set antenna");
+			}
 		}
-	}
 
-	verbose_ppm_set(dev, ppm_error, channel);
+		verbose_ppm_set(dev, ppm_error, channel);
+	}
 
-	if(strcmp(filename, "-") == 0) { /* Write samples to stdout */
+	if (!filename) {
+		/* only broadcasting */
+		file = NULL;
+		sync_mode = 1;
+	} else if(strcmp(filename, "-") == 0) { /* Write samples to stdout */
 		file = stdout;
 #ifdef _WIN32
 		_setmode(_fileno(stdin), _O_BINARY);
@@ -298,129 +506,173 @@ int main(int argc, char **argv)
 		}
 	}
 
-	r = verbose_setup_stream(dev, &stream, channel, input_format);
-	if(r != 0){
-		fprintf(stderr, "Failed to setup stream\n");
+	if (shm_name) {
+		if (shm_ring_create(&shm, shm_name, input_format, input_elem_size,
+		    (double)samp_rate, (double)frequency, BROADCAST_MB) != 0) {
+			fprintf(stderr, "Failed to set up the broadcast '%s'\n", shm_name);
+			exit(1);
+		}
+		fprintf(stderr, "Broadcasting %s as '%s' (%u blocks of %d samples).\n",
+			input_format, shm_name, shm_ring_slot_count(&shm), SHM_RING_SLOT_ELEMS);
 	}
-	/* Reset endpoint before we start reading from it (mandatory) */
-	verbose_reset_buffer(dev);
 
-	if(sdr_settings)
-		verbose_settings(dev, sdr_settings);
+	if (input_mode) {
+		verbose_input_reader(&reader, &input);
+	} else {
+		r = verbose_setup_stream(dev, &stream, channel, input_format);
+		if(r != 0){
+			fprintf(stderr, "Failed to setup stream\n");
+		}
+		/* Reset endpoint before we start reading from it (mandatory) */
+		verbose_reset_buffer(dev);
 
-	if (true || sync_mode) {
+		if(sdr_settings)
+			verbose_settings(dev, sdr_settings);
+
+		verbose_stream_reader(&reader, dev, stream, zero_copy);
+	}
+	written_metric = metric_new(METRIC_COUNTER, "rx_sdr_written_bytes_total", "Bytes written to the output.", 1.0);
+	stalls_metric = metric_new(METRIC_COUNTER, "rx_sdr_write_stalls_total",
+		"Blocks dropped because the writer fell behind.", 1.0);
+	if (metrics_dest && verbose_metrics_start(metrics_dest, "rx_sdr") != 0) {
+		exit(1);}
+	writer.file = file;
+	if (!sync_mode) {
+		/* with driver buffers the reader converts, so the ring holds output */
+		writer.converted = reader.direct > 0;
+		slot_size = out_block_size * (writer.converted ? writer.output_elem_size : input_elem_size);
+		ring_depth = (unsigned)(((size_t)ring_mb << 20) / slot_size);
+		if (ring_depth < 2) {
+			ring_depth = 2;}
+		if (ring_init(&writer.ring, ring_depth, slot_size) != 0) {
+			fprintf(stderr, "Failed to allocate a %u MB ring, try a smaller -m\n", ring_mb);
+			exit(1);
+		}
+		fprintf(stderr, "Reading samples in async mode (%u blocks, %.1f MB)...\n",
+			ring_depth, (double)ring_depth * slot_size / (1 << 20));
+		pthread_create(&writer.thread, NULL, writer_thread_fn, (void *)(&writer));
+	} else {
 		fprintf(stderr, "Reading samples in sync mode...\n");
-		if (SoapySDRDevice_activateStream(dev, stream, 0, 0, 0) != 0) {
-			fprintf(stderr, "Failed to activate stream\n");
-                        exit(1);
-                }
-		suppress_stdout_stop(tmp_stdout);
-		while (!do_exit) {
-			void *buffs[] = {buffer};
-			int flags = 0;
-			long long timeNs = 0;
-			long timeoutNs = 1000000;
-			int n_read = 0, bytes_read = 0, elems_read, i;
-
-			elems_read = SoapySDRDevice_readStream(dev, stream, buffs, out_block_size, &flags, &timeNs, timeoutNs);
-
-			//fprintf(stderr, "readStream ret=%d, flags=%d, timeNs=%lld\n", elems_read, flags, timeNs);
-			if (elems_read >= 0) {
-				// elems_read is number of complex pairs of I+Q elements read
-				n_read = elems_read * 2; // one element read is I and Q
-				bytes_read = elems_read * input_elem_size;
-			} else {
-				if (elems_read == SOAPY_SDR_OVERFLOW) {
-					fprintf(stderr, "O");
-					fflush(stderr);
-					continue;
-				}
-				fprintf(stderr, "WARNING: sync read failed. %d\n", elems_read);
+	}
+	if (!input_mode && SoapySDRDevice_activateStream(dev, stream, 0, 0, 0) != 0) {
+		fprintf(stderr, "Failed to activate stream\n");
+		exit(1);
+	}
+	suppress_stdout_stop(tmp_stdout);
+	while (!do_exit) {
+		void *block = buffer;
+		int flags = 0;
+		long long timeNs = 0;
+		long timeoutNs = 1000000;
+		int elems_read;
+
+		/* a full ring drops the block here instead of at the device */
+		if (!sync_mode && !reader.direct) {
+			block = ring_write_slot(&writer.ring);
+			if (!block) {
+				metric_add(stalls_metric, 1);
+				fprintf(stderr, "D");
+				fflush(stderr);
+				block = buffer;
 			}
+		}
 
-			if ((samples_to_read > 0) && (samples_to_read < (uint32_t)elems_read)) {
-				// truncate to requested sample count
-				n_read = samples_to_read * 2;
-				bytes_read = samples_to_read * input_elem_size;
-				do_exit = 1;
-			}
+		elems_read = stream_acquire(&reader, &raw, block, out_block_size, &flags, &timeNs, timeoutNs);
 
-			if (ISFMT(output_format, input_format)) {
-				// The "native" format we read in, write out no conversion needed
-				if (fwrite(buffer, sizeof(uint8_t), bytes_read, file) != (size_t)bytes_read) {
-					fprintf(stderr, "Short write, samples lost, exiting!\n");
-					break;
-				}
-			} else if (ISFMT(input_format, SOAPY_SDR_CS12) && ISFMT(output_format, SOAPY_SDR_CS16)) {
-				uint8_t *src = (uint8_t *)buffer;
-				for (i = 0; i < elems_read; ++i) {
-					uint8_t b0 = *src++;
-					uint8_t b1 = *src++;
-					uint8_t b2 = *src++;
-					buf16[i * 2 + 0] = (b1 << 12) | (b0 << 4);
-					buf16[i * 2 + 1] = (b2 << 8) | (b1 & 0xf0);
-				}
-				if (fwrite(buf16, sizeof(int16_t), n_read, file) != (size_t)n_read) {
-					fprintf(stderr, "Short write, samples lost, exiting!\n");
-					break;
-				}
-			} else if (ISFMT(output_format, SOAPY_SDR_CS8)) {
-				for (i = 0; i < n_read; ++i) {
-					buf8[i] = ( (int16_t)buffer[i] / 32767.0 * 128.0 + 0.4);
-				}
-				if (fwrite(buf8, sizeof(int8_t), n_read, file) != (size_t)n_read) {
-					fprintf(stderr, "Short write, samples lost, exiting!\n");
-					break;
-				}
-			} else if (ISFMT(output_format, SOAPY_SDR_CU8)) {
-				for (i = 0; i < n_read; ++i) {
-					buf8[i] = ( (int16_t)buffer[i] / 32767.0 * 128.0 + 127.4);
-				}
-				if (fwrite(buf8, sizeof(uint8_t), n_read, file) != (size_t)n_read) {
-					fprintf(stderr, "Short write, samples lost, exiting!\n");
-					break;
-				}
-			} else if (ISFMT(output_format, SOAPY_SDR_CF32)) {
-				for (i = 0; i < n_read; ++i) {
-					fbuf[i] = buffer[i] * 1.0f / SHRT_MAX;
-				}
-				if (fwrite(fbuf, sizeof(float), n_read, file) != (size_t)n_read) {
-					fprintf(stderr, "Short write, samples lost, exiting!\n");
-					break;
-				}
+		//fprintf(stderr, "readStream ret=%d, flags=%d, timeNs=%lld\n", elems_read, flags, timeNs);
+		if (elems_read < 0) {
+			if (elems_read == SOAPY_SDR_OVERFLOW) {
+				fprintf(stderr, "O");
+				fflush(stderr);
+				continue;
 			}
+			if (elems_read == STREAM_EOF) {
+				ended = 1;
+				break;
+			}
+			fprintf(stderr, "WARNING: sync read failed. %d\n", elems_read);
+			continue;
+		}
+
+		if ((samples_to_read > 0) && (samples_to_read <= (uint32_t)elems_read)) {
+			// truncate to requested sample count
+			elems_read = samples_to_read;
+			do_exit = 1;
+		}
 
+		if (shm_name) {
+			broadcast(&shm, raw, elems_read, flags, timeNs);}
 
-                        // TODO: hmm.. n_read 8192, but out_block_size (16 * 16384) is much larger TODO: loop? or accept 8192? rtl_fm ok with it
-                        /*
-			if ((uint32_t)n_read < out_block_size) {
-				fprintf(stderr, "Short read, samples lost, exiting! (%d < %d)\n", n_read, out_block_size);
+		if (!file) {
+			stream_release(&reader);
+		} else if (reader.direct) {
+			r = direct_block(&writer, raw, elems_read, (int)out_block_size, sync_mode);
+			stream_release(&reader);
+			if (r != 0) {
+				writer.failed = 1;
 				break;
 			}
-                        */
+		} else if (sync_mode) {
+			if (write_block(&writer, block, elems_read) != 0) {
+				writer.failed = 1;
+				break;
+			}
+		} else if (block != buffer) {
+			ring_write_commit(&writer.ring, elems_read);
+		}
 
-			if (samples_to_read > 0)
-				samples_to_read -= elems_read;
+		// TODO: hmm.. n_read 8192, but out_block_size (16 * 16384) is much larger TODO: loop? or accept 8192? rtl_fm ok with it
+		/*
+		if ((uint32_t)n_read < out_block_size) {
+			fprintf(stderr, "Short read, samples lost, exiting! (%d < %d)\n", n_read, out_block_size);
+			break;
 		}
+		*/
+
+		if (samples_to_read > 0)
+			samples_to_read -= elems_read;
+	}
+
+	if (!sync_mode) {
+		ring_close(&writer.ring);
+		pthread_join(writer.thread, NULL);
+		fprintf(stderr, "\nRing high water: %u of %u blocks (%.1f MB), %u blocks dropped\n",
+			writer.ring.high_water, writer.ring.depth,
+			(double)writer.ring.high_water * slot_size / (1 << 20),
+			writer.ring.overruns);
+		ring_free(&writer.ring);
 	}
 
-	if (do_exit)
+	metrics_stop();
+
+	if (writer.failed) {
+		fprintf(stderr, "\nShort write, samples lost, exiting!\n");
+		r = 1;
+	} else if (ended) {
+		fprintf(stderr, "\nEnd of input, exiting...\n");
+	} else if (do_exit) {
 		fprintf(stderr, "\nUser cancel, exiting...\n");
-	else
-		fprintf(stderr, "\nLibrary error %d, exiting...\n", r);
+	} else {
+		fprintf(stderr, "\nLibrary error %d, exiting...\n", r);}
 
-	if (file != stdout)
+	if (file && file != stdout)
 		fclose(file);
 
-	SoapySDRDevice_deactivateStream(dev, stream, 0, 0);
-	SoapySDRDevice_closeStream(dev, stream);
-	SoapySDRDevice_unmake(dev);
+	if (shm_name) {
+		shm_ring_close(&shm);}
+
+	if (input_mode) {
+		input_close(&input);
+	} else {
+		SoapySDRDevice_deactivateStream(dev, stream, 0, 0);
+		SoapySDRDevice_closeStream(dev, stream);
+		SoapySDRDevice_unmake(dev);
+	}
 
 out:
 	free(buffer);
-	free(buf8);
-	free(buf16);
-	free(fbuf);
+	free(writer.buf16);
+	free(writer.conv);
 
 	return r >= 0 ? r : -r;
 }
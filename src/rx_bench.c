@@ -0,0 +1,1042 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * times the DSP kernels of rx_fm, rx_power and rx_sdr on synthetic
+ * signals, one block of the size the tools use per call
+ *
+ * every call starts from the same input, so in place kernels see
+ * a realistic signal each time, and the median call is reported
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <time.h>
+#else
+#include <windows.h>
+#include "getopt/getopt.h"
+#define _USE_MATH_DEFINES
+#endif
+
+#include <math.h>
+
+#include "kernels.h"
+#include "fft.h"
+#include "demod.h"
+#include "fir.h"
+#include "power.h"
+
+#ifdef HAVE_X86_KERNELS
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define HAVE_TSC
+#endif
+
+#define FM_BLOCK		8192    /* complex samples, rx_fm's DEFAULT_BUF_LENGTH */
+#define AUDIO_BLOCK		4096
+#define CONV_BLOCK		131072  /* complex samples, rx_sdr's DEFAULT_BUF_LENGTH in CS16 */
+#define POWER_BLOCK		8192
+#define CIC_BLOCK		131072  /* complex samples, a whole rx_fm block */
+#define CIC_PASSES		6       /* -F at -s 24k */
+#define CHANNEL_DOWNSAMPLE	42      /* -M fm -s 24k captures at 1.008 MS/s */
+#define CHANNEL_PASSES		1       /* fifth_order halvings rx_fm does first */
+#define FFT_LOG2		10
+#define MAX_CALLS		4096
+#define LEVELS			4
+#define LUT512_SIZE		131072  /* the -A lut table rx_fm had, 512 KB */
+#define LUT512_COEF		8
+
+static const char *level_names[LEVELS] = {"scalar", "sse2", "avx2", "avx512"};
+
+/* cic_9_tables[4] of rx_fm */
+static const int cic_9[10] = {9, -122, -612, 6082, -26353, 77818, -26353, 6082, -612, -122};
+
+/* pristine inputs */
+static int16_t *fm_iq, *am_iq, *noise_iq, *audio, *conv_iq;
+static int8_t *conv_cs8;
+static uint8_t *conv_cu8, *conv_cs12;
+static float *conv_cf32, *fft_in, *window;
+static double *bins;
+
+/* work buffers */
+static int16_t *work16, *result16;
+static uint8_t *work8;
+static float *workf, *fft_work;
+static double *avg;
+static struct demod_state dm;
+static struct fir_filter droop, channel;
+static struct fir_resampler resample_32k, resample_44k1;
+static struct tuning_state ts;
+static int16_t hist_i[10], hist_q[10];
+static struct cic_state cic, channel_cic;
+static struct fft_plan *fft_builtin, *fft_fftw;
+static int *lut512;
+static FILE *null_file;
+
+struct bench
+{
+	const char *name;
+	const char *unit;  /* what one sample is */
+	int samples;       /* per call */
+	int tiered;        /* runs once per SIMD level */
+	void (*reset)(void);  /* untimed */
+	void (*run)(void);
+};
+
+struct result
+{
+	double ns;      /* per sample */
+	double cycles;  /* per sample, < 0 when unknown */
+};
+
+void usage(void)
+{
+	fprintf(stderr,
+		"rx_bench, times the DSP kernels of the rx tools\n\n"
+		"Use:\trx_bench [-options]\n"
+		"\t[-k kernel (default: all, matches substrings, use multiple -k for more)]\n"
+		"\t[-s simd level (default: every one the cpu has)]\n"
+		"\t	scalar, sse2, avx2, avx512\n"
+		"\t[-t seconds per kernel (default: 0.2)]\n"
+		"\t[-c clock_ghz, cycles are ns times this instead of the TSC]\n"
+		"\t[-j write JSON instead of a table]\n"
+		"\t[-e report the FM discriminators' error against atan2 instead]\n"
+		"\t[-v check every simd level against scalar at odd and even lengths instead]\n"
+		"\t[-l list the kernels]\n\n"
+		"Samples are complex for I/Q kernels, real for audio and bins for csv_dbm.\n"
+		"The TSC counts at its nominal rate, not the actual core clock.\n\n");
+	exit(1);
+}
+
+static double now_ns(void)
+{
+#ifndef _WIN32
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+#else
+	LARGE_INTEGER f, c;
+	QueryPerformanceFrequency(&f);
+	QueryPerformanceCounter(&c);
+	return (double)c.QuadPart * 1e9 / (double)f.QuadPart;
+#endif
+}
+
+static uint64_t tsc(void)
+{
+#ifdef HAVE_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static double noise(void)
+/* roughly gaussian, unit variance */
+{
+	int i;
+	double sum = 0.0;
+	for (i=0; i<12; i++) {
+		sum += (double)rand() / RAND_MAX;}
+	return sum - 6.0;
+}
+
+static int16_t quantize(double x)
+{
+	if (x > 32767.0) {
+		return 32767;}
+	if (x < -32768.0) {
+		return -32768;}
+	return (int16_t)lrint(x);
+}
+
+static void *alloc(size_t bytes)
+{
+	void *p = calloc(1, bytes);
+	if (!p) {
+		fprintf(stderr, "Out of memory.\n");
+		exit(1);
+	}
+	return p;
+}
+
+static void filters_init(void)
+/* rx_fm's droop filter after -F, its channel filter without and
+   the -M wbfm audio resampled by -r to 32k (rational) or 44.1k (not) */
+{
+	double *h = alloc(FIR_MAX_TAPS * sizeof(double));
+	struct fir_taps *droop_taps, *channel_taps;
+	int k, n;
+	for (k=0; k<9; k++) {
+		h[k] = cic_9[k+1] / 32768.0;}
+	droop_taps = fir_taps_new(h, 9, 1);
+	n = fir_kaiser_taps(0.25 / (CHANNEL_DOWNSAMPLE >> CHANNEL_PASSES), 60.0);
+	fir_kaiser_lowpass(h, n, 0.5 / (CHANNEL_DOWNSAMPLE >> CHANNEL_PASSES), 60.0);
+	channel_taps = fir_taps_new(h, n, CHANNEL_DOWNSAMPLE >> CHANNEL_PASSES);
+	if (!droop_taps || !channel_taps || fir_init(&droop, droop_taps) != 0 ||
+	    fir_init(&channel, channel_taps) != 0 ||
+	    fir_resampler_init(&resample_32k, 170000, 32000) != 0 ||
+	    fir_resampler_init(&resample_44k1, 170000, 44100) != 0) {
+		fprintf(stderr, "Out of memory.\n");
+		exit(1);
+	}
+	free(h);
+}
+
+static void signals_init(void)
+/* an FM voice channel and an AM carrier at -12 dBFS in noise */
+{
+	int i;
+	double phase = 0.0, amp = 8192.0, env;
+	struct dsp_kernels scalar;
+	dsp_init_scalar(&scalar);
+	srand(1);
+	fm_iq   = alloc(2 * CONV_BLOCK * sizeof(int16_t));
+	am_iq   = alloc(2 * FM_BLOCK * sizeof(int16_t));
+	conv_iq = fm_iq;
+	for (i=0; i<CONV_BLOCK; i++) {
+		/* 0.05 cycles per sample off center, deviation 0.02, tone 0.0005 */
+		phase += 2 * M_PI * (0.05 + 0.02 * sin(2 * M_PI * 0.0005 * i));
+		fm_iq[2*i]   = quantize(amp * cos(phase) + 300 * noise());
+		fm_iq[2*i+1] = quantize(amp * sin(phase) + 300 * noise());
+	}
+	for (i=0; i<FM_BLOCK; i++) {
+		env = amp * (1.0 + 0.5 * sin(2 * M_PI * 0.0005 * i));
+		am_iq[2*i]   = quantize(env * cos(2 * M_PI * 0.05 * i) + 300 * noise());
+		am_iq[2*i+1] = quantize(env * sin(2 * M_PI * 0.05 * i) + 300 * noise());
+	}
+	/* what an open squelch hears, every phase step as likely */
+	noise_iq = alloc(2 * FM_BLOCK * sizeof(int16_t));
+	for (i=0; i<2*FM_BLOCK; i++) {
+		noise_iq[i] = quantize(amp * noise());}
+	audio = alloc(FM_BLOCK * sizeof(int16_t));
+	for (i=0; i<FM_BLOCK; i++) {
+		audio[i] = quantize(6000 * sin(2 * M_PI * 0.01 * i) + 200 * noise());}
+	conv_cs8  = alloc(2 * CONV_BLOCK);
+	conv_cu8  = alloc(2 * CONV_BLOCK);
+	conv_cs12 = alloc(3 * CONV_BLOCK);
+	conv_cf32 = alloc(2 * CONV_BLOCK * sizeof(float));
+	scalar.cs16_to_cs8(conv_iq, conv_cs8, 2 * CONV_BLOCK);
+	scalar.cs16_to_cu8(conv_iq, conv_cu8, 2 * CONV_BLOCK);
+	scalar.cs16_to_cs12(conv_iq, conv_cs12, 2 * CONV_BLOCK);
+	scalar.cs16_to_cf32(conv_iq, conv_cf32, 2 * CONV_BLOCK);
+	work16   = alloc(2 * CONV_BLOCK * sizeof(int16_t));
+	result16 = alloc(2 * CONV_BLOCK * sizeof(int16_t));
+	work8    = alloc(4 * CONV_BLOCK);
+	workf    = alloc(2 * CONV_BLOCK * sizeof(float));
+	window   = alloc((1 << FFT_LOG2) * sizeof(float));
+	for (i=0; i<(1 << FFT_LOG2); i++) {
+		window[i] = (float)(0.5 - 0.5 * cos(2 * M_PI * i / (1 << FFT_LOG2)));}
+	fft_in = fft_malloc(1 << FFT_LOG2);
+	fft_work = fft_malloc(1 << FFT_LOG2);
+	scalar.window_cs16(fm_iq, window, fft_in, 1 << FFT_LOG2);
+	fft_builtin = fft_plan_new(FFT_LOG2, FFT_BACKEND_BUILTIN);
+	fft_fftw = fft_plan_new(FFT_LOG2, FFT_BACKEND_FFTW);
+	avg  = alloc(POWER_BLOCK * sizeof(double));
+	bins = alloc((1 << FFT_LOG2) * sizeof(double));
+	for (i=0; i<(1 << FFT_LOG2); i++) {
+		bins[i] = 1e9 * (1.0 + 0.1 * noise() * noise());}
+	filters_init();
+	atan_lut_init();
+	lut512 = alloc(LUT512_SIZE * sizeof(int));
+	for (i=0; i<LUT512_SIZE; i++) {
+		lut512[i] = (int)(atan((double)i / (1<<LUT512_COEF)) / 3.14159 * (1<<14));}
+#ifndef _WIN32
+	null_file = fopen("/dev/null", "w");
+#else
+	null_file = fopen("NUL", "w");
+#endif
+	if (!null_file) {
+		perror("null device");
+		exit(1);
+	}
+}
+
+/* rx_fm */
+
+static void reset_fm_block(void)
+{
+	memcpy(work16, fm_iq, 2 * FM_BLOCK * sizeof(int16_t));
+}
+
+static void run_rotate16_90(void)
+{
+	dsp.rotate16_90(fm_iq, work16, 2 * FM_BLOCK);
+}
+
+static void run_fifth_order(void)
+{
+	dsp.fifth_order(work16, 2 * FM_BLOCK, hist_i, hist_q);
+}
+
+static void reset_cic(void)
+{
+	memcpy(work16, fm_iq, 2 * CIC_BLOCK * sizeof(int16_t));
+}
+
+static void run_fifth_passes(void)
+/* the cascade one whole block sweep per pass, as rx_fm used to */
+{
+	int p;
+	for (p=0; p<CIC_PASSES; p++) {
+		dsp.fifth_order(work16, (2 * CIC_BLOCK) >> p, cic.hist[p], cic.hist[p] + 6);}
+}
+
+static void run_cic_decimate(void)
+{
+	cic_decimate(&cic, work16, 2 * CIC_BLOCK, CIC_PASSES, 0);
+}
+
+static void run_fir_droop(void)
+{
+	fir_decimate(&droop, work16, 2 * FM_BLOCK);
+}
+
+static void run_fir_channel(void)
+{
+	fir_decimate(&channel, work16, cic_decimate(&channel_cic, work16, 2 * FM_BLOCK, CHANNEL_PASSES, 0));
+}
+
+static void reset_demod(void)
+{
+	dm.lowpassed = fm_iq;
+	dm.lp_len = 2 * FM_BLOCK;
+	dm.result = result16;
+}
+
+static void reset_am_demod(void)
+{
+	reset_demod();
+	dm.lowpassed = am_iq;
+}
+
+static void reset_noise_demod(void)
+{
+	reset_demod();
+	dm.lowpassed = noise_iq;
+}
+
+static void run_fm_std(void)
+{
+	dm.custom_atan = 0;
+	fm_demod(&dm);
+}
+
+static void run_fm_fast(void)
+{
+	dm.custom_atan = 1;
+	fm_demod(&dm);
+}
+
+static void run_fm_lut(void)
+{
+	dm.custom_atan = 2;
+	fm_demod(&dm);
+}
+
+static void run_fm_ale(void)
+{
+	dm.custom_atan = 3;
+	fm_demod(&dm);
+}
+
+static int polar_disc_lut512(int ar, int aj, int br, int bj)
+/* -A lut as it was, a division per sample into a 512 KB table */
+{
+	int64_t cr, cj, x, x_abs;
+	cr = (int64_t)ar*br + (int64_t)aj*bj;
+	cj = (int64_t)aj*br - (int64_t)ar*bj;
+	if (cr == 0 || cj == 0) {
+		if (cr == 0 && cj == 0)
+			{return 0;}
+		if (cr == 0)
+			{return cj > 0 ? 1 << 13 : -(1 << 13);}
+		return cr > 0 ? 0 : 1 << 14;
+	}
+	x = (cj * (1<<LUT512_COEF)) / cr;
+	x_abs = x < 0 ? -x : x;
+	if (x_abs >= LUT512_SIZE) {
+		return (cj > 0) ? 1<<13 : -(1<<13);}
+	if (x > 0) {
+		return (cj > 0) ? lut512[x] : lut512[x] - (1<<14);}
+	return (cj > 0) ? (1<<14) - lut512[-x] : -lut512[-x];
+}
+
+static void run_fm_lut512(void)
+{
+	int k, pr = dm.pre_r, pj = dm.pre_j;
+	const int16_t *lp = dm.lowpassed;
+	for (k=0; k<dm.lp_len/2; k++) {
+		result16[k] = (int16_t)polar_disc_lut512(lp[2*k], lp[2*k+1], pr, pj);
+		pr = lp[2*k];
+		pj = lp[2*k+1];
+	}
+	dm.result_len = dm.lp_len / 2;
+}
+
+static void run_am_demod(void)
+{
+	am_demod(&dm);
+}
+
+static void reset_audio(void)
+{
+	memcpy(result16, audio, AUDIO_BLOCK * sizeof(int16_t));
+	dm.result = result16;
+	dm.result_len = AUDIO_BLOCK;
+	/* -M wbfm, 170k down to 32k with 75 us de-emphasis */
+	dm.rate_out = 170000;
+	dm.deemph_a = (int)round(1.0/((1.0-exp(-1.0/(dm.rate_out * 75e-6)))));
+}
+
+static void run_resample_32k(void)
+{
+	fir_resample(&resample_32k, result16, AUDIO_BLOCK, AUDIO_BLOCK);
+}
+
+static void run_resample_44k1(void)
+{
+	fir_resample(&resample_44k1, result16, AUDIO_BLOCK, AUDIO_BLOCK);
+}
+
+static void run_deemph_filter(void)
+{
+	deemph_filter(&dm);
+}
+
+/* rx_power */
+
+static void run_window_cs16(void)
+{
+	dsp.window_cs16(fm_iq, window, workf, 1 << FFT_LOG2);
+}
+
+static void reset_fft(void)
+{
+	memcpy(fft_work, fft_in, 2 * (1 << FFT_LOG2) * sizeof(float));
+}
+
+static void run_fft_builtin(void)
+{
+	fft_forward(fft_builtin, fft_work);
+}
+
+static void run_fft_fftw(void)
+{
+	fft_forward(fft_fftw, fft_work);
+}
+
+static void run_power_sum(void)
+{
+	dsp.power_sum(fft_in, avg, 1 << FFT_LOG2);
+}
+
+static void reset_rms_power(void)
+{
+	ts.buf16 = fm_iq;
+	ts.buf_len = 2 * POWER_BLOCK;
+	ts.avg = avg;
+	avg[0] = 0.0;
+}
+
+static void run_rms_power(void)
+{
+	rms_power(&ts, 0);
+}
+
+static void reset_csv_dbm(void)
+{
+	memcpy(avg, bins, (1 << FFT_LOG2) * sizeof(double));
+	ts.freq = 100000000;
+	ts.rate = 2400000;
+	ts.bin_e = FFT_LOG2;
+	ts.avg = avg;
+	ts.samples = 100;
+	ts.downsample = 1;
+	ts.crop = 0.0;
+}
+
+static void run_csv_dbm(void)
+{
+	csv_dbm(null_file, &ts);
+}
+
+/* rx_sdr */
+
+static void run_cs16_to_cs8(void)
+{
+	dsp.cs16_to_cs8(conv_iq, (int8_t *)work8, 2 * CONV_BLOCK);
+}
+
+static void run_cs16_to_cu8(void)
+{
+	dsp.cs16_to_cu8(conv_iq, work8, 2 * CONV_BLOCK);
+}
+
+static void run_cs16_to_cs12(void)
+{
+	dsp.cs16_to_cs12(conv_iq, work8, 2 * CONV_BLOCK);
+}
+
+static void run_cs16_to_cf32(void)
+{
+	dsp.cs16_to_cf32(conv_iq, workf, 2 * CONV_BLOCK);
+}
+
+static void run_cs8_to_cs16(void)
+{
+	dsp.cs8_to_cs16(conv_cs8, work16, 2 * CONV_BLOCK);
+}
+
+static void run_cu8_to_cs16(void)
+{
+	dsp.cu8_to_cs16(conv_cu8, work16, 2 * CONV_BLOCK);
+}
+
+static void run_cs12_to_cs16(void)
+{
+	dsp.cs12_to_cs16(conv_cs12, work16, 2 * CONV_BLOCK);
+}
+
+static void run_cf32_to_cs16(void)
+{
+	dsp.cf32_to_cs16(conv_cf32, work16, 2 * CONV_BLOCK);
+}
+
+static void run_flip8(void)
+{
+	dsp.flip8(conv_cu8, work8, 2 * CONV_BLOCK);
+}
+
+static struct bench benches[] = {
+	{"rotate16_90",     "iq",    FM_BLOCK,    1, NULL,            run_rotate16_90},
+	{"fifth_order",     "iq",    FM_BLOCK,    1, reset_fm_block,  run_fifth_order},
+	{"fifth_passes",    "iq",    CIC_BLOCK,   1, reset_cic,       run_fifth_passes},
+	{"cic_decimate",    "iq",    CIC_BLOCK,   1, reset_cic,       run_cic_decimate},
+	{"fir_droop",       "iq",    FM_BLOCK,    1, reset_fm_block,  run_fir_droop},
+	{"fir_channel",     "iq",    FM_BLOCK,    1, reset_fm_block,  run_fir_channel},
+	{"fm_demod_std",    "iq",    FM_BLOCK,    1, reset_demod,     run_fm_std},
+	{"fm_demod_fast",   "iq",    FM_BLOCK,    0, reset_demod,     run_fm_fast},
+	{"fm_demod_lut",    "iq",    FM_BLOCK,    0, reset_demod,     run_fm_lut},
+	{"fm_demod_ale",    "iq",    FM_BLOCK,    0, reset_demod,     run_fm_ale},
+	{"fm_demod_lut512", "iq",    FM_BLOCK,    0, reset_demod,     run_fm_lut512},
+	{"fm_noise_lut",    "iq",    FM_BLOCK,    0, reset_noise_demod, run_fm_lut},
+	{"fm_noise_lut512", "iq",    FM_BLOCK,    0, reset_noise_demod, run_fm_lut512},
+	{"am_demod",        "iq",    FM_BLOCK,    0, reset_am_demod,  run_am_demod},
+	{"resample_32k",    "audio", AUDIO_BLOCK, 1, reset_audio,     run_resample_32k},
+	{"resample_44k1",   "audio", AUDIO_BLOCK, 1, reset_audio,     run_resample_44k1},
+	{"deemph_filter",   "audio", AUDIO_BLOCK, 0, reset_audio,     run_deemph_filter},
+	{"window_cs16",     "iq",    1 << FFT_LOG2, 1, NULL,          run_window_cs16},
+	{"fft_forward",     "iq",    1 << FFT_LOG2, 1, reset_fft,     run_fft_builtin},
+	{"fft_forward_fftw", "iq",   1 << FFT_LOG2, 0, reset_fft,     run_fft_fftw},
+	{"power_sum",       "iq",    1 << FFT_LOG2, 1, NULL,          run_power_sum},
+	{"rms_power",       "iq",    POWER_BLOCK, 0, reset_rms_power, run_rms_power},
+	{"csv_dbm",         "bin",   1 << FFT_LOG2, 0, reset_csv_dbm, run_csv_dbm},
+	{"cs16_to_cs8",     "iq",    CONV_BLOCK,  1, NULL,            run_cs16_to_cs8},
+	{"cs16_to_cu8",     "iq",    CONV_BLOCK,  1, NULL,            run_cs16_to_cu8},
+	{"cs16_to_cs12",    "iq",    CONV_BLOCK,  1, NULL,            run_cs16_to_cs12},
+	{"cs16_to_cf32",    "iq",    CONV_BLOCK,  1, NULL,            run_cs16_to_cf32},
+	{"cs8_to_cs16",     "iq",    CONV_BLOCK,  1, NULL,            run_cs8_to_cs16},
+	{"cu8_to_cs16",     "iq",    CONV_BLOCK,  1, NULL,            run_cu8_to_cs16},
+	{"cs12_to_cs16",    "iq",    CONV_BLOCK,  1, NULL,            run_cs12_to_cs16},
+	{"cf32_to_cs16",    "iq",    CONV_BLOCK,  1, NULL,            run_cf32_to_cs16},
+	{"flip8",           "iq",    CONV_BLOCK,  1, NULL,            run_flip8},
+};
+
+#define BENCH_COUNT	((int)(sizeof(benches) / sizeof(benches[0])))
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static struct result measure(struct bench *b, double seconds, double clock_ghz)
+{
+	static double ns[MAX_CALLS], cyc[MAX_CALLS];
+	struct result r;
+	double t0, t1, start;
+	uint64_t c0, c1;
+	int n = 0;
+	/* warm up caches and branch predictors */
+	if (b->reset) {
+		b->reset();}
+	b->run();
+	start = now_ns();
+	while (n < MAX_CALLS && (n < 5 || now_ns() - start < seconds * 1e9)) {
+		if (b->reset) {
+			b->reset();}
+		c0 = tsc();
+		t0 = now_ns();
+		b->run();
+		t1 = now_ns();
+		c1 = tsc();
+		ns[n] = t1 - t0;
+		cyc[n] = (double)(c1 - c0);
+		n++;
+	}
+	qsort(ns, n, sizeof(double), cmp_double);
+	qsort(cyc, n, sizeof(double), cmp_double);
+	r.ns = ns[n/2] / b->samples;
+	r.cycles = -1.0;
+	if (clock_ghz > 0) {
+		r.cycles = r.ns * clock_ghz;}
+#ifdef HAVE_TSC
+	else {
+		r.cycles = cyc[n/2] / b->samples;}
+#endif
+	return r;
+}
+
+static void disc_errors(void)
+/* each -A against the exact angle, in output lsb (pi is 1<<14) */
+{
+	struct {const char *name; void (*run)(void);} discs[] = {
+		{"std", run_fm_std}, {"fast", run_fm_fast}, {"lut", run_fm_lut},
+		{"lut512", run_fm_lut512}, {"ale", run_fm_ale}};
+	const int16_t *signals[2] = {fm_iq, noise_iq};
+	const char *signal_names[2] = {"fm", "noise"};
+	const int16_t *lp;
+	double cr, cj, e, max, sum;
+	int d, i, k;
+	printf("%-8s %-6s %10s %10s\n", "atan", "signal", "max_err", "rms_err");
+	for (d=0; d<(int)(sizeof(discs) / sizeof(discs[0])); d++) {
+		for (i=0; i<2; i++) {
+			lp = signals[i];
+			reset_demod();
+			dm.lowpassed = (int16_t *)lp;
+			discs[d].run();
+			max = sum = 0.0;
+			/* the first sample depends on the previous block */
+			for (k=1; k<FM_BLOCK; k++) {
+				cr = (double)lp[2*k] * lp[2*k-2] + (double)lp[2*k+1] * lp[2*k-1];
+				cj = (double)lp[2*k+1] * lp[2*k-2] - (double)lp[2*k] * lp[2*k-1];
+				e = result16[k] - atan2(cj, cr) / M_PI * (1<<14);
+				if (e > (1<<14)) {
+					e -= 1<<15;}
+				if (e < -(1<<14)) {
+					e += 1<<15;}
+				if (fabs(e) > max) {
+					max = fabs(e);}
+				sum += e * e;
+			}
+			printf("%-8s %-6s %10.3f %10.3f\n", discs[d].name, signal_names[i],
+				max, sqrt(sum / (FM_BLOCK - 1)));
+		}
+	}
+}
+
+/* -v, every SIMD level against the scalar reference */
+
+#define VERIFY_MAX	8192  /* int16 values of input per call */
+#define FFT_MAX_LOG2	12
+
+static const int verify_lengths[] = {1, 2, 3, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33,
+	36, 37, 63, 64, 65, 100, 101, 1024, 1025, 4097, 4098};
+
+static int16_t *v_in16, *v_hist, *v_coef;
+static uint8_t *v_in8;
+static float *v_inf, *v_fft;
+static double *v_avg;
+
+static void verify_init(void)
+/* full scale int16 with the extremes, floats past the clamps */
+{
+	int i;
+	v_in16 = alloc(4 * VERIFY_MAX * sizeof(int16_t));
+	v_in8  = alloc(4 * VERIFY_MAX);
+	v_inf  = alloc(4 * VERIFY_MAX * sizeof(float));
+	v_hist = alloc(12 * sizeof(int16_t));
+	v_coef = alloc(FIR_ALIGN * 2 * sizeof(int16_t));
+	v_avg  = alloc(2 * VERIFY_MAX * sizeof(double));
+	v_fft  = fft_malloc(1 << FFT_MAX_LOG2);
+	srand(2);
+	for (i=0; i<4*VERIFY_MAX; i++) {
+		v_in16[i] = (int16_t)(rand() & 0xffff);
+		v_in8[i] = (uint8_t)(rand() & 0xff);
+		v_inf[i] = (float)(2.5 * rand() / RAND_MAX - 1.25);
+	}
+	v_in16[0] = v_in16[3] = -32768;
+	v_in16[1] = v_in16[2] = 32767;
+	v_inf[0] = 0.5f / 32768.0f;
+	v_inf[1] = -1.5f / 32768.0f;
+	for (i=0; i<12; i++) {
+		v_hist[i] = v_in16[4*VERIFY_MAX - 1 - i];}
+	/* 64 taps of at most 512 keep fir_iq's sum within 32 bits */
+	for (i=0; i<2*FIR_ALIGN; i++) {
+		v_coef[i] = (int16_t)(rand() % 1025 - 512);}
+	/* power_max keeps some bins and replaces others */
+	for (i=0; i<2*VERIFY_MAX; i++) {
+		v_avg[i] = 1.5 * rand() / RAND_MAX;}
+}
+
+/* each writes what the kernel produced to out and returns its size in bytes */
+
+static size_t verify_rotate16_90(struct dsp_kernels *k, int n, void *out)
+{
+	n = n < 8 ? 8 : n & ~7;
+	k->rotate16_90(v_in16, out, n);
+	return n * sizeof(int16_t);
+}
+
+static size_t verify_fifth_order(struct dsp_kernels *k, int n, void *out)
+/* a value past the block shows writes outside it */
+{
+	int16_t *data = out;
+	memcpy(data, v_in16, (n + 1) * sizeof(int16_t));
+	memcpy(data + n + 1, v_hist, 12 * sizeof(int16_t));
+	k->fifth_order(data, n, data + n + 1, data + n + 7);
+	return (n + 13) * sizeof(int16_t);
+}
+
+static size_t verify_fifth_decimate(struct dsp_kernels *k, int n, void *out)
+{
+	k->fifth_decimate(v_in16 + 12, out, n);
+	return 2 * n * sizeof(int16_t);
+}
+
+static size_t verify_split_iq(struct dsp_kernels *k, int n, void *out)
+{
+	int16_t *o = out;
+	k->split_iq(v_in16, o, o + n, n);
+	return 2 * n * sizeof(int16_t);
+}
+
+static size_t verify_fir_iq(struct dsp_kernels *k, int n, void *out)
+{
+	k->fir_iq(v_in16, v_in16 + 2*VERIFY_MAX, out, n, 3, v_coef, 2 * FIR_ALIGN, 15);
+	return 2 * n * sizeof(int16_t);
+}
+
+static size_t verify_fir_short(struct dsp_kernels *k, int n, void *out)
+{
+	k->fir_short(v_in16, v_in16 + 2*VERIFY_MAX, out, n, v_coef, 10, 15);
+	return 2 * n * sizeof(int16_t);
+}
+
+static size_t verify_dot16(struct dsp_kernels *k, int n, void *out)
+{
+	int32_t sum;
+	n = n < FIR_ALIGN ? FIR_ALIGN : n / FIR_ALIGN * FIR_ALIGN;
+	sum = k->dot16(v_in16, v_coef, n < 2 * FIR_ALIGN ? n : 2 * FIR_ALIGN);
+	memcpy(out, &sum, sizeof(sum));
+	return sizeof(sum);
+}
+
+static size_t verify_fm_disc(struct dsp_kernels *k, int n, void *out)
+{
+	k->fm_disc(v_in16, out, n, v_hist[0], v_hist[1]);
+	return n * sizeof(int16_t);
+}
+
+static size_t verify_remove_dc(struct dsp_kernels *k, int n, void *out)
+{
+	memcpy(out, v_in16, 2 * n * sizeof(int16_t));
+	k->remove_dc(out, 2 * n);
+	return 2 * n * sizeof(int16_t);
+}
+
+static size_t verify_cs16_to_cs8(struct dsp_kernels *k, int n, void *out)
+{
+	k->cs16_to_cs8(v_in16, out, n);
+	return n;
+}
+
+static size_t verify_cs16_to_cu8(struct dsp_kernels *k, int n, void *out)
+{
+	k->cs16_to_cu8(v_in16, out, n);
+	return n;
+}
+
+static size_t verify_cs16_to_cf32(struct dsp_kernels *k, int n, void *out)
+{
+	k->cs16_to_cf32(v_in16, out, n);
+	return n * sizeof(float);
+}
+
+static size_t verify_cs16_to_cs12(struct dsp_kernels *k, int n, void *out)
+{
+	n &= ~1;
+	k->cs16_to_cs12(v_in16, out, n);
+	return n / 2 * 3;
+}
+
+static size_t verify_cs8_to_cs16(struct dsp_kernels *k, int n, void *out)
+{
+	k->cs8_to_cs16((const int8_t *)v_in8, out, n);
+	return n * sizeof(int16_t);
+}
+
+static size_t verify_cu8_to_cs16(struct dsp_kernels *k, int n, void *out)
+{
+	k->cu8_to_cs16(v_in8, out, n);
+	return n * sizeof(int16_t);
+}
+
+static size_t verify_cs12_to_cs16(struct dsp_kernels *k, int n, void *out)
+{
+	n &= ~1;
+	k->cs12_to_cs16(v_in8, out, n);
+	return n * sizeof(int16_t);
+}
+
+static size_t verify_cf32_to_cs16(struct dsp_kernels *k, int n, void *out)
+{
+	k->cf32_to_cs16(v_inf, out, n);
+	return n * sizeof(int16_t);
+}
+
+static size_t verify_flip8(struct dsp_kernels *k, int n, void *out)
+{
+	k->flip8(v_in8, out, n);
+	return n;
+}
+
+static size_t verify_window_cs16(struct dsp_kernels *k, int n, void *out)
+{
+	k->window_cs16(v_in16, v_inf, out, n);
+	return 2 * n * sizeof(float);
+}
+
+static size_t verify_fft_radix4(struct dsp_kernels *k, int n, void *out)
+/* through the builtin plan, sized by the top bit of n */
+{
+	struct fft_plan *plan;
+	int log2n = 0;
+	while ((2 << log2n) <= n && log2n < FFT_MAX_LOG2) {
+		log2n++;}
+	plan = fft_plan_new(log2n, FFT_BACKEND_BUILTIN);
+	if (!plan) {
+		fprintf(stderr, "Out of memory.\n");
+		exit(1);
+	}
+	memcpy(v_fft, v_inf, (2 << log2n) * sizeof(float));
+	dsp = *k;
+	fft_forward(plan, v_fft);
+	fft_plan_free(plan);
+	memcpy(out, v_fft, (2 << log2n) * sizeof(float));
+	return (2 << log2n) * sizeof(float);
+}
+
+static size_t verify_power_sum(struct dsp_kernels *k, int n, void *out)
+{
+	memcpy(out, v_avg, n * sizeof(double));
+	k->power_sum(v_inf, out, n);
+	return n * sizeof(double);
+}
+
+static size_t verify_power_max(struct dsp_kernels *k, int n, void *out)
+{
+	memcpy(out, v_avg, n * sizeof(double));
+	k->power_max(v_inf, out, n);
+	return n * sizeof(double);
+}
+
+static int verify_tiers(struct dsp_kernels *tiers, int *have)
+/* returns the number of mismatches */
+{
+	struct {const char *name; size_t (*run)(struct dsp_kernels *k, int n, void *out);} checks[] = {
+		{"rotate16_90", verify_rotate16_90}, {"fifth_order", verify_fifth_order},
+		{"fifth_decimate", verify_fifth_decimate}, {"split_iq", verify_split_iq},
+		{"fir_iq", verify_fir_iq}, {"fir_short", verify_fir_short},
+		{"dot16", verify_dot16}, {"fm_disc", verify_fm_disc},
+		{"remove_dc", verify_remove_dc}, {"cs16_to_cs8", verify_cs16_to_cs8},
+		{"cs16_to_cu8", verify_cs16_to_cu8}, {"cs16_to_cf32", verify_cs16_to_cf32},
+		{"cs16_to_cs12", verify_cs16_to_cs12}, {"cs8_to_cs16", verify_cs8_to_cs16},
+		{"cu8_to_cs16", verify_cu8_to_cs16}, {"cs12_to_cs16", verify_cs12_to_cs16},
+		{"cf32_to_cs16", verify_cf32_to_cs16}, {"flip8", verify_flip8},
+		{"window_cs16", verify_window_cs16}, {"fft_radix4", verify_fft_radix4},
+		{"power_sum", verify_power_sum}, {"power_max", verify_power_max}};
+	int c, i, level, n, failed = 0;
+	size_t want, got;
+	uint8_t *ref = alloc(16 * VERIFY_MAX);
+	uint8_t *test = alloc(16 * VERIFY_MAX);
+	verify_init();
+	for (c=0; c<(int)(sizeof(checks) / sizeof(checks[0])); c++) {
+		for (level=1; level<LEVELS; level++) {
+			if (!have[level]) {
+				continue;}
+			for (i=0; i<(int)(sizeof(verify_lengths) / sizeof(verify_lengths[0])); i++) {
+				n = verify_lengths[i];
+				memset(ref, 0x55, 16 * VERIFY_MAX);
+				memset(test, 0x55, 16 * VERIFY_MAX);
+				want = checks[c].run(&tiers[0], n, ref);
+				got = checks[c].run(&tiers[level], n, test);
+				if (want != got || memcmp(ref, test, 16 * VERIFY_MAX) != 0) {
+					printf("%-14s %-7s length %5i differs from scalar\n",
+						checks[c].name, level_names[level], n);
+					failed++;
+				}
+			}
+		}
+	}
+	printf("%s\n", failed ? "FAILED" : "every level matches scalar");
+	free(ref);
+	free(test);
+	return failed;
+}
+
+static int selected(const char *name, char **kernels, int kernel_count)
+{
+	int i;
+	if (!kernel_count) {
+		return 1;}
+	for (i=0; i<kernel_count; i++) {
+		if (strstr(name, kernels[i])) {
+			return 1;}
+	}
+	return 0;
+}
+
+static void report(int json, int *first, struct bench *b, const char *simd, struct result r)
+{
+	double msps = 1e3 / r.ns;
+	if (json) {
+		printf("%s\n    {\"kernel\": \"%s\", \"simd\": \"%s\", \"unit\": \"%s\", \"block\": %i, "
+			"\"ns_per_sample\": %.4f, \"msps\": %.2f, \"cycles_per_sample\": ",
+			*first ? "" : ",", b->name, simd, b->unit, b->samples, r.ns, msps);
+		if (r.cycles >= 0) {
+			printf("%.3f}", r.cycles);}
+		else {
+			printf("null}");}
+	} else {
+		printf("%-18s %-7s %-6s %7i %10.3f %10.2f ", b->name, simd, b->unit, b->samples, r.ns, msps);
+		if (r.cycles >= 0) {
+			printf("%12.2f\n", r.cycles);}
+		else {
+			printf("%12s\n", "-");}
+	}
+	*first = 0;
+	fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, i, level, reached, json = 0, first = 1, errors = 0, verify = 0;
+	int kernel_count = 0, only_level = -1, top;
+	char *kernels[BENCH_COUNT];
+	double seconds = 0.2, clock_ghz = 0.0;
+	struct dsp_kernels tiers[LEVELS];
+	int have[LEVELS];
+	while ((opt = getopt(argc, argv, "k:s:t:c:ejlvh")) != -1) {
+		switch (opt) {
+		case 'k':
+			if (kernel_count < BENCH_COUNT) {
+				kernels[kernel_count++] = optarg;}
+			break;
+		case 's':
+			for (i=0; i<LEVELS; i++) {
+				if (strcmp(optarg, level_names[i]) == 0) {
+					only_level = i;}
+			}
+			if (only_level < 0) {
+				fprintf(stderr, "Unknown simd level '%s'.\n", optarg);
+				exit(1);
+			}
+			break;
+		case 't':
+			seconds = atof(optarg);
+			break;
+		case 'c':
+			clock_ghz = atof(optarg);
+			break;
+		case 'e':
+			errors = 1;
+			break;
+		case 'j':
+			json = 1;
+			break;
+		case 'v':
+			verify = 1;
+			break;
+		case 'l':
+			for (i=0; i<BENCH_COUNT; i++) {
+				printf("%s\n", benches[i].name);}
+			exit(0);
+		case 'h':
+		default:
+			usage();
+			break;
+		}
+	}
+
+	/* the table dsp_init() would pick, then every level on its own */
+	dsp_init();
+	top = 0;
+	for (level=0; level<LEVELS; level++) {
+		reached = dsp_init_level(&tiers[level], level);
+		have[level] = reached == level;
+		if (have[level]) {
+			top = level;}
+	}
+	if (only_level >= 0 && !have[only_level]) {
+		fprintf(stderr, "This cpu has no %s.\n", level_names[only_level]);
+		exit(1);
+	}
+	if (verify) {
+		return verify_tiers(tiers, have) ? 1 : 0;}
+	signals_init();
+	if (errors) {
+		dsp = tiers[top];
+		disc_errors();
+		return 0;
+	}
+
+	if (json) {
+		printf("{\n  \"dsp_init\": \"%s\",\n  \"tsc\": %s,\n  \"seconds\": %.3f,\n  \"results\": [",
+			dsp.name, clock_ghz <= 0 && tsc() ? "true" : "false", seconds);
+	} else {
+		printf("%-18s %-7s %-6s %7s %10s %10s %12s\n", "kernel", "simd", "unit", "block",
+			"ns/sample", "MS/s", "cycles/sample");
+	}
+	for (i=0; i<BENCH_COUNT; i++) {
+		struct bench *b = &benches[i];
+		if (!selected(b->name, kernels, kernel_count)) {
+			continue;}
+		if (b->run == run_fft_fftw && !fft_fftw) {
+			continue;}
+		if (!b->tiered) {
+			if (only_level > 0) {
+				continue;}
+			dsp = tiers[top];
+			report(json, &first, b, "none", measure(b, seconds, clock_ghz));
+			continue;
+		}
+		for (level=0; level<LEVELS; level++) {
+			if (!have[level] || (only_level >= 0 && level != only_level)) {
+				continue;}
+			dsp = tiers[level];
+			report(json, &first, b, level_names[level], measure(b, seconds, clock_ghz));
+		}
+	}
+	if (json) {
+		printf("\n  ]\n}\n");}
+
+	fclose(null_file);
+	fft_plan_free(fft_builtin);
+	if (fft_fftw) {
+		fft_plan_free(fft_fftw);}
+	return 0;
+}
+
+// vim: tabstop=8:softtabstop=8:shiftwidth=8:noexpandtab